@@ -16,6 +16,8 @@ function, memory allocator, and some other commonly used functions. */
 
 
 #include "aspic.h"
+#include <fcntl.h>
+#include <unistd.h>
 
 
 
@@ -23,14 +25,14 @@ function, memory allocator, and some other commonly used functions. */
 *                 Global variables               *
 *************************************************/
 
-FILE *main_input;
-FILE *out_file;
+input_file *main_input;
 
 includestr *included_from = NULL;   /* chain for included files */
 includestr *spare_included = NULL;  /* chain of spare blocks */
 uschar **file_line_stack;           /* line stack for included files */
 int *file_chptr_stack;              /* chptr stack ditto */
 int inc_stack_ptr = 0;              /* stack position */
+int cond_depth = 0;                 /* number of open conditionals */
 void *spare_lines = NULL;           /* chain of re-usable input lines */
 
 item *main_item_base;               /* root of chain of drawing items */
@@ -44,27 +46,37 @@ BOOL translate_chars = FALSE;  /* don't translate by default */
 
 uschar **in_line_stack;        /* stack of pointers to saved in_lines */
 int *chptr_stack;	       /* stack of saved chptrs */
-int max_level = 0;             /* uppermost level used */
-int min_level = 0;             /* lowermost level used */
 int *mac_count_stack;          /* stack of macro invocation counts */
 int mac_stack_ptr = 0;         /* the stack position */
 int macro_count;	       /* for generating id's */
 int macro_id;
-int minimum_thickness = 0;     /* this is ok for EPS */
+dimen minimum_thickness = 0;   /* this is ok for EPS */
 int outstyle = OUT_UNSET;      /* output style */
-int resolution = 1;            /* default resolution is now exact */
+dimen resolution = 1;          /* default resolution is now exact */
 int subs_ptr;                  /* offset for substitution errors */
 
-int joined_xx;                 /* Coordinates of explicit join position */
-int joined_yy;
+dimen joined_xx;               /* Coordinates of explicit join position */
+dimen joined_yy;
 
 macro *macroot = NULL;         /* root of all macros */
 macro *macactive = NULL;       /* chain of active macros */
 macro *spare_macros = NULL;    /* chain of re-usable macro blocks */
+tree_node *spare_locals = NULL; /* chain of re-usable local variables */
 
+static loop *spare_loops = NULL;          /* chain of re-usable loop blocks */
+static mac_line *spare_loop_lines = NULL; /* ditto loop body lines */
+static inner_body *spare_inner_bodies = NULL; /* ditto kept inner bodies */
+static mac_arg *spare_data_args = NULL;   /* ditto data argument blocks */
+
+BOOL minimize = FALSE;         /* compact output */
 BOOL no_variables = FALSE;     /* variables are available by default */
 BOOL reading = FALSE;          /* true while reading */
+BOOL strings_centred = FALSE;  /* at least one string is centred */
 BOOL strings_exist = FALSE;    /* at least one item has a string */
+BOOL strings_right = FALSE;    /* at least one string is right-justified */
+BOOL strings_rotated = FALSE;  /* at least one string is rotated */
+BOOL style_classes = FALSE;    /* write SVG styles as classes */
+BOOL svg_compressed = FALSE;   /* compress SVG output */
 BOOL substituting = FALSE;     /* true while substituting variables */
 BOOL testing = FALSE;          /* suppress version in output */
 
@@ -117,7 +129,7 @@ static uschar *error_messages[] = {
   US"Line too long while substituting \"%s\" - processing abandoned", /* 25 */
   US"Line too long while substituting - processing abandoned",  /* 26 */
   US"Missing } after \"${%s\"",                             /* 27 */
-  US"Only one of -[e]ps or -svg is allowed",                /* 28 */
+  US"Only one of -[e]ps, -svg, or -pdf is allowed",         /* 28 */
   US"File name expected",                                   /* 29 */
   US"\"include\" is not allowed in a macro",                /* 30 */
   US"Memory allocation failure for malloc(%d)",             /* 31 */
@@ -133,6 +145,33 @@ static uschar *error_messages[] = {
   US"Recursive macro call not allowed - processing abandoned", /* 41 */
   US"The \"align\" option is not valid for a sloping line", /* 42 */
   US"Variable name is too long in substitution",            /* 43 */ 
+  US"End of file while reading loop body - processing abandoned", /* 44 */
+  US"Loop step must not be zero",                           /* 45 */
+  US"Macro calls and loops are nested too deeply - processing abandoned", /* 46 */
+  US"Division by zero in expression",                       /* 47 */
+  US"Group definitions may not be nested",                  /* 48 */
+  US"End of file inside group \"%s\"",                      /* 49 */
+  US"Unknown group \"%s\"",                                 /* 50 */
+  US"Scale factor must be greater than zero",               /* 51 */
+  US"Duplicate \"%s\" in conditional",                       /* 52 */
+  US"Conditionals are nested too deeply - processing abandoned", /* 53 */
+  US"\"%s\" without matching \"if\"",                        /* 54 */
+  US"Missing \"endif\" at end of file",                       /* 55 */
+  US"Malformed variable definition \"%s\" for -D",          /* 56 */
+  US"Grid rows and columns must be in the range 1 to %d",   /* 57 */
+  US"Label \"%s\" is too long to be subscripted",           /* 58 */
+  US"More strings than grid cells",                         /* 59 */
+  US"Unknown macro \"%s\"",                                 /* 60 */
+  US"Line %d of data file \"%s\" is too long",              /* 61 */
+  US"Macro \"%s\" has more than %d arguments",              /* 62 */
+  US"Invalid position in line %d of data file \"%s\"",      /* 63 */
+  US"At least %d points are needed",                        /* 64 */
+  US"Number too large (maximum %d)",                        /* 65 */
+  US"\"local\" can be used only in a macro",                /* 66 */
+  US"Local variable name is too long (maximum %d)",         /* 67 */
+  US"Failed to write output: %s",                           /* 68 */
+  US"Line %d of data file \"%s\" makes a line too long - processing abandoned", /* 69 */
+  US"Output is too large for a memory buffer of %d bytes",  /* 70 */
   };
 
 #define ERROR_COUNT (sizeof(error_messages)/sizeof(char *))
@@ -175,8 +214,9 @@ if (reading)
   if (substituting)
     {
     ptr = subs_ptr;
-    fprintf(stderr, "%s", CS in_raw);
-    if (in_raw[Ustrlen(in_raw)-1] != '\n') fprintf(stderr, "\n");
+    fprintf(stderr, "%.*s", in_raw_length, CS in_raw);
+    if (in_raw_length == 0 || in_raw[in_raw_length-1] != '\n')
+      fprintf(stderr, "\n");
     }
   else if (chptr > 0)
     {
@@ -231,7 +271,9 @@ if (++error_count > MAX_ERRORS)
 
 /* Small blocks are carved out of larger chunks. The size is rounded up to a
 multiple of the pointer size, which should mean that each block is aligned for
-any data type.
+any data type. A large block, such as the points of a long polyline, gets a
+chunk of its own, which is put on the chain behind the current chunk so that
+the rest of that chunk can still be used.
 
 Argument:   size wanted
 Returns:    pointer to the store
@@ -246,12 +288,27 @@ size_t available = MEMORY_CHUNKSIZE - mem_top;
 size = (size + sizeof(char *) - 1);
 size -= size % sizeof(char *);
 
-if (size > MEMORY_CHUNKSIZE - sizeof(char *))
+if (size > MEMORY_CHUNKSIZE/4)
   {
-  /* LCOV_EXCL_START */
-  error_moan(15, size);
-  exit(EXIT_FAILURE);
-  /* LCOV_EXCL_STOP */
+  char *newblock = malloc(size + sizeof(char *));
+  if (newblock == NULL)
+    {
+    /* LCOV_EXCL_START */
+    error_moan(31, (int)(size + sizeof(char *)));
+    exit(EXIT_FAILURE);
+    /* LCOV_EXCL_STOP */
+    }
+  if (mem_anchor == NULL)
+    {
+    *((void **)newblock) = NULL;
+    mem_anchor = newblock;
+    }
+  else
+    {
+    *((void **)newblock) = *((void **)mem_anchor);
+    *((void **)mem_anchor) = newblock;
+    }
+  return newblock + sizeof(char *);
   }
 
 if (available < size)
@@ -278,6 +335,35 @@ return yield;
 
 
 
+/*************************************************
+*        Multiply two fixed-point values         *
+*************************************************/
+
+/* The result is limited to the largest dimension. A product that would not fit
+in 64 bits is certainly too large, so it is not formed. Dimensions are limited
+so that sums of them never overflow.
+
+Arguments:
+  a          the first value
+  b          the second value
+
+Returns:     the fixed-point product
+*/
+
+dimen
+fixmul(dimen a, dimen b)
+{
+dimen n;
+if (a != 0 && llabs(b) > LLONG_MAX/llabs(a))
+  return ((a < 0) != (b < 0))? -FIXED_MAX : FIXED_MAX;
+n = (a * b)/1000;
+if (n > FIXED_MAX) return FIXED_MAX;
+if (n < -FIXED_MAX) return -FIXED_MAX;
+return n;
+}
+
+
+
 /*************************************************
 *               Get a new input line             *
 *************************************************/
@@ -332,12 +418,224 @@ return yield;
 void
 freemacro(macro *p)
 {
+free_locals(p);
 p->previous = spare_macros;
 spare_macros = p;
 }
 
 
 
+/*************************************************
+*          Get a new local variable              *
+*************************************************/
+
+/* Local variables are kept on a short chain for each active macro, and the
+blocks are re-used after the macro has finished, so that calling a macro many
+times does not use more and more store. The value buffer follows the name in
+the same block, and is large enough for any value that can be read.
+
+Arguments:
+  m          the macro frame
+  name       the variable name
+
+Returns:     the new variable, with an empty value
+*/
+
+tree_node *
+getlocal(macro *m, uschar *name)
+{
+tree_node *tn;
+if (spare_locals == NULL)
+  tn = getstore(sizeof(tree_node) + LOCAL_NAMESIZE + INPUT_LINESIZE);
+else
+  {
+  tn = spare_locals;
+  spare_locals = tn->left;
+  }
+Ustrcpy(tn->name, name);
+tn->value = LOCAL_VALUE(tn);
+tn->value[0] = 0;
+tn->left = m->locals;
+m->locals = tn;
+return tn;
+}
+
+
+
+/*************************************************
+*        Save the local variables of a macro     *
+*************************************************/
+
+/* The blocks are put on the spare chain for re-use.
+
+Argument:  the macro frame
+Returns:   nothing
+*/
+
+void
+free_locals(macro *m)
+{
+while (m->locals != NULL)
+  {
+  tree_node *tn = m->locals;
+  m->locals = tn->left;
+  tn->left = spare_locals;
+  spare_locals = tn;
+  }
+}
+
+
+
+/*************************************************
+*          Get a new loop block                  *
+*************************************************/
+
+/* Loop blocks, the lines of loop bodies, and the argument blocks of the "data"
+command are re-used after a loop has finished, so that obeying a loop command
+many times, for example within another loop, does not use more and more store.
+So that any body line can be re-used for any other, they are all large enough
+for a whole input line and the space that is added at the end of a body. */
+
+loop *
+getloop(void)
+{
+loop *yield;
+if (spare_loops == NULL) return getstore(sizeof(loop));
+yield = spare_loops;
+spare_loops = yield->next;
+return yield;
+}
+
+
+/* Get a block for one line of a loop body */
+
+mac_line *
+get_loop_line(void)
+{
+mac_line *yield;
+if (spare_loop_lines == NULL)
+  return getstore(INPUT_LINESIZE + 2 + offsetof(mac_line, text));
+yield = spare_loop_lines;
+spare_loop_lines = yield->next;
+return yield;
+}
+
+
+/* Get a block for keeping the body of an inner loop */
+
+inner_body *
+get_inner_body(void)
+{
+inner_body *yield;
+if (spare_inner_bodies == NULL) return getstore(sizeof(inner_body));
+yield = spare_inner_bodies;
+spare_inner_bodies = yield->next;
+return yield;
+}
+
+
+/* Get a block for one argument of a macro that is obeyed by "data" */
+
+mac_arg *
+get_data_arg(void)
+{
+mac_arg *yield;
+if (spare_data_args == NULL)
+  return getstore(DATA_ROWSIZE + offsetof(mac_arg, text));
+yield = spare_data_args;
+spare_data_args = yield->next;
+return yield;
+}
+
+
+
+/*************************************************
+*          Save re-usable loop body lines        *
+*************************************************/
+
+/* The inner loop bodies that were kept by the lines are saved as well.
+
+Argument:  the first line
+Returns:   nothing
+*/
+
+static void
+free_loop_lines(mac_line *line)
+{
+while (line != NULL)
+  {
+  mac_line *next = line->next;
+  while (line->inner != NULL)
+    {
+    inner_body *ib = line->inner;
+    line->inner = ib->next;
+    free_loop_lines(ib->body);
+    ib->next = spare_inner_bodies;
+    spare_inner_bodies = ib;
+    }
+  line->next = spare_loop_lines;
+  spare_loop_lines = line;
+  line = next;
+  }
+}
+
+
+
+/*************************************************
+*          Save a re-usable loop block           *
+*************************************************/
+
+/* The body lines of a "repeat" or "for" loop belong to it, and are saved for
+re-use, unless they are kept by a line of an outer loop's body; those of a
+"data" loop belong to its macro. The argument blocks of a "data" loop are
+saved.
+
+Argument:  the loop block
+Returns:   nothing
+*/
+
+void
+freeloop(loop *lp)
+{
+if (lp->data == NULL && !lp->keepbody) free_loop_lines(lp->body);
+lp->body = NULL;
+
+while (lp->args != NULL)
+  {
+  mac_arg *arg = lp->args;
+  lp->args = arg->next;
+  arg->next = spare_data_args;
+  spare_data_args = arg;
+  }
+
+lp->next = spare_loops;
+spare_loops = lp;
+}
+
+
+
+/*************************************************
+*           Find a local variable                *
+*************************************************/
+
+/* The locals of each active macro are searched, starting with the innermost,
+so a macro can see the locals of the macros that called it.
+
+Argument:  the variable name
+Returns:   the variable, or NULL if there is no such local
+*/
+
+tree_node *
+find_local(uschar *name)
+{
+for (macro *m = macactive; m != NULL; m = m->previous)
+  for (tree_node *tn = m->locals; tn != NULL; tn = tn->left)
+    if (Ustrcmp(tn->name, name) == 0) return tn;
+return NULL;
+}
+
+
+
 /*************************************************
 *             Close all input files              *
 *************************************************/
@@ -350,15 +648,16 @@ close_all_input(void)
 {
 while (included_from != NULL)
   {
-  fclose(main_input);
+  input_close(main_input);
   main_input = included_from->prevfile;
   included_from = included_from->prev;
   }
-if (main_input != NULL && main_input != stdin)
+if (main_input != NULL)
   {
-  fclose(main_input);
+  input_close(main_input);
   main_input = NULL;
   }
+input_release_cache();
 }
 
 
@@ -428,6 +727,46 @@ return timebuf;
 
 
 
+/*************************************************
+*       Define a variable from the command line  *
+*************************************************/
+
+/* The argument of -D is a variable name, optionally followed by "=" and a
+value. If there is no value, the variable is set to "1". A later definition of
+the same variable overrides an earlier one.
+
+Argument:   the argument of -D
+Returns:    TRUE if all is well
+*/
+
+static BOOL
+define_variable(uschar *def)
+{
+tree_node *tn;
+uschar *value = US"1";
+uschar *p = def;
+size_t len;
+
+while (isalpha(*p) || isdigit(*p)) p++;
+len = p - def;
+if (len == 0 || len >= 64 || (*p != 0 && *p != '=')) return FALSE;
+if (*p == '=') value = p + 1;
+
+*p = 0;
+tn = tree_search(varroot, def);
+if (tn == NULL)
+  {
+  tn = getstore(sizeof(tree_node) + len);
+  Ustrcpy(tn->name, def);
+  (void)tree_insertnode(&varroot, tn);
+  }
+tn->value = getstore(Ustrlen(value) + 1);
+Ustrcpy(tn->value, value);
+return TRUE;
+}
+
+
+
 /*************************************************
 *                 Usage                          *
 *************************************************/
@@ -446,18 +785,26 @@ void usage(FILE *f)
 {
 fprintf(f, "Usage: aspic [<options>] [<input> [<output>]]\n\n");
 fprintf(f, "Options:\n");
+fprintf(f, "  -D name[=val]  set variable (default value \"1\")\n");
 fprintf(f, "  -[-]help       show usage information and exit\n");
 fprintf(f, "  -nv            disable variable substitutions\n");
+fprintf(f, "  -pdf           generate PDF\n");
 fprintf(f, "  -[e]ps         generate Encapsulated PostScript\n");
+fprintf(f, "  -epsmin        generate compact Encapsulated PostScript\n");
 fprintf(f, "  -svg           generate SVG\n");
+fprintf(f, "  -svgclass      write SVG styles once, as classes\n");
+fprintf(f, "  -svgmin        generate minimized SVG\n");
+fprintf(f, "  -svgz          compress SVG output (gzip format)\n");
 fprintf(f, "  -testing       used by 'make test'\n");
+fprintf(f, "  -testmem n     used by 'make test' (output via memory)\n");
 fprintf(f, "  -tr            translate quotes and double-hyphens\n");
 fprintf(f, "  -v             show version and exit\n");
 fprintf(f, "  -[-]version    show version and exit\n\n");
 
 fprintf(f, "The default output format is Encapsulated PostScript.\n");
-fprintf(f, "Only one of -[e]ps or -svg is permitted.\n");
-fprintf(f, "Default output file is base <input> with .eps or .svg extension.\n");
+fprintf(f, "Only one of -[e]ps, -svg, or -pdf is permitted.\n");
+fprintf(f, "Default output file is base <input> with .eps, .svg, .svgz, or .pdf\n");
+fprintf(f, "extension.\n");
 fprintf(f, "Omit file names or use \"-\" for stdin and stdout.\n");
 }
 
@@ -473,6 +820,7 @@ main(int argc, char **argv)
 tree_node *tn;
 uschar timebuf[sizeof("www, dd-mmm-yyyy hh:mm:ss +zzzz")];
 int firstarg = 1;       /* points after options */
+int memsize = 0;        /* size of memory buffer for -testmem */
 BOOL input_is_stdin = FALSE;
 
 if (atexit(tidy_up) != 0)
@@ -485,7 +833,6 @@ if (atexit(tidy_up) != 0)
 
 /* Get memory for input lines */
 
-in_raw  = get_in_line();
 in_line = get_in_line();
 in_prev = get_in_line();
 in_prev[0] = 0;		/* to avoid junk in error messages */
@@ -504,6 +851,7 @@ file_chptr_stack = getstore(MAC_STACKSIZE * sizeof(int));
 pi = 4 * atan2(1.0, 1.0);
 black.red = black.green = black.blue = 0;
 unfilled.red = unfilled.green = unfilled.blue = -1000;
+init_font_chars();
 
 /* Handle command-line options */
 
@@ -514,12 +862,49 @@ while (firstarg < argc && argv[firstarg][0] == '-' && argv[firstarg][1] != 0)
     no_variables = TRUE;
   else if (Ustrcmp(arg, "-testing") == 0)
     testing = TRUE;
+  else if (Ustrcmp(arg, "-testmem") == 0)
+    {
+    memsize = (firstarg < argc)? atoi(argv[firstarg++]) : 0;
+    if (memsize <= 0)
+      {
+      error_moan(0, arg);
+      usage(stderr);
+      exit(EXIT_FAILURE);
+      }
+    }
   else if (Ustrcmp(arg, "-ps") == 0 || Ustrcmp(arg, "-eps") == 0)
     { if (outstyle == OUT_UNSET) outstyle = OUT_EPS; else error_moan(28); }
+  else if (Ustrcmp(arg, "-epsmin") == 0)
+    {
+    if (outstyle == OUT_UNSET) outstyle = OUT_EPS; else error_moan(28);
+    minimize = TRUE;
+    }
   else if (Ustrcmp(arg, "-svg") == 0)
     { if (outstyle == OUT_UNSET) outstyle = OUT_SVG; else error_moan(28); }
+  else if (Ustrcmp(arg, "-pdf") == 0)
+    { if (outstyle == OUT_UNSET) outstyle = OUT_PDF; else error_moan(28); }
+  else if (Ustrcmp(arg, "-svgclass") == 0)
+    style_classes = TRUE;
+  else if (Ustrcmp(arg, "-svgz") == 0)
+    svg_compressed = TRUE;
+  else if (Ustrcmp(arg, "-svgmin") == 0)
+    {
+    if (outstyle == OUT_UNSET) outstyle = OUT_SVG; else error_moan(28);
+    minimize = TRUE;
+    }
   else if (Ustrcmp(arg, "-tr") == 0)
     translate_chars = TRUE;
+  else if (Ustrncmp(arg, "-D", 2) == 0)
+    {
+    if (arg[2] != 0) arg += 2;
+      else arg = (firstarg < argc)? US argv[firstarg++] : US"";
+    if (!define_variable(arg))
+      {
+      error_moan(56, arg);
+      usage(stderr);
+      exit(EXIT_FAILURE);
+      }
+    }
   else if (Ustrcmp(arg, "-v") == 0 || Ustrcmp(arg, "-version") == 0 ||
            Ustrcmp(arg, "--version") == 0)
     {
@@ -540,21 +925,22 @@ while (firstarg < argc && argv[firstarg][0] == '-' && argv[firstarg][1] != 0)
     }
   }
 
-/* Default output style is EPS */
+/* Default output style is EPS, unless -svgclass or -svgz was given alone */
 
-if (outstyle == OUT_UNSET) outstyle = OUT_EPS;
+if (outstyle == OUT_UNSET)
+  outstyle = (style_classes || svg_compressed)? OUT_SVG : OUT_EPS;
 
 /* If no file name is given, or it is "-", read the standard input. Otherwise,
 try to open the input file. */
 
 if (firstarg >= argc || Ustrcmp(argv[firstarg], "-") == 0)
   {
-  main_input = stdin;
+  main_input = input_open(NULL);
   input_is_stdin = TRUE;
   }
 else
   {
-  if ((main_input = fopen(argv[firstarg], "r")) == NULL)
+  if ((main_input = input_open(US argv[firstarg])) == NULL)
     {
     error_moan(1, argv[firstarg], "input", strerror(errno));
     exit(EXIT_FAILURE);
@@ -588,6 +974,7 @@ switch (outstyle)
   {
   case OUT_EPS: init_ps(); break;
   case OUT_SVG: init_sv(); break;
+  case OUT_PDF: init_pdf(); break;
   }
 
 /* Process the input and then write the output if successful. */
@@ -605,6 +992,8 @@ else
   {
   char *outname = NULL;
   char outnamebuff[256];
+  uschar *membuffer = NULL;
+  int fd = STDOUT_FILENO;
 
   /* If there is no output file name, and input is not stdin, create a name by
   adjusting the extension. */
@@ -621,7 +1010,8 @@ else
       switch (outstyle)
         {
         case OUT_EPS: strcpy(dot, ".eps"); break;
-        case OUT_SVG: strcpy(dot, ".svg"); break;
+        case OUT_SVG: strcpy(dot, svg_compressed? ".svgz" : ".svg"); break;
+        case OUT_PDF: strcpy(dot, ".pdf"); break;
         }
       }
     }
@@ -636,13 +1026,25 @@ else
 
   if (outname != NULL)
     {
-    if ((out_file = fopen(outname, "w")) == NULL)
+    fd = open(outname, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (fd < 0)
       {
       error_moan(1, outname, "output", strerror(errno));
       exit(EXIT_FAILURE);
       }
     }
-  else out_file = stdout;
+
+  /* For testing, the output can be generated in a memory buffer and then
+  copied to the file. */
+
+  if (memsize > 0)
+    {
+    membuffer = getstore(memsize);
+    out_open_memory(membuffer, memsize);
+    }
+  else out_open_fd(fd);
+
+  if (outstyle == OUT_SVG && svg_compressed) out_compress(ZIP_GZIP);
 
   /* Generate output of the appropriate type */
 
@@ -650,9 +1052,23 @@ else
     {
     case OUT_EPS: write_ps(); break;
     case OUT_SVG: write_sv(); break;
+    case OUT_PDF: write_pdf(); break;
+    }
+
+  if (membuffer != NULL)
+    {
+    long int len = out_close();
+    if (len < 0)
+      {
+      if (fd != STDOUT_FILENO) close(fd);
+      error_moan(70, memsize);
+      exit(EXIT_FAILURE);
+      }
+    out_open_fd(fd);
+    out_bytes(membuffer, len);
     }
 
-  if (out_file != stdout) fclose(out_file);
+  (void)out_close();
   }
 
 return had_error? EXIT_FAILURE : EXIT_SUCCESS;
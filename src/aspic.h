@@ -18,6 +18,7 @@
 #include <string.h>
 #include <limits.h>
 #include <time.h>
+#include <sys/types.h>
 
 #include "mytypes.h"
 
@@ -25,16 +26,40 @@
 
 #define Version_String "2.01-DEV (25-January-2023)"
 
-#define UNSET INT_MAX          /* For unset parameters */
+#define UNSET LLONG_MAX        /* For unset parameters */
+#define FIXED_MAX 1000000000000LL  /* Largest dimension (10^9 points) */
 #define MEMORY_CHUNKSIZE 4096
+#define OUT_BUFFERSIZE 65536   /* Output buffer for files */
+#define FIXED_SIZE 24          /* Buffer for a fixed-point number */
 #define INPUT_LINESIZE 256
 #define MAC_STACKSIZE 20       /* Macro stacksize */
+#define COND_STACKSIZE 32      /* Maximum nesting of conditionals */
+#define GRID_MAX 1000          /* Maximum grid rows or columns */
+#define DATA_ROWSIZE 1024      /* Maximum size of used fields in a data row */
+#define DATA_MAXFIELDS 64      /* Maximum fields used from a data row */
+#define DATA_NAMESIZE 256      /* Maximum length of data file name + 1 */
 #define MAX_ERRORS 100
 #define WORD_SIZE 256
+#define LOCAL_NAMESIZE 64      /* Maximum length of local variable name */
 
 /* Macro to apply magnification to a dimension */
 
-#define mag(x) ((x * env->magnification)/1000)
+#define mag(x) fixmul(x, env->magnification)
+
+/* Macro to add one byte to the output. */
+
+#define out_char(c) \
+  do { if (out_ptr >= out_end) out_flush(); *out_ptr++ = (uschar)(c); } \
+  while (0)
+
+/* The value of a local variable is held in the same block, after its name. */
+
+#define LOCAL_VALUE(tn) ((tn)->name + LOCAL_NAMESIZE)
+
+/* Macro to test for the start of a number, which may be an expression in
+parentheses. */
+
+#define isnumstart(c) (isdigit((int)(c)) || (c) == '(')
 
 /* Macro to get the next UTF-8 character, advancing the pointer. */
 
@@ -60,12 +85,17 @@
 
 /* Output types */
 
-enum { OUT_UNSET, OUT_EPS, OUT_SVG };
+enum { OUT_UNSET, OUT_EPS, OUT_SVG, OUT_PDF };
+
+/* Compression formats */
+
+enum { ZIP_GZIP, ZIP_ZLIB };
 
 /* Item types - box is also used for circles and ellipses */
 
-enum { i_arc, i_box, i_curve, i_line, i_text };
-enum { box_box, box_circle, box_ellipse };
+enum { i_arc, i_box, i_curve, i_line, i_poly, i_text };
+enum { box_box, box_circle, box_ellipse, box_place };
+enum { poly_open, poly_closed, poly_smooth };
 
 /* Item "style"s */
 
@@ -83,6 +113,7 @@ enum { north, northeast, east, southeast, south, southwest, west, northwest,
 /* Types of optional argument */
 
 enum { opt_bool,            /* no data; set first arg; unset second arg */
+       opt_dash,            /* no data; set first arg (a dimension) non-zero */
        opt_xline,           /* one x dimension; set first arg; zero second arg if UNSET */
        opt_xnline,          /* one x dimension; set first arg negative; zero second arg if UNSET */
        opt_yline,           /* one y dimension; set first arg; zero second arg if UNSET */
@@ -95,9 +126,14 @@ enum { opt_bool,            /* no data; set first arg; unset second arg */
        opt_join,	    /* position specified by joining point */
        opt_angle,           /* one angle */
        opt_int,             /* integer */
-       opt_dir              /* no data; sets direction from table data */
+       opt_dir,             /* no data; sets direction from table data */
+       opt_number           /* signed number, not magnified */
 };
 
+/* Token types produced by the line lexer */
+
+enum { tok_word, tok_number, tok_string, tok_punct };
+
 /* Values in the special fonts characters table (Symbol or Dingbats) */
 
 enum { SF_SYMB, SF_DBAT };
@@ -108,13 +144,59 @@ enum { SF_SYMB, SF_DBAT };
 *              Structures                        *
 *************************************************/
 
+/* Dimensions and positions are held in fixed point, in thousandths of a point.
+They are 64 bits long, so that very large pictures can be drawn. */
+
+typedef long long int dimen;
+
+/* Structure for an input file. A regular file is mapped into memory; others
+are read a line at a time into a buffer. */
+
+typedef struct input_file {
+  struct input_file *prev;    /* For the chain of spare blocks */
+  FILE *file;                 /* NULL if mapped */
+  uschar *map;                /* Start of mapped data */
+  uschar *mapend;             /* End of mapped data */
+  uschar *next;               /* Next line in mapped data */
+  uschar *buffer;             /* Line buffer if not mapped */
+  uschar *rowbuffer;          /* For data rows longer than the line buffer */
+  int rowsize;                /* Size of rowbuffer */
+} input_file;
+
+/* Structure for a cached mapping of a regular file */
+
+typedef struct mapped_file {
+  struct mapped_file *next;
+  dev_t dev;                  /* These four fields identify the file */
+  ino_t ino;
+  time_t mtime;
+  off_t size;
+  uschar *map;                /* Start of mapped data */
+} mapped_file;
+
 /* Structure for included files */
 
 typedef struct includestr {
   struct includestr *prev;
-  FILE *prevfile;
+  input_file *prevfile;
+  int prevunsubstituted;      /* Saved value of "unsubstituted" */
+  int prevcond;               /* Conditional depth at the include */
 } includestr;
 
+/* Structure for a token in the current input line. All the offsets are into
+in_line. For a number, "end" is after any fractional part, whereas "wordend" is
+the end of the run of letters and digits that readword() would take. */
+
+typedef struct token {
+  int type;
+  int start;
+  int end;
+  int wordend;
+  int intend;         /* End of integer part of a number */
+  dimen value;        /* Fixed point value of a number */
+  int intvalue;       /* Integer part of a number */
+} token;
+
 /* Structure of command table entries */
 
 typedef struct {
@@ -133,6 +215,21 @@ typedef struct {
   int arg2;
 } arg_item;
 
+/* Structures for a table of optional arguments. The perfect hash table that
+is used for lookup is built from the list the first time the table is used. */
+
+typedef struct arg_slot {
+  uschar *name;               /* Option name or alternative spelling */
+  arg_item *item;
+} arg_slot;
+
+typedef struct arg_table {
+  arg_item *items;            /* List, ended by an empty name */
+  arg_slot *slots;            /* Hash table, NULL until built */
+  unsigned int seed;          /* Hash seed that gives no collisions */
+  unsigned int mask;          /* Hash table size - 1 */
+} arg_table;
+
 /* Structure to hold a colour definition */
 
 typedef struct colour {
@@ -146,9 +243,9 @@ typedef struct colour {
 typedef struct stringchain {
   struct stringchain *next;
   double rrotate;     /* Rotation in radians */
-  int rotate;         /* Rotation in degrees */
-  int xadjust;
-  int yadjust;
+  dimen rotate;       /* Rotation in degrees */
+  dimen xadjust;
+  dimen yadjust;
   int justify;
   int font;
   int chcount;        /* Count of chars, not bytes */
@@ -161,7 +258,9 @@ typedef struct stringchain {
 typedef struct bindfont {
   struct bindfont *next;
   int number;
-  int size;
+  dimen size;
+  BOOL needLower;     /* Parts of the font that are used */
+  BOOL needUpper;
   BOOL needSymbol;
   BOOL needDingbats;
   uschar name[1];     /* Variable length font neme */
@@ -174,68 +273,108 @@ typedef struct entity_block {
   int value;
 } entity_block;
 
-/* Structures for macro handling */
+/* Structures for macro handling. A line of a loop body keeps the bodies of
+any inner loops that start in it, once they have been read, so that they are
+not read and copied again on each iteration of the outer loop. */
 
 typedef struct mac_line {
   struct mac_line *next;
+  struct inner_body *inner; /* Inner loop bodies, or NULL */
   uschar text[1];     /* Variable length line */
 } mac_line;
 
+typedef struct inner_body {
+  struct inner_body *next;  /* Next in this line, or in the spare chain */
+  int start;                /* Offset of the body in the line's text */
+  mac_line *body;           /* The body lines */
+  mac_line *endline;        /* Line with the closing brace; NULL if the same */
+  int end;                  /* Offset after the closing brace */
+} inner_body;
+
 typedef struct mac_arg {
   struct mac_arg *next;
   uschar text[1];
 } mac_arg;
 
+/* Structure for a loop that is being obeyed. The body lines are raw; they are
+substituted afresh for each iteration. A loop is also used for the "data"
+command, when the body is that of a macro, and its arguments are set from each
+row of the data file. When a loop has finished, its block, its body lines, and
+its data argument blocks are kept for re-use. */
+
+typedef struct loop {
+  struct loop *next;        /* For the chain of spare blocks */
+  mac_line *body;           /* Chain of raw body lines */
+  BOOL keepbody;            /* The body is kept by an outer body's line */
+  struct tree_node *var;    /* Loop variable; NULL for "repeat" */
+  BOOL localvar;            /* The variable is a local one */
+  int count;                /* Number of iterations still to do */
+  dimen value;              /* Current value of the variable */
+  dimen step;               /* Increment for the variable */
+  uschar valbuf[FIXED_SIZE];/* Current value as a string */
+  input_file *data;         /* Data file, or NULL */
+  uschar dataname[DATA_NAMESIZE]; /* Name of data file */
+  mac_arg *args;            /* Arguments set from each row */
+  int argcount;             /* Number of arguments */
+  int row;                  /* Line number in the data file */
+} loop;
+
+/* A macro block is also used for an active loop; it then has no name. */
+
 typedef struct macro {
   struct macro *previous;
   uschar name[20];
   mac_line *nextline;
+  mac_line *thisline;       /* Current line of a loop body */
   int argcount;
   mac_arg *args;
+  loop *loop;               /* Non-NULL for an active loop */
+  int prevunsubstituted;    /* Saved value of "unsubstituted" */
+  struct tree_node *locals; /* Local variables, chained by "left" */
 } macro;
 
 /* Environment variables are held in a structure for eash stacking. */
 
 typedef struct environment {
   struct environment *previous;  /* link for stacking */
-  int arcradius;       /* default arc radius */
-  int arrow_x;         /* x distance for arrowhead */
-  int arrow_y;         /* y distance for arrowhead */
-  int boxdash1;        /* box dash parameters */
-  int boxdash2;
-  int boxwidth;        /* box width */
-  int boxthickness;    /* thickness of edge of boxes */
-  int boxdepth;        /* box depth */
+  dimen arcradius;     /* default arc radius */
+  dimen arrow_x;       /* x distance for arrowhead */
+  dimen arrow_y;       /* y distance for arrowhead */
+  dimen boxdash1;      /* box dash parameters */
+  dimen boxdash2;
+  dimen boxwidth;      /* box width */
+  dimen boxthickness;  /* thickness of edge of boxes */
+  dimen boxdepth;      /* box depth */
   colour boxcolour;    /* colour of box edges */
   colour boxfilled;    /* colour of box filling */
-  int cirdash1;        /* circle dash parameters */
-  int cirdash2;
+  dimen cirdash1;      /* circle dash parameters */
+  dimen cirdash2;
   colour circolour;    /* colour of circle edges */
-  int cirradius;       /* default circle radius */
-  int cirthickness;    /* default thickness of circle edges */
+  dimen cirradius;     /* default circle radius */
+  dimen cirthickness;  /* default thickness of circle edges */
   colour cirfilled;    /* colour of circle filling */
   int direction;       /* default direction */
-  int elldash1;        /* ellipse dash parameters */
-  int elldash2;
+  dimen elldash1;      /* ellipse dash parameters */
+  dimen elldash2;
   colour ellcolour;    /* ellipse edge colour */
-  int ellwidth;        /* ellipse width */
-  int elldepth;        /* ellipse depth */
-  int ellthickness;    /* ellipse edge thickness */
+  dimen ellwidth;      /* ellipse width */
+  dimen elldepth;      /* ellipse depth */
+  dimen ellthickness;  /* ellipse edge thickness */
   colour ellfilled;    /* colour of ellipse filling */
   colour shapefilled;  /* filled colour for shapes */
   colour arrowfilled;  /* filled colour for arrowheads */
-  int fontdepth;       /* text font depth */
+  dimen fontdepth;     /* text font depth */
   int setfont;         /* font number */
   colour textcolour;   /* text colour */
   int level;           /* drawing level */
-  int linedash1;       /* line dash parameters */
-  int linedash2;
-  int linedepth;       /* text linedepth */
-  int linethickness;   /* thickness of lines */
+  dimen linedash1;     /* line dash parameters */
+  dimen linedash2;
+  dimen linedepth;     /* text linedepth */
+  dimen linethickness; /* thickness of lines */
   colour linecolour;   /* colour of lines */
-  int line_hw;         /* default horizontal line width */
-  int line_vd;         /* default vertical line depth */
-  int magnification;   /* magnification */
+  dimen line_hw;       /* default horizontal line width */
+  dimen line_vd;       /* default vertical line depth */
+  dimen magnification; /* magnification */
 } environment;
 
 /* Use a macro for the common header for aspic "items" */
@@ -246,15 +385,15 @@ typedef struct environment {
   int level; \
   int type; \
   int style; \
-  int dash1; \
-  int dash2; \
-  int linedepth; \
-  int fontdepth; \
-  int thickness; \
+  dimen dash1; \
+  dimen dash2; \
+  dimen linedepth; \
+  dimen fontdepth; \
+  dimen thickness; \
   colour colour; \
   colour shapefilled; \
-  int x; \
-  int y
+  dimen x; \
+  dimen y
 
 /* Generic item structure */
 
@@ -262,11 +401,11 @@ typedef struct item {
   itemhdr;
 } item;
 
-/* Structure of label chain */
+/* Structure of the chain of labels for the next item. When the item is
+created, the labels are put into a tree, whose nodes point to the item. */
 
 typedef struct label {
   struct label *next;
-  item *itemptr;
   uschar name[20];
 } label;
 
@@ -277,18 +416,18 @@ typedef struct {
   double angle1;
   double angle2;
   int direction;
-  int radius;
-  int angle;
+  dimen radius;
+  dimen angle;
   int cw;
-  int depth;
-  int via_x;
-  int via_y;
+  dimen depth;
+  dimen via_x;
+  dimen via_y;
   int arrow_start;
   int arrow_end;
-  int arrow_x;
-  int arrow_y;
+  dimen arrow_x;
+  dimen arrow_y;
   colour arrow_filled;
-  int x0, y0, x1, y1;
+  dimen x0, y0, x1, y1;
 } item_arc;
 
 /* Box item (boxtype => box, circle, ellipse) */
@@ -296,40 +435,80 @@ typedef struct {
 typedef struct {
   itemhdr;
   int boxtype;
-  int width;
-  int depth;
+  dimen width;
+  dimen depth;
   int joinpoint;
   int pointjoined;
 } item_box;
 
+/* Group of items that is defined once and placed any number of times. The
+items are on their own chain, with coordinates relative to the group's origin.
+*/
+
+typedef struct group {
+  struct group *next;
+  item *items;
+  dimen bbox[4];      /* Bounding box of the items */
+  int number;         /* Used to name the group in the output */
+  BOOL used;          /* TRUE if the group has been placed */
+  uschar name[1];     /* Variable length group name */
+} group;
+
+/* Placement of a group. This is a box item with some additional fields, so
+that it can be positioned and referenced like a box, whose size is the
+bounding box of the transformed group. */
+
+typedef struct {
+  item_box box;
+  group *group;
+  dimen rotate;       /* Rotation in degrees */
+  dimen scale;        /* Scale factor */
+  dimen originx;      /* Offset of the group's origin from the centre */
+  dimen originy;
+} item_place;
+
 /* Curve item */
 
 typedef struct {
   itemhdr;
   int cw;
   int wavy;
-  int x0, y0, x1, y1;
-  int cx1, cy1, cx2, cy2;
-  int cxs, cys;
+  dimen x0, y0, x1, y1;
+  dimen cx1, cy1, cx2, cy2;
+  dimen cxs, cys;
 } item_curve;
 
 /* Line item */
 
 typedef struct {
   itemhdr;
-  int width;
-  int depth;
-  int endx;
-  int endy;
-  int alignx;
-  int aligny;
+  dimen width;
+  dimen depth;
+  dimen endx;
+  dimen endy;
+  dimen alignx;
+  dimen aligny;
   int arrow_start;
   int arrow_end;
-  int arrow_x;
-  int arrow_y;
+  dimen arrow_x;
+  dimen arrow_y;
   colour arrow_filled;
 } item_line;
 
+/* Polyline, polygon, or spline item. The points are absolute, and are packed
+into a vector of x,y pairs. For a spline, they are the start followed by three
+points for each Bezier segment: two control points and the end. The x and y
+fields in the header are the centre of the points' bounding box. */
+
+typedef struct {
+  itemhdr;
+  int closed;         /* TRUE for a polygon */
+  int smooth;         /* TRUE for a spline */
+  int count;          /* Number of points */
+  dimen x0, y0, x1, y1; /* First and last points */
+  dimen *points;
+} item_poly;
+
 /* Text item */
 
 typedef struct {
@@ -360,8 +539,9 @@ typedef struct u2sencod {
 *                  Global variables              *
 *************************************************/
 
-extern FILE   *main_input;        /* source input file */
-extern FILE   *out_file;          /* output file */
+extern input_file *main_input;    /* source input file */
+extern uschar *out_ptr;           /* current position in output buffer */
+extern uschar *out_end;           /* end of output buffer */
 extern item_box *drawbbox;        /* box item for bounding box */
 
 extern includestr *included_from; /* chain for included files */
@@ -369,18 +549,24 @@ extern includestr *spare_included;/* chain of spare blocks */
 extern uschar **file_line_stack;  /* saved lines for included files */
 extern int    *file_chptr_stack;  /* saved chptrs ditto */
 extern int    inc_stack_ptr;      /* stack position */
+extern int    cond_depth;         /* number of open conditionals */
 extern void   *spare_lines;       /* chain of re-usable input lines */
 
 extern item   *main_item_base;    /* base of chain of items */
 extern item   *lastitem;          /* last on list of items read */
 extern item   *baseitem;          /* item to base next item on */
+extern group  *group_base;        /* base of chain of groups */
 
-extern label  *label_base;        /* base of chain of labels */
+extern tree_node *label_root;     /* labels root */
 extern label  *nextlabel;         /* next label item */
 extern environment *env;          /* input environment */
 
 extern bindfont *font_base;       /* base of chain of font bindings */
 extern BOOL   translate_chars;    /* TRUE to translate quotes and dash */
+extern BOOL   capturing_loop;     /* TRUE while reading a loop body */
+extern BOOL   defining_macro;     /* TRUE while reading a macro body */
+extern loop   *pending_loop;      /* loop to start after its command */
+extern int    unsubstituted;      /* offset of raw text in in_line, or -1 */
 
 extern double pi;                 /* PI */
 
@@ -388,20 +574,23 @@ extern colour black;              /* For easy setting colours to black */
 extern colour unfilled;           /* An "impossible" colour */
 
 extern int    chptr;		  /* offset to next char */
-extern int    drawbboxoffset;	  /* draw bounding box offset */
+extern dimen  drawbboxoffset;	  /* draw bounding box offset */
 extern BOOL   endfile;		  /* TRUE when EOF reached */
 extern int    item_arg1;	  /* parameter 1 for items */
 extern int    item_arg2;	  /* parameter 2 for items */
-extern int    joined_xx;          /* explicit join point */
-extern int    joined_yy;
-extern int    max_level;          /* uppermost level used */
-extern int    min_level;          /* lowermost level used */
+extern dimen  joined_xx;          /* explicit join point */
+extern dimen  joined_yy;
 extern int    macro_count;        /* count of executed macros */
 extern int    macro_id;		  /* this macro's id */
-extern int    minimum_thickness;  /* minimum line thickness */
+extern dimen  minimum_thickness;  /* minimum line thickness */
 extern BOOL   no_variables;       /* disable variables */
-extern int    resolution;         /* resolution of output device */
+extern dimen  resolution;         /* resolution of output device */
+extern BOOL   strings_centred;    /* at least one string is centred */
 extern BOOL   strings_exist;      /* at least one item has a string */
+extern BOOL   strings_right;      /* at least one string is right-justified */
+extern BOOL   strings_rotated;    /* at least one string is rotated */
+extern BOOL   style_classes;      /* write SVG styles as classes */
+extern BOOL   svg_compressed;     /* compress SVG output */
 extern int    subs_ptr;           /* error offset in raw buffer */
 
 extern uschar word[];             /* next word in input */
@@ -410,6 +599,7 @@ extern uschar wordstd[];          /* ...with standardized spelling */
 extern uschar *in_line;           /* current input line */
 extern uschar *in_prev;           /* previous input line */
 extern uschar *in_raw;            /* raw input line */
+extern int    in_raw_length;      /* length of raw input line */
 
 extern uschar **in_line_stack;    /* stack of pointers to saved in_lines */
 extern int    *chptr_stack;       /* stack of saved chptrs */
@@ -419,7 +609,9 @@ extern int    *mac_count_stack;   /* stack current count */
 extern macro  *macroot;           /* root of all macros */
 extern macro  *macactive;         /* chain of active macros */
 extern macro  *spare_macros;      /* chain of re-usable macro blocks */
+extern tree_node *spare_locals;   /* chain of re-usable local variables */
 
+extern BOOL   minimize;           /* compact output */
 extern int    outstyle;           /* output style */
 extern BOOL   reading;            /* TRUE while reading input */
 extern BOOL   substituting;       /* TRUE while substituting variables */
@@ -446,6 +638,14 @@ extern int nonucount;
 extern int u2scount;
 extern u2sencod u2slist[];
 
+/* Encodings and font metrics */
+
+extern const char *encoding_names[];
+extern int encoding_count;
+extern const unsigned short int text_font_widths[];
+extern const unsigned short int symbol_widths[];
+extern const unsigned short int dingbats_widths[];
+
 
 
 /*************************************************
@@ -457,40 +657,94 @@ void c_box(void);
 void c_circle(void);
 void c_curve(void);
 void c_line(void);
+void c_grid(void);
+void data_items(input_file *, uschar *);
+void c_place(void);
+void c_poly(void);
 
 void chain_label(item *);
 void error_moan(int, ...);
-void find_bbox(int  *);
-uschar *fixed(int );
-int  find_fontdepth(item *, stringchain *);
-int  find_linedepth(item *, stringchain *);
+void find_bbox(dimen *);
+void find_items_bbox(item *, dimen *);
+dimen find_fontdepth(item *, stringchain *);
+int  font_char(int, int *);
+int  format_fixed(uschar *, dimen);
+int  format_fixed_min(uschar *, dimen);
+dimen find_linedepth(item *, stringchain *);
+dimen fixmul(dimen, dimen);
 item *findlabel(uschar *);
-void find_curvepos(item_curve *, double, int *, int *);
+tree_node *find_local(uschar *);
+void find_curvepos(item_curve *, double, dimen *, dimen *);
 void freechain(void);
+void freeloop(loop *);
 void freemacro(macro *);
+void free_locals(macro *);
 void free_in_line(uschar *);
+tree_node *getlocal(macro *, uschar *);
 macro *getmacro(void);
+void lex_line(void);
 void *getstore(size_t);
+mac_arg *get_data_arg(void);
+loop *getloop(void);
+inner_body *get_inner_body(void);
+mac_line *get_loop_line(void);
 void *get_in_line(void);
+void init_font_chars(void);
+void init_pdf(void);
 void init_ps(void);
 void init_sv(void);
+void end_loop(loop *);
+void expand_rest(void);
+void input_close(input_file *);
+uschar *input_getline(input_file *, int *);
+int  input_getrow(input_file *, uschar **, int, uschar *, int);
+input_file *input_open(uschar *);
+void input_release_cache(void);
 void nextch(void);
 void nextsigch(void);
-void options(item *, arg_item *);
+void note_string(stringchain *);
+BOOL next_iteration(loop *, BOOL);
+void options(item *, arg_table *);
+void out_bytes(const uschar *, size_t);
+long int out_close(void);
+void out_compress(int);
+void out_compress_end(void);
+void out_fixed(dimen);
+void out_fixed_rounded(dimen);
+void out_flush(void);
+void out_int(long long int);
+void out_open_fd(int);
+void out_open_memory(uschar *, size_t);
+long int out_position(void);
+void out_printf(const char *, ...);
+void out_set_minimal(BOOL);
+void out_set_unit(dimen);
+void out_string(const uschar *);
+void out_write_raw(const uschar *, size_t);
+int  readcolour(void);
 int  readint(void);
-int  readnumber(void);
+dimen readnumber(void);
+dimen *readpoints(int *);
 void readstringchain(item *, int);
+void readlabel(void);
 void readword(void);
 int  read_conf_file(uschar *);
 void read_inputfile(void);
-int  rnd(int );
+dimen rnd(dimen);
 BOOL samecolour(colour, colour);
-void smallarc(int, int, double, double, void (*)(int, int, int, int, int, int));
+dimen scan_fixed(uschar *, uschar **);
+item **sort_items(item *, int *);
+void smallarc(dimen, dimen, double, double,
+  void (*)(dimen, dimen, dimen, dimen, dimen, dimen));
 void standardize_word(void);
-void stringpos(item *, int  *, int  *);
+void stringpos(item *, dimen *, dimen *);
+void substitute_rest(void);
 int  tree_insertnode(tree_node **, tree_node *);
 tree_node *tree_search(tree_node *, uschar *);
+void write_pdf(void);
 void write_ps(void);
 void write_sv(void);
+void zip_data(const uschar *, size_t, BOOL);
+void zip_start(int);
 
 /* End of aspic.h */
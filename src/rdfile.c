@@ -0,0 +1,363 @@
+/*************************************************
+*                      ASPIC                     *
+*************************************************/
+
+/* Copyright (c) University of Cambridge 1991 - 2023 */
+/* Created: October 2026 */
+/* Last modified: October 2026 */
+
+/* This module contains functions for opening, reading, and closing input
+files. A regular file is mapped into memory and its lines are found by walking
+the mapped data, so no copying is needed. Other inputs, such as the standard
+input or a pipe, are read a line at a time into a buffer. Data files for the
+"data" command are read in the same way, except that a row is not limited by
+the size of the buffer, and they are split into fields here.
+
+Mappings are cached for the life of the process, keyed by device, inode,
+modification time, and size, so a file that is included more than once is
+opened and mapped only once. */
+
+
+#include "aspic.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/*************************************************
+*            Local variables                     *
+*************************************************/
+
+static input_file *spare_inputs = NULL;   /* Chain of re-usable blocks */
+static mapped_file *mapped_files = NULL;  /* Cache of mapped files */
+
+
+
+/*************************************************
+*          Find or create a cached mapping       *
+*************************************************/
+
+/* If the file is already in the cache, the open file is not needed. Otherwise
+it is mapped and the mapping is added to the cache.
+
+Arguments:
+  statbuf    the result of stat() or fstat() on the file
+  file       the open file, or NULL to look only in the cache
+
+Returns:     pointer to the cache entry, or NULL
+*/
+
+static mapped_file *
+find_mapping(struct stat *statbuf, FILE *file)
+{
+mapped_file *m;
+void *map;
+
+for (m = mapped_files; m != NULL; m = m->next)
+  {
+  if (m->dev == statbuf->st_dev && m->ino == statbuf->st_ino &&
+      m->mtime == statbuf->st_mtime && m->size == statbuf->st_size)
+    return m;
+  }
+
+if (file == NULL) return NULL;
+
+map = mmap(NULL, (size_t)statbuf->st_size, PROT_READ, MAP_PRIVATE,
+  fileno(file), 0);
+if (map == MAP_FAILED) return NULL;   /* LCOV_EXCL_LINE */
+#ifdef MADV_SEQUENTIAL
+(void)madvise(map, (size_t)statbuf->st_size, MADV_SEQUENTIAL);
+#endif
+
+m = getstore(sizeof(mapped_file));
+m->next = mapped_files;
+m->dev = statbuf->st_dev;
+m->ino = statbuf->st_ino;
+m->mtime = statbuf->st_mtime;
+m->size = statbuf->st_size;
+m->map = US map;
+mapped_files = m;
+return m;
+}
+
+
+
+/*************************************************
+*              Open an input file                *
+*************************************************/
+
+/* A NULL name means the standard input, which is never mapped. If a regular
+file cannot be mapped for any reason, it is read via stdio instead.
+
+Argument:  the file name, or NULL for stdin
+Returns:   pointer to an input_file block, or NULL on failure, with errno set
+*/
+
+input_file *
+input_open(uschar *name)
+{
+input_file *f;
+mapped_file *m = NULL;
+FILE *file = NULL;
+struct stat statbuf;
+
+/* A cached file does not need to be opened again. */
+
+if (name != NULL && Ustat(name, &statbuf) == 0 && S_ISREG(statbuf.st_mode))
+  m = find_mapping(&statbuf, NULL);
+
+if (m == NULL)
+  {
+  if (name == NULL) file = stdin;
+    else if ((file = Ufopen(name, "r")) == NULL) return NULL;
+  }
+
+if (spare_inputs == NULL)
+  {
+  f = getstore(sizeof(input_file));
+  f->rowbuffer = NULL;
+  f->rowsize = 0;
+  }
+else
+  {
+  f = spare_inputs;
+  spare_inputs = f->prev;
+  }
+
+f->prev = NULL;
+f->file = file;
+f->map = f->next = f->mapend = NULL;
+f->buffer = NULL;
+
+/* An empty file need not be mapped; it just has no lines. */
+
+if (m == NULL && file != stdin && fstat(fileno(file), &statbuf) == 0 &&
+    S_ISREG(statbuf.st_mode))
+  {
+  if (statbuf.st_size == 0 || (m = find_mapping(&statbuf, file)) != NULL)
+    {
+    (void)fclose(file);     /* The mapping remains valid */
+    f->file = NULL;
+    }
+  }
+
+if (m != NULL)
+  {
+  f->map = f->next = m->map;
+  f->mapend = m->map + m->size;
+  }
+else if (f->file != NULL) f->buffer = get_in_line();
+
+return f;
+}
+
+
+
+/*************************************************
+*        Get the next line from an input file    *
+*************************************************/
+
+/* For a mapped file, the yield points into the mapped data and is not zero-
+terminated; for a buffered file it points to the buffer. In both cases the
+length includes the terminating newline, if there is one. As before, a buffered
+read stops after INPUT_LINESIZE - 1 bytes; the caller checks for overlong
+lines.
+
+Arguments:
+  f          the input file
+  lenptr     where to return the length of the line
+
+Returns:     pointer to the line, or NULL at end of file
+*/
+
+uschar *
+input_getline(input_file *f, int *lenptr)
+{
+uschar *yield;
+
+if (f->file != NULL)
+  {
+  if (Ufgets(f->buffer, INPUT_LINESIZE, f->file) == NULL) return NULL;
+  *lenptr = Ustrlen(f->buffer);
+  return f->buffer;
+  }
+
+if (f->next >= f->mapend) return NULL;
+yield = f->next;
+f->next = memchr(yield, '\n', f->mapend - yield);
+f->next = (f->next == NULL)? f->mapend : f->next + 1;
+*lenptr = (int)(((f->next - yield) > INT_MAX)? INT_MAX : f->next - yield);
+return yield;
+}
+
+
+
+/*************************************************
+*     Get a whole line from a buffered file      *
+*************************************************/
+
+/* A row of a data file is not limited to the size of the line buffer, so that
+a file gives the same rows whether or not it can be mapped. If a buffered read
+stops before the end of the line, the line is gathered in a larger block,
+which is kept with the input_file for later rows.
+
+Arguments:
+  f          the input file
+  lenptr     where to return the length of the line
+
+Returns:     pointer to the line, or NULL at end of file
+*/
+
+static uschar *
+input_getwholeline(input_file *f, int *lenptr)
+{
+uschar *p = input_getline(f, lenptr);
+int len;
+
+if (p == NULL || f->file == NULL) return p;
+len = *lenptr;
+if (len < INPUT_LINESIZE - 1 || p[len-1] == '\n') return p;
+
+do
+  {
+  if (f->rowsize - len < INPUT_LINESIZE)
+    {
+    int newsize = 2*(f->rowsize + INPUT_LINESIZE);
+    uschar *newrow = getstore(newsize);
+    memcpy(newrow, p, len);
+    f->rowbuffer = newrow;
+    f->rowsize = newsize;
+    }
+  else if (p != f->rowbuffer) memcpy(f->rowbuffer, p, len);
+  p = f->rowbuffer;
+  if (Ufgets(p + len, f->rowsize - len, f->file) == NULL) break;
+  len += Ustrlen(p + len);
+  }
+while (p[len-1] != '\n');
+
+*lenptr = len;
+return p;
+}
+
+
+
+/*************************************************
+*          Get the next row from a data file     *
+*************************************************/
+
+/* The fields of a row are separated by tabs if the row contains one, and by
+commas otherwise. A field may be enclosed in double quotes, in which case it
+may contain the separator, and a quote is represented by two quotes. Spaces
+around unquoted fields are removed. The fields are copied into a buffer, each
+terminated by a zero; any beyond the size of the vector are ignored.
+
+Arguments:
+  f          the input file
+  fields     where to put pointers to the fields
+  max        the size of the fields vector
+  buffer     where to copy the fields
+  size       the size of the buffer
+
+Returns:     the number of fields, 0 for a blank or comment line, -1 at the
+             end of the file, or -2 if the buffer is too small
+*/
+
+int
+input_getrow(input_file *f, uschar **fields, int max, uschar *buffer,
+  int size)
+{
+int len;
+int n = 0;
+uschar sep;
+uschar *p, *e;
+uschar *t = buffer;
+uschar *tend = buffer + size;
+
+if ((p = input_getwholeline(f, &len)) == NULL) return -1;
+e = p + len;
+while (e > p && (e[-1] == '\n' || e[-1] == '\r')) e--;
+while (p < e && *p == ' ') p++;
+if (p >= e || *p == '#') return 0;
+
+sep = (memchr(p, '\t', e - p) != NULL)? '\t' : ',';
+
+while (n < max)
+  {
+  fields[n++] = t;
+  while (p < e && *p == ' ') p++;
+
+  if (p < e && *p == '"')
+    {
+    for (p++; p < e; p++)
+      {
+      if (*p == '"' && (++p >= e || *p != '"')) break;
+      if (t >= tend - 1) return -2;
+      *t++ = *p;
+      }
+    while (p < e && *p != sep) p++;     /* Ignore anything after the quote */
+    }
+  else
+    {
+    uschar *q = memchr(p, sep, e - p);
+    uschar *qq;
+    if (q == NULL) q = e;
+    for (qq = q; qq > p && qq[-1] == ' '; qq--);
+    if (qq - p >= tend - t) return -2;
+    memcpy(t, p, qq - p);
+    t += qq - p;
+    p = q;
+    }
+
+  if (t >= tend) return -2;
+  *t++ = 0;
+  if (p++ >= e) break;
+  }
+
+return n;
+}
+
+
+
+/*************************************************
+*              Close an input file               *
+*************************************************/
+
+/* The block is saved for re-use. The standard input is not closed, and a
+mapping is left in the cache.
+
+Argument:  the input file
+Returns:   nothing
+*/
+
+void
+input_close(input_file *f)
+{
+if (f->file != NULL && f->file != stdin) (void)fclose(f->file);
+if (f->buffer != NULL) free_in_line(f->buffer);
+f->prev = spare_inputs;
+spare_inputs = f;
+}
+
+
+
+/*************************************************
+*          Release all cached mappings           *
+*************************************************/
+
+/* Called when reading is complete. The cache blocks themselves are in store
+that is freed at exit.
+
+Arguments:  none
+Returns:    nothing
+*/
+
+void
+input_release_cache(void)
+{
+for (mapped_file *m = mapped_files; m != NULL; m = m->next)
+  (void)munmap(m->map, (size_t)m->size);
+mapped_files = NULL;
+}
+
+/* End of rdfile.c */
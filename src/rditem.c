@@ -38,7 +38,7 @@ static arg_item arrow_args[] = {
   { US"from",        opt_at,     oo(item_line,     x), oo(item_line,     y) },
   { US"to",          opt_at,     oo(item_line,  endx), oo(item_line,  endy) },
   { US"align",       opt_at,     oo(item_line,alignx), oo(item_line,aligny) },
-  { US"dashed",      opt_bool,   oo(item_line, dash1),                   -1 },
+  { US"dashed",      opt_dash,   oo(item_line, dash1),                   -1 },
   { US"thickness",   opt_dim,    oo(item_line, thickness),               -1 },
   { US"colour",      opt_colour, oo(item_line, colour),                  -1 },
   { US"grey",        opt_grey,   oo(item_line, colour),                  -1 },
@@ -47,7 +47,8 @@ static arg_item arrow_args[] = {
   { US"", 0, -1, -1 }
 };
 
-static arg_item *line_args = arrow_args + 3;
+static arg_table arrow_table = { arrow_args, NULL, 0, 0 };
+static arg_table line_table = { arrow_args + 3, NULL, 0, 0 };
 
 /* The arguments for an ellipse are the same as for a box. */
 
@@ -57,7 +58,7 @@ static arg_item box_args[] = {
                                                  oo(item_box, pointjoined) },
   { US"width",       opt_dim,  oo(item_box, width),                       -1 },
   { US"depth",       opt_dim,  oo(item_box, depth),                       -1 },
-  { US"dashed",      opt_bool, oo(item_box, dash1),                       -1 },
+  { US"dashed",      opt_dash, oo(item_box, dash1),                       -1 },
   { US"filled",      opt_colgrey, oo(item_box, shapefilled),              -1 },
   { US"thickness",   opt_dim,  oo(item_box, thickness),                   -1 },
   { US"colour",      opt_colour, oo(item_box, colour),                    -1 },
@@ -66,12 +67,14 @@ static arg_item box_args[] = {
   { US"", 0, -1, -1 }
 };
 
+static arg_table box_table = { box_args, NULL, 0, 0 };
+
 static arg_item circle_args[] = {
   { US"at",          opt_at,   oo(item_box,         x), oo(item_box, y)      },
   { US"join",        opt_join, oo(item_box, joinpoint),
                                                  oo(item_box, pointjoined) },
   { US"radius",      opt_dim,  oo(item_box, width),                       -1 },
-  { US"dashed",      opt_bool, oo(item_box, dash1),                       -1 },
+  { US"dashed",      opt_dash, oo(item_box, dash1),                       -1 },
   { US"thickness",   opt_dim,  oo(item_box, thickness),                   -1 },
   { US"colour",      opt_colour, oo(item_box, colour),                    -1 },
   { US"grey",        opt_grey, oo(item_box, colour),                      -1 },
@@ -80,6 +83,22 @@ static arg_item circle_args[] = {
   { US"", 0, -1, -1 }
 };
 
+static arg_table circle_table = { circle_args, NULL, 0, 0 };
+
+/* A placed group is a box whose "at" position is the group's origin */
+
+static arg_item place_args[] = {
+  { US"at",          opt_at,   oo(item_box,         x), oo(item_box, y)      },
+  { US"join",        opt_join, oo(item_box, joinpoint),
+                                                 oo(item_box, pointjoined) },
+  { US"rotate",      opt_number, oo(item_place, rotate),                  -1 },
+  { US"scale",       opt_number, oo(item_place, scale),                   -1 },
+  { US"level",       opt_int,  oo(item_box, level),                       -1 },
+  { US"", 0, -1, -1 }
+};
+
+static arg_table place_table = { place_args, NULL, 0, 0 };
+
 /* Those specific to arc arrows come at the start here. */
 
 static arg_item arcarrow_args[] = {
@@ -97,7 +116,7 @@ static arg_item arcarrow_args[] = {
   { US"angle",       opt_angle,oo(item_arc, angle),                  -1 },
   { US"depth",       opt_dim,  oo(item_arc, depth),                  -1 },
   { US"via",         opt_at,   oo(item_arc, via_x), oo(item_arc, via_y) },
-  { US"dashed",      opt_bool, oo(item_arc, dash1),                  -1 },
+  { US"dashed",      opt_dash, oo(item_arc, dash1),                  -1 },
   { US"up",          opt_dir,  oo(item_arc, direction),           north },
   { US"down",        opt_dir,  oo(item_arc, direction),           south },
   { US"left",        opt_dir,  oo(item_arc, direction),            west },
@@ -110,7 +129,8 @@ static arg_item arcarrow_args[] = {
   { US"", 0, -1, -1 }
 };
 
-static arg_item *arc_args = arcarrow_args + 3;
+static arg_table arcarrow_table = { arcarrow_args, NULL, 0, 0 };
+static arg_table arc_table = { arcarrow_args + 3, NULL, 0, 0 };
 
 static arg_item curve_args[] = {
   { US"from",        opt_at,   oo(item_curve, x0), oo(item_curve,   y0) },
@@ -120,7 +140,7 @@ static arg_item curve_args[] = {
   { US"c1",          opt_at,   oo(item_curve, cx1), oo(item_curve, cy1) },
   { US"c2",          opt_at,   oo(item_curve, cx2), oo(item_curve, cy2) },
   { US"cs",          opt_at,   oo(item_curve, cxs), oo(item_curve, cys) },
-  { US"dashed",      opt_bool, oo(item_curve, dash1),                -1 },
+  { US"dashed",      opt_dash, oo(item_curve, dash1),                -1 },
   { US"thickness",   opt_dim,  oo(item_curve, thickness),            -1 },
   { US"colour",      opt_colour, oo(item_curve, colour),             -1 },
   { US"grey",        opt_grey, oo(item_curve, colour),               -1 },
@@ -129,6 +149,23 @@ static arg_item curve_args[] = {
   { US"", 0, -1, -1 }
 };
 
+static arg_table curve_table = { curve_args, NULL, 0, 0 };
+
+/* The points of a polyline or polygon come before any options. */
+
+static arg_item poly_args[] = {
+  { US"dashed",      opt_dash, oo(item_poly, dash1),                 -1 },
+  { US"thickness",   opt_dim,  oo(item_poly, thickness),             -1 },
+  { US"colour",      opt_colour, oo(item_poly, colour),              -1 },
+  { US"grey",        opt_grey, oo(item_poly, colour),                -1 },
+  { US"filled",      opt_colgrey, oo(item_poly, shapefilled),        -1 },
+  { US"shapefilled", opt_colgrey, oo(item_poly, shapefilled),        -1 },
+  { US"level",       opt_int,  oo(item_poly, level),                 -1 },
+  { US"", 0, -1, -1 }
+};
+
+static arg_table poly_table = { poly_args, NULL, 0, 0 };
+
 
 
 /*************************************************
@@ -139,7 +176,7 @@ static arg_item curve_args[] = {
 point on the previous item, if it exists. */
 
 static void
-find_arcurve_start(int *ax0, int *ay0, int direction)
+find_arcurve_start(dimen *ax0, dimen *ay0, int direction)
 {
 if (baseitem == NULL)
   {
@@ -158,6 +195,11 @@ else switch(baseitem->type)
   *ay0 = ((item_curve *)baseitem)->y1;
   break;
 
+  case i_poly:
+  *ax0 = ((item_poly *)baseitem)->x1;
+  *ay0 = ((item_poly *)baseitem)->y1;
+  break;
+
   case i_line:
   *ax0 = ((item_line *)baseitem)->x + ((item_line *)baseitem)->width;
   *ay0 = ((item_line *)baseitem)->y + ((item_line *)baseitem)->depth;
@@ -166,8 +208,8 @@ else switch(baseitem->type)
   case i_box:
     {
     item_box *box = (item_box *)baseitem;
-    int width2 = box->width/2;
-    int depth2 = box->depth/2;
+    dimen width2 = box->width/2;
+    dimen depth2 = box->depth/2;
 
     *ax0 = box->x;
     *ay0 = box->y;
@@ -237,10 +279,8 @@ arc->x0 = arc->y0 = arc->x1 = arc->y1 = UNSET;
 
 /* Read optional parameters and sort out dashing */
 
-options((item *)arc, item_arg2? arcarrow_args : arc_args);
+options((item *)arc, item_arg2? &arcarrow_table : &arc_table);
 if (arc->dash1) { arc->dash1 = env->linedash1; arc->dash2 = env->linedash2; }
-if (arc->level > max_level) max_level = arc->level;
-if (arc->level < min_level) min_level = arc->level;
 
 /* Convert angle to radians and adjust for clockwise */
 
@@ -291,8 +331,8 @@ if (arc->x0 != UNSET && arc->x1 == UNSET)
 
   /* Compute the end point */
 
-  arc->x1 = arc->x + (int )(radius * cos(arc->angle2));
-  arc->y1 = arc->y + (int )(radius * sin(arc->angle2));
+  arc->x1 = arc->x + (dimen)(radius * cos(arc->angle2));
+  arc->y1 = arc->y + (dimen)(radius * sin(arc->angle2));
   }
 
 /* If the end is specified, with or without a starting point, then EITHER
@@ -311,8 +351,8 @@ else if (arc->x1 != UNSET)
 
   /* We now have a start and a finish position. */
 
-  xx = (double)((int )(arc->x1 - arc->x0));
-  yy = (double)((int )(arc->y1 - arc->y0));
+  xx = (double)((dimen)(arc->x1 - arc->x0));
+  yy = (double)((dimen)(arc->y1 - arc->y0));
 
   angle = atan2(yy, xx);
 
@@ -358,8 +398,8 @@ else if (arc->x1 != UNSET)
 
     if (arc->via_x != UNSET)
       {
-      double xxx = (double)( (int )(arc->via_x - arc->x0) );
-      double yyy = (double)( (int )(arc->via_y - arc->y0) );
+      double xxx = (double)( (dimen)(arc->via_x - arc->x0) );
+      double yyy = (double)( (dimen)(arc->via_y - arc->y0) );
       double sss = sin(angle);
       double ccc = cos(angle);
       double zzz = xxx*sss - yyy*ccc;
@@ -393,7 +433,7 @@ else if (arc->x1 != UNSET)
     /* Depth known; compute the radius */
 
     radius = ((len1 * len1) + ((double)arc->depth * (double)arc->depth)) /
-      (double)((int )(2 * arc->depth));
+      (double)((dimen)(2 * arc->depth));
 
     /* If depth is greater than half the distance between the ends, we want
     to draw an arc with the centre on the other side of the joining line to
@@ -404,7 +444,7 @@ else if (arc->x1 != UNSET)
 
   /* Set the used radius */
 
-  arc->radius = (int )(radius);
+  arc->radius = (dimen)(radius);
 
   /* Force minimum radius */
 
@@ -412,13 +452,13 @@ else if (arc->x1 != UNSET)
 
   len2 = comp * sqrt(radius*radius - len1*len1);
 
-  arc->x = (arc->x0 + arc->x1)/2 - centresign * icwsign * (int )(len2 * sin(angle));
-  arc->y = (arc->y0 + arc->y1)/2 + centresign * icwsign * (int )(len2 * cos(angle));
+  arc->x = (arc->x0 + arc->x1)/2 - centresign * icwsign * (dimen)(len2 * sin(angle));
+  arc->y = (arc->y0 + arc->y1)/2 + centresign * icwsign * (dimen)(len2 * cos(angle));
 
   /* Now we have the centre, we can compute the angles. */
 
-  arc->angle1 = atan2((double)((int )(arc->y0 - arc->y)), (double)((int )(arc->x0 - arc->x)));
-  arc->angle2 = atan2((double)((int )(arc->y1 - arc->y)), (double)((int )(arc->x1 - arc->x)));
+  arc->angle1 = atan2((double)((dimen)(arc->y0 - arc->y)), (double)((dimen)(arc->x0 - arc->x)));
+  arc->angle2 = atan2((double)((dimen)(arc->y1 - arc->y)), (double)((dimen)(arc->x1 - arc->x)));
   }
 
 /* If neither the start nor end point has been set, we position the
@@ -475,8 +515,8 @@ else
         changed to accommodate an arrowhead. */
 
         arc->angle1 =
-	  atan2((double)((int )(lastarc->y1 - lastarc->y)),
-	    (double)((int )(lastarc->x1 - lastarc->x))) - cwangle;
+	  atan2((double)((dimen)(lastarc->y1 - lastarc->y)),
+	    (double)((dimen)(lastarc->x1 - lastarc->x))) - cwangle;
         break;
 
         case north: arc->angle1 = cwangle; break;
@@ -485,8 +525,8 @@ else
         case west:  arc->angle1 = cwangle + 0.5*pi; break;
         }
 
-      arc->x = lastarc->x1 - (int )(radius * cos(arc->angle1));
-      arc->y = lastarc->y1 - (int )(radius * sin(arc->angle1));
+      arc->x = lastarc->x1 - (dimen)(radius * cos(arc->angle1));
+      arc->y = lastarc->y1 - (dimen)(radius * sin(arc->angle1));
       }
      break;
 
@@ -504,8 +544,8 @@ else
         break;
         }
       arc->angle1 = cwangle - (0.5*pi - angle);
-      arc->x = line->x + line->width - icwsign * (int)(radius * sin(angle));
-      arc->y = line->y + line->depth + icwsign * (int)(radius * cos(angle));
+      arc->x = line->x + line->width - icwsign * (dimen)(radius * sin(angle));
+      arc->y = line->y + line->depth + icwsign * (dimen)(radius * cos(angle));
       }
     break;
 
@@ -524,16 +564,40 @@ else
         break;
         }
       arc->angle1 = cwangle - (0.5*pi - angle);
-      arc->x = curve->x1 - icwsign * (int)(radius * sin(angle));
-      arc->y = curve->y1 + icwsign * (int)(radius * cos(angle));
+      arc->x = curve->x1 - icwsign * (dimen)(radius * sin(angle));
+      arc->y = curve->y1 + icwsign * (dimen)(radius * cos(angle));
+      }
+    break;
+
+    /* Continue in the direction of the last segment */
+
+    case i_poly:
+      {
+      double angle;
+      item_poly *poly = (item_poly *)baseitem;
+      dimen *last = poly->points + 2*(poly->count - 2);
+      switch (arc->direction)
+        {
+        case north: angle = 0.5*pi;  break;
+        case south: angle = -0.5*pi; break;
+        case east:  angle = 0.0; break;
+        case west:  angle = pi; break;
+        default: angle = poly->closed?
+          atan2((double)(poly->y1 - last[3]), (double)(poly->x1 - last[2])) :
+          atan2((double)(poly->y1 - last[1]), (double)(poly->x1 - last[0]));
+        break;
+        }
+      arc->angle1 = cwangle - (0.5*pi - angle);
+      arc->x = poly->x1 - icwsign * (dimen)(radius * sin(angle));
+      arc->y = poly->y1 + icwsign * (dimen)(radius * cos(angle));
       }
     break;
 
     case i_box:
       {
       item_box *box = (item_box *)baseitem;
-      int width2 = box->width/2;
-      int depth2 = box->depth/2;
+      dimen width2 = box->width/2;
+      dimen depth2 = box->depth/2;
 
       arc->x = box->x;
       arc->y = box->y;
@@ -585,10 +649,10 @@ else
 
   /* Compute the actual start and end points */
 
-  arc->x0 = arc->x + (int )(radius * cos(arc->angle1));
-  arc->y0 = arc->y + (int )(radius * sin(arc->angle1));
-  arc->x1 = arc->x + (int )(radius * cos(arc->angle2));
-  arc->y1 = arc->y + (int )(radius * sin(arc->angle2));
+  arc->x0 = arc->x + (dimen)(radius * cos(arc->angle1));
+  arc->y0 = arc->y + (dimen)(radius * sin(arc->angle1));
+  arc->x1 = arc->x + (dimen)(radius * cos(arc->angle2));
+  arc->y1 = arc->y + (dimen)(radius * sin(arc->angle2));
   }
 
 /* Adjust if arrow heads are around */
@@ -642,10 +706,8 @@ curve->cxs = curve->cys = 0;
 
 /* Read optional parameters and sort out dashing */
 
-options((item *)curve, curve_args);
+options((item *)curve, &curve_table);
 if (curve->dash1) { curve->dash1 = env->linedash1; curve->dash2 = env->linedash2; }
-if (curve->level > max_level) max_level = curve->level;
-if (curve->level < min_level) min_level = curve->level;
 
 /* An end point must be specified. */
 
@@ -708,8 +770,8 @@ fm = (flen + (double)(curve->cx1)) / len;
 dx = ylen * sin(angle) * cwsign;
 dy = ylen * cos(angle) * cwsign;
 
-curve->cx1 = (int)(w * fm + dx);
-curve->cy1 = (int)(h * fm - dy);
+curve->cx1 = (dimen)(w * fm + dx);
+curve->cy1 = (dimen)(h * fm - dy);
 
 /* Second control point; adjust for wavy, adjust ylen, then as before. */
 
@@ -720,8 +782,8 @@ fm = (flen + (double)(curve->cx2)) / len;
 dx = ylen * sin(angle) * cwsign;
 dy = ylen * cos(angle) * cwsign;
 
-curve->cx2 = (int)(w - w * fm + dx);
-curve->cy2 = (int)(h - h * fm - dy);
+curve->cx2 = (dimen)(w - w * fm + dx);
+curve->cy2 = (dimen)(h - h * fm - dy);
 
 /* Read any associated strings, then connect to chain, updating the last item
 and sorting the label. */
@@ -736,22 +798,344 @@ chain_label((item *)curve);
 *       The BOX, CIRCLE, and ELLIPSE commands    *
 *************************************************/
 
+/* The group that is being placed by c_place() or c_grid(). */
+
+static group *placing_group;
+
+/* The grid that is being created by c_grid(); grid_rows is zero at other
+times. */
+
+static int grid_rows = 0;
+static int grid_cols;
+static dimen grid_xpitch;
+static dimen grid_ypitch;
+
+/* The data file that is being read by data_items(); NULL at other times. */
+
+static input_file *data_file = NULL;
+static uschar *data_name;
+
+
+/* Local subroutine to set the size of a placed group, which is the bounding
+box of its items after they have been scaled and rotated about the origin, and
+to find the offset of the origin from the centre.
+
+Argument:   the placement item
+Returns:    nothing
+*/
+
+static void
+size_place(item_place *pp)
+{
+group *g = pp->group;
+double r = ((double)(pp->rotate)/1000.0)*pi/180.0;
+double sf = (double)(pp->scale)/1000.0;
+double s = sin(r) * sf;
+double c = cos(r) * sf;
+dimen minx = LLONG_MAX, miny = LLONG_MAX, maxx = LLONG_MIN, maxy = LLONG_MIN;
+
+for (int i = 0; i < 4; i++)
+  {
+  dimen x = g->bbox[(i & 1)? 2 : 0];
+  dimen y = g->bbox[(i & 2)? 3 : 1];
+  dimen xx = (dimen)((double)x * c - (double)y * s);
+  dimen yy = (dimen)((double)x * s + (double)y * c);
+  if (xx < minx) minx = xx;
+  if (xx > maxx) maxx = xx;
+  if (yy < miny) miny = yy;
+  if (yy > maxy) maxy = yy;
+  }
+
+pp->box.width = maxx - minx;
+pp->box.depth = maxy - miny;
+pp->originx = -(minx + maxx)/2;
+pp->originy = -(miny + maxy)/2;
+}
+
+
+/* Local subroutine to create the cells of a grid, after bce() has read the
+options and positioned the whole grid. Each cell is a copy of the grid's item,
+and the strings are distributed one per cell, in row order, with an empty
+string leaving a cell without one. If the command has labels, each cell is
+labelled with the label name followed by its row and column numbers, for
+example A[1][2]. The grid item itself becomes an invisible box that encloses
+the cells; it carries the command's labels, and the next item is positioned
+relative to it.
+
+Arguments:
+  box          the grid item, positioned
+  size         the size of the item
+  cell_width   the width of each cell
+  cell_depth   the depth of each cell
+
+Returns:       nothing
+*/
+
+static void
+make_grid(item_box *box, size_t size, dimen cell_width, dimen cell_depth)
+{
+dimen x0 = box->x - box->width/2 + cell_width/2;
+dimen y0 = box->y + box->depth/2 - cell_depth/2;
+label *labels = nextlabel;
+label *cell_labels = labels;
+stringchain *s;
+uschar buffer[WORD_SIZE];
+
+/* Check that the longest cell labels will fit */
+
+for (label *lb = labels; lb != NULL; lb = lb->next)
+  {
+  if (snprintf(CS buffer, sizeof(buffer), "%s[%d][%d]", lb->name, grid_rows,
+      grid_cols) >= (int)sizeof(lb->name))
+    {
+    error_moan(58, lb->name);
+    cell_labels = NULL;
+    }
+  }
+
+readstringchain((item *)box, just_centre);
+s = box->strings;
+box->strings = NULL;
+nextlabel = NULL;
+
+for (int r = 0; r < grid_rows; r++)
+  {
+  for (int c = 0; c < grid_cols; c++)
+    {
+    item_box *cell = getstore(size);
+    memcpy(cell, box, size);
+    cell->x = x0 + c * grid_xpitch;
+    cell->y = y0 - r * grid_ypitch;
+    cell->width = cell_width;
+    cell->depth = cell_depth;
+
+    if (s != NULL)
+      {
+      stringchain *next = s->next;
+      s->next = NULL;
+      if (s->text[0] != 0) cell->strings = s;
+      s = next;
+      }
+
+    for (label *lb = cell_labels; lb != NULL; lb = lb->next)
+      {
+      label *newlabel = getstore(sizeof(label));
+      if (snprintf(CS newlabel->name, sizeof(newlabel->name), "%s[%d][%d]",
+          lb->name, r + 1, c + 1) >= (int)sizeof(newlabel->name))
+        error_moan(58, lb->name);
+      else if (findlabel(newlabel->name) != NULL)
+        error_moan(37, newlabel->name);
+      else
+        {
+        newlabel->next = nextlabel;
+        nextlabel = newlabel;
+        }
+      }
+
+    chain_label((item *)cell);
+    }
+  }
+
+if (s != NULL) error_moan(59);
+
+/* The enclosing box */
+
+box->boxtype = box_box;
+box->style = is_invi;
+box->thickness = 0;
+nextlabel = labels;
+chain_label((item *)box);
+}
+
+
+/* Local subroutine to copy a string for an item created from a data file,
+optionally replacing its text.
+
+Arguments:
+  s          the string to copy
+  text       replacement text, or NULL
+
+Returns:     the copy
+*/
+
+static stringchain *
+copy_string(stringchain *s, uschar *text)
+{
+size_t len = Ustrlen((text == NULL)? s->text : text);
+stringchain *t = getstore(len + 1 + offsetof(stringchain, text));
+
+memcpy(t, s, offsetof(stringchain, text));
+t->next = NULL;
+if (text != NULL)
+  {
+  Ustrcpy(t->text, text);
+  t->chcount = 0;
+  for (uschar *p = text; *p != 0; p++)
+    if ((*p & 0xc0) != 0x80) t->chcount++;
+  note_string(t);
+  }
+else Ustrcpy(t->text, s->text);
+return t;
+}
+
+
+/* Local subroutine to convert a field of a data file that is a coordinate. It
+is converted in the same way as a number in the input, so that the same value
+gives the same position either way.
+
+Arguments:
+  s          the field
+  value      where to return the value
+
+Returns:     TRUE if the field is a number that is not too large
+*/
+
+static BOOL
+data_number(uschar *s, dimen *value)
+{
+int sign = 1;
+uschar *end;
+
+if (*s == '-') { sign = -1; s++; }
+  else if (*s == '+') s++;
+if (!isdigit((int)*s) && (*s != '.' || !isdigit((int)s[1]))) return FALSE;
+*value = scan_fixed(s, &end) * sign;
+return *end == 0 && *value <= FIXED_MAX && *value >= -FIXED_MAX;
+}
+
+
+/* Local subroutine to create the items for a "data" command, after bce() has
+read the options. Each row of the data file gives the x and y position of the
+centre of one item, which is otherwise a copy of the command's item. Any
+strings given with the command are copied to each item. If a row has a third
+field, it replaces the text of the first string, or if there are none, it
+becomes a centred string using the current font and colour. If the command has
+labels, each item is labelled with the label name followed by its number, for
+example P[3].
+
+Arguments:
+  box          the item, without a position
+  size         the size of the item
+
+Returns:       nothing
+*/
+
+static void
+make_data(item_box *box, size_t size)
+{
+int count = 0;
+int row = 0;
+int n;
+label *labels = nextlabel;
+stringchain *templates, *defstring;
+uschar *fields[3];
+uschar buffer[DATA_ROWSIZE];
+
+readstringchain((item *)box, just_centre);
+templates = box->strings;
+box->strings = NULL;
+nextlabel = NULL;
+
+defstring = getstore(1 + offsetof(stringchain, text));
+defstring->next = NULL;
+defstring->rrotate = 0.0;
+defstring->rotate = defstring->xadjust = defstring->yadjust = 0;
+defstring->justify = just_centre;
+defstring->font = env->setfont;
+defstring->chcount = 0;
+defstring->rgb = env->textcolour;
+defstring->text[0] = 0;
+
+while ((n = input_getrow(data_file, fields, 3, buffer, sizeof(buffer))) != -1)
+  {
+  dimen x, y;
+  item_box *b;
+  stringchain **sp;
+
+  row++;
+  if (n == 0) continue;
+  if (n == -2)
+    {
+    error_moan(61, row, data_name);
+    continue;
+    }
+
+  if (n < 2 || !data_number(fields[0], &x) || !data_number(fields[1], &y))
+    {
+    error_moan(63, row, data_name);
+    continue;
+    }
+
+  b = getstore(size);
+  memcpy(b, box, size);
+  b->x = mag(x);
+  b->y = mag(y);
+  if (box->boxtype == box_place)
+    {
+    b->x -= ((item_place *)box)->originx;
+    b->y -= ((item_place *)box)->originy;
+    }
+
+  sp = &(b->strings);
+  if (n > 2 && fields[2][0] != 0)
+    {
+    *sp = copy_string((templates == NULL)? defstring : templates, fields[2]);
+    sp = &((*sp)->next);
+    strings_exist = TRUE;
+    }
+  for (stringchain *s = (n > 2 && fields[2][0] != 0 && templates != NULL)?
+       templates->next : templates; s != NULL; s = s->next)
+    {
+    *sp = copy_string(s, NULL);
+    sp = &((*sp)->next);
+    }
+
+  count++;
+  for (label *lb = labels; lb != NULL; lb = lb->next)
+    {
+    label *newlabel = getstore(sizeof(label));
+    if (snprintf(CS newlabel->name, sizeof(newlabel->name), "%s[%d]",
+        lb->name, count) >= (int)sizeof(newlabel->name))
+      error_moan(58, lb->name);
+    else if (findlabel(newlabel->name) != NULL)
+      error_moan(37, newlabel->name);
+    else
+      {
+      newlabel->next = nextlabel;
+      nextlabel = newlabel;
+      }
+    }
+
+  chain_label((item *)b);
+  }
+
+/* The command's own labels have been used only as the bases of the items'
+labels. */
+
+nextlabel = NULL;
+}
+
+
 /* This common subroutine is called with different arguments for each
-variation on the theme.
+variation on the theme. It is also used for each type of grid, and for the
+items created from a data file.
 
 Arguments:
-  boxtype    box_box, box_circle, or box_ellipse
+  boxtype    box_box, box_circle, box_ellipse, or box_place
   args       allowed arguments for the type
 
 Returns:     nothing
 */
 
 static void
-bce(int boxtype, arg_item *args)
+bce(int boxtype, arg_table *args)
 {
-int x_corner, y_corner;
-int depth2, width2;
-item_box *box = getstore(sizeof(item_box));
+dimen x_corner, y_corner;
+dimen depth2, width2;
+dimen cell_width = 0;
+dimen cell_depth = 0;
+size_t size = (boxtype == box_place)? sizeof(item_place) : sizeof(item_box);
+item_box *box = getstore(size);
 
 /* Initialize with default parameters */
 
@@ -789,6 +1173,18 @@ switch (boxtype)
   box->colour = env->ellcolour;
   box->shapefilled = env->ellfilled;
   break;
+
+  case box_place:
+    {
+    item_place *pp = (item_place *)box;
+    pp->group = placing_group;
+    pp->rotate = 0;
+    pp->scale = 1000;
+    box->thickness = 0;
+    box->colour = black;
+    box->shapefilled = unfilled;
+    }
+  break;
   }
 
 box->x = box->y = UNSET;
@@ -798,23 +1194,53 @@ box->pointjoined = FALSE;
 /* Read optional parameters and compute 1/2 widths and distances to "corners". */
 
 options((item *)box, args);
-if (box->level > max_level) max_level = box->level;
-if (box->level < min_level) min_level = box->level;
 
 if (boxtype == box_circle) box->width = box->depth = 2 * box->width;
 
+/* For a placed group, compute the size; if an "at" position was given, it is
+the position of the group's origin, so convert it to the centre. */
+
+if (boxtype == box_place)
+  {
+  item_place *pp = (item_place *)box;
+  if (pp->scale <= 0)
+    {
+    error_moan(51);
+    pp->scale = 1000;
+    }
+  size_place(pp);
+  if (box->x != UNSET && grid_rows == 0)
+    {
+    box->x -= pp->originx;
+    box->y -= pp->originy;
+    }
+  }
+
+/* A grid is positioned as a whole, as if it were a box; an "at" position is
+its centre. */
+
+if (grid_rows > 0)
+  {
+  cell_width = box->width;
+  cell_depth = box->depth;
+  if (grid_xpitch == UNSET) grid_xpitch = cell_width;
+  if (grid_ypitch == UNSET) grid_ypitch = cell_depth;
+  box->width = (grid_cols - 1) * grid_xpitch + cell_width;
+  box->depth = (grid_rows - 1) * grid_ypitch + cell_depth;
+  }
+
 depth2 = box->depth/2;
 width2 = box->width/2;
 
-if (boxtype == box_box)
+if (boxtype == box_box || boxtype == box_place || grid_rows > 0)
   {
   x_corner = width2;
   y_corner = depth2;
   }
 else
   {
-  x_corner = (int )((double)(width2)*cos(0.25*pi));
-  y_corner = (int )((double)(depth2)*sin(0.25*pi));
+  x_corner = (dimen)((double)(width2)*cos(0.25*pi));
+  y_corner = (dimen)((double)(depth2)*sin(0.25*pi));
   }
 
 /* Sort out dashing parameters */
@@ -837,6 +1263,14 @@ if (box->dash1) switch (boxtype)
   break;
   }
 
+/* Items from a data file are positioned by the file. */
+
+if (data_file != NULL)
+  {
+  make_data(box, size);
+  return;
+  }
+
 /* Set up default position if required */
 
 if (box->x == UNSET)
@@ -852,19 +1286,19 @@ if (box->x == UNSET)
   else if (baseitem->type == i_box)
     {
     item_box *lastbox = (item_box *)baseitem;
-    int lastwidth2 = lastbox->width/2;
-    int lastdepth2 = lastbox->depth/2;
-    int last_x_corner, last_y_corner;
+    dimen lastwidth2 = lastbox->width/2;
+    dimen lastdepth2 = lastbox->depth/2;
+    dimen last_x_corner, last_y_corner;
 
-    if (lastbox->boxtype == box_box)
+    if (lastbox->boxtype == box_box || lastbox->boxtype == box_place)
       {
       last_x_corner = lastwidth2;
       last_y_corner = lastdepth2;
       }
     else
       {
-      last_x_corner = (int )((double)(lastwidth2)*cos(0.25*pi));
-      last_y_corner = (int )((double)(lastdepth2)*sin(0.25*pi));
+      last_x_corner = (dimen)((double)(lastwidth2)*cos(0.25*pi));
+      last_y_corner = (dimen)((double)(lastdepth2)*sin(0.25*pi));
       }
 
     if (box->joinpoint == unset_dirpos) switch (env->direction)
@@ -996,12 +1430,12 @@ if (box->x == UNSET)
       }
     }
 
-  /* This box follows a line, arc, or curve */
+  /* This box follows a line, arc, curve, or polyline */
 
   else
     {
-    int xoffset = 0, yoffset = 0;
-    int x, y, xx, yy;
+    dimen xoffset = 0, yoffset = 0;
+    dimen x, y, xx, yy;
 
     if (baseitem->type == i_arc)
       {
@@ -1026,18 +1460,33 @@ if (box->x == UNSET)
       yy = lastcurve->y1;
       }
 
-    else  /* It must be a line */
+    else  /* It must be a line or a polyline */
       {
-      item_line *lastline = (item_line *)baseitem;
+      if (baseitem->type == i_line)
+        {
+        item_line *lastline = (item_line *)baseitem;
+        x = lastline->x;
+        y = lastline->y;
+        xx = x + lastline->width;
+        yy = y + lastline->depth;
+        }
 
-      x = lastline->x;
-      y = lastline->y;
-      xx = x + lastline->width;
-      yy = y + lastline->depth;
+      /* For a polyline, use the last segment */
+
+      else
+        {
+        item_poly *lastpoly = (item_poly *)baseitem;
+        dimen *last = lastpoly->points +
+          2*(lastpoly->count - (lastpoly->closed? 1 : 2));
+        x = last[0];
+        y = last[1];
+        xx = lastpoly->x1;
+        yy = lastpoly->y1;
+        }
 
       if (box->joinpoint == unset_dirpos)
         {
-	if (abs(xx - x) > abs(yy - y))
+	if (llabs(xx - x) > llabs(yy - y))
           {
           xoffset = width2;
           if (xx < x) xoffset = -xoffset;
@@ -1110,6 +1559,12 @@ if (box->x == UNSET)
 /* Read any associated strings, then connect to chain, updating the last item
 and sorting the label. */
 
+if (grid_rows > 0)
+  {
+  make_grid(box, size, cell_width, cell_depth);
+  return;
+  }
+
 readstringchain((item *)box, just_centre);
 chain_label((item *)box);
 }
@@ -1120,7 +1575,7 @@ chain_label((item *)box);
 void
 c_box(void)
 {
-bce(box_box, box_args);
+bce(box_box, &box_table);
 }
 
 
@@ -1128,9 +1583,305 @@ void
 c_circle(void)
 {
 if (item_arg2)
-  bce(box_circle, circle_args);
+  bce(box_circle, &circle_table);
 else
-  bce(box_ellipse, box_args);
+  bce(box_ellipse, &box_table);
+}
+
+
+
+/*************************************************
+*               The PLACE command                *
+*************************************************/
+
+/* The group must already have been defined. Apart from the group name, the
+command is read like a box. */
+
+static BOOL
+find_group(void)
+{
+readword();
+for (placing_group = group_base; placing_group != NULL;
+     placing_group = placing_group->next)
+  if (Ustrcmp(placing_group->name, word) == 0) break;
+
+if (placing_group == NULL)
+  {
+  if (word[0] == 0) error_moan(11, "Group name");
+    else error_moan(50, word);
+  return FALSE;
+  }
+
+placing_group->used = TRUE;
+return TRUE;
+}
+
+
+void
+c_place(void)
+{
+if (find_group()) bce(box_place, &place_table);
+}
+
+
+
+/*************************************************
+*          Read a shape for grid or data         *
+*************************************************/
+
+/* The shape name has already been read into word. For "place", the group name
+follows.
+
+Arguments:
+  boxtype    where to return the box type
+  args       where to return the argument table
+
+Returns:     TRUE if all is well
+*/
+
+static BOOL
+read_shape(int *boxtype, arg_table **args)
+{
+if (Ustrcmp(word, "box") == 0)
+  {
+  *boxtype = box_box;
+  *args = &box_table;
+  }
+else if (Ustrcmp(word, "circle") == 0)
+  {
+  *boxtype = box_circle;
+  *args = &circle_table;
+  }
+else if (Ustrcmp(word, "ellipse") == 0)
+  {
+  *boxtype = box_ellipse;
+  *args = &box_table;
+  }
+else if (Ustrcmp(word, "place") == 0)
+  {
+  *boxtype = box_place;
+  *args = &place_table;
+  return find_group();
+  }
+else
+  {
+  error_moan(11, "\"box\", \"circle\", \"ellipse\", or \"place\"");
+  return FALSE;
+  }
+return TRUE;
+}
+
+
+
+/*************************************************
+*               The GRID command                 *
+*************************************************/
+
+/* The command starts with the numbers of rows and columns, optionally followed
+by the horizontal and vertical distances between the centres of the cells,
+which default to the size of a cell. Then comes the shape of the cells, which
+is read like a single shape of that type, except that it is the whole grid that
+is positioned. */
+
+void
+c_grid(void)
+{
+int boxtype;
+arg_table *args;
+
+grid_rows = readint();
+grid_cols = readint();
+grid_xpitch = grid_ypitch = UNSET;
+
+if (grid_rows < 1 || grid_rows > GRID_MAX || grid_cols < 1 ||
+    grid_cols > GRID_MAX)
+  {
+  error_moan(57, GRID_MAX);
+  grid_rows = 0;
+  return;
+  }
+
+for (;;)
+  {
+  dimen *pitch;
+  readword();
+  if (Ustrcmp(word, "xpitch") == 0) pitch = &grid_xpitch;
+    else if (Ustrcmp(word, "ypitch") == 0) pitch = &grid_ypitch;
+      else break;
+  if (!isnumstart(in_line[chptr]))
+    {
+    error_moan(8);
+    grid_rows = 0;
+    return;
+    }
+  *pitch = mag(readnumber());
+  nextsigch();
+  }
+
+if (read_shape(&boxtype, &args)) bce(boxtype, args);
+grid_rows = 0;
+}
+
+
+
+/*************************************************
+*          Shapes for the DATA command           *
+*************************************************/
+
+/* This is called from c_data() when the data file name is followed by a shape
+instead of "using". The shape is read like a single shape of that type, except
+that an item is created for each row of the file.
+
+Arguments:
+  f          the open data file
+  name       the file name, for error messages
+
+Returns:     nothing
+*/
+
+void
+data_items(input_file *f, uschar *name)
+{
+int boxtype;
+arg_table *args;
+
+if (!read_shape(&boxtype, &args)) return;
+data_file = f;
+data_name = name;
+bce(boxtype, args);
+data_file = NULL;
+}
+
+
+
+/*************************************************
+*   The POLYLINE, POLYGON, and SPLINE commands   *
+*************************************************/
+
+/* Local subroutine to convert the points of a spline into Bezier segments. The
+spline is a Catmull-Rom spline, which passes through all the points, with the
+tangent at each point parallel to the line joining its neighbours. For the
+segment from P[i] to P[i+1], the control points are P[i] + (P[i+1] - P[i-1])/6
+and P[i+1] - (P[i+2] - P[i])/6, where the end points are used in place of the
+missing neighbours at the ends.
+
+Arguments:
+  p          the points, as x,y pairs
+  n          the number of points
+
+Returns:     the Bezier points, 3*(n-1)+1 of them
+*/
+
+static dimen *
+spline_points(dimen *p, int n)
+{
+dimen *yield = getstore((6*(n - 1) + 2) * sizeof(dimen));
+dimen *q = yield;
+
+for (int i = 0; i < n - 1; i++)
+  {
+  dimen *prev = (i == 0)? p : p + 2*(i - 1);
+  dimen *here = p + 2*i;
+  dimen *next = here + 2;
+  dimen *after = (i == n - 2)? next : next + 2;
+
+  q[0] = here[0];
+  q[1] = here[1];
+  q[2] = here[0] + (next[0] - prev[0])/6;
+  q[3] = here[1] + (next[1] - prev[1])/6;
+  q[4] = next[0] - (after[0] - here[0])/6;
+  q[5] = next[1] - (after[1] - here[1])/6;
+  q += 6;
+  }
+
+q[0] = p[2*n - 2];
+q[1] = p[2*n - 1];
+return yield;
+}
+
+
+/* The points are read into a packed vector, and the whole path is one item.
+For a polygon, the last point is joined to the first, so it is also the end
+point for the purpose of positioning the next item. For a spline, the vector
+holds the points of the equivalent Bezier curves. */
+
+void
+c_poly(void)
+{
+dimen minx = LLONG_MAX, miny = LLONG_MAX, maxx = LLONG_MIN, maxy = LLONG_MIN;
+dimen *points;
+item_poly *poly = getstore(sizeof(item_poly));
+
+poly->next = NULL;
+poly->strings = NULL;
+
+poly->type = i_poly;
+poly->style = item_arg1;
+poly->closed = item_arg2 == poly_closed;
+poly->smooth = item_arg2 == poly_smooth;
+poly->level = env->level;
+
+poly->linedepth = env->linedepth;
+poly->fontdepth = env->fontdepth;
+poly->thickness = env->linethickness;
+poly->dash1 = 0;
+poly->dash2 = 0;
+poly->colour = env->linecolour;
+poly->shapefilled = env->shapefilled;
+
+points = readpoints(&(poly->count));
+if (poly->count < (poly->closed? 3 : 2))
+  {
+  error_moan(64, poly->closed? 3 : 2);
+  return;
+  }
+
+if (poly->smooth)
+  {
+  poly->points = spline_points(points, poly->count);
+  poly->count = 3*(poly->count - 1) + 1;
+  }
+else
+  {
+  poly->points = getstore(2 * poly->count * sizeof(dimen));
+  memcpy(poly->points, points, 2 * poly->count * sizeof(dimen));
+  }
+
+/* Read optional parameters and sort out dashing */
+
+options((item *)poly, &poly_table);
+if (poly->dash1) { poly->dash1 = env->linedash1; poly->dash2 = env->linedash2; }
+
+for (int i = 0; i < 2*poly->count; i += 2)
+  {
+  dimen x = poly->points[i];
+  dimen y = poly->points[i+1];
+  if (x < minx) minx = x;
+  if (x > maxx) maxx = x;
+  if (y < miny) miny = y;
+  if (y > maxy) maxy = y;
+  }
+
+poly->x = (minx + maxx)/2;
+poly->y = (miny + maxy)/2;
+poly->x0 = poly->points[0];
+poly->y0 = poly->points[1];
+if (poly->closed)
+  {
+  poly->x1 = poly->x0;
+  poly->y1 = poly->y0;
+  }
+else
+  {
+  poly->x1 = poly->points[2*poly->count - 2];
+  poly->y1 = poly->points[2*poly->count - 1];
+  }
+
+/* Read any associated strings, then connect to chain, updating the last item
+and sorting the label. */
+
+readstringchain((item *)poly, just_centre);
+chain_label((item *)poly);
 }
 
 
@@ -1175,10 +1926,8 @@ line->endx = line->endy = line->alignx = line->aligny = UNSET;
 
 /* Read optional parameters and sort out dashing */
 
-options((item *)line, item_arg2? arrow_args : line_args);
+options((item *)line, item_arg2? &arrow_table : &line_table);
 if (line->dash1) { line->dash1 = env->linedash1; line->dash2 = env->linedash2; }
-if (line->level > max_level) max_level = line->level;
-if (line->level < min_level) min_level = line->level;
 
 /* If no end point is given set the default size if required; if any option was
 encountered, both dimensions will have been set, so we test only one. */
@@ -1245,12 +1994,17 @@ if (line->x == UNSET)
     line->y = lastcurve->y1;
     break;
 
+    case i_poly:
+    line->x = ((item_poly *)baseitem)->x1;
+    line->y = ((item_poly *)baseitem)->y1;
+    break;
+
     case i_box:
     lastbox = (item_box *)baseitem;
 
     if (line->width == UNSET || line->depth == UNSET)
       quadrant = env->direction;
-    else if (abs(line->depth) < abs(line->width))
+    else if (llabs(line->depth) < llabs(line->width))
       quadrant = (line->width > 0)? east : west;
     else quadrant = (line->depth > 0)? north : south;
 
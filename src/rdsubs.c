@@ -17,7 +17,17 @@ is being read. */
 *            Local variables                     *
 *************************************************/
 
-static BOOL wordread;   /* Set TRUE when a word has been read but not used. */
+/* The lexer's view of the current input line. The token map gives, for each
+offset in the line, the index of the token that starts there, or -1. The skip
+map gives, for each offset, the offset of the next character that is not a
+space or newline. */
+
+static uschar *lexed_line = NULL;
+static int     lex_length = 0;
+static int     lex_count = 0;
+static token   lex_tokens[INPUT_LINESIZE];
+static short   lex_map[INPUT_LINESIZE];
+static short   lex_skip[INPUT_LINESIZE + 1];
 
 
 
@@ -37,12 +47,12 @@ Returns:    nothing
 */
 
 void
-find_curvepos(item_curve *pp, double t, int *xp, int *yp)
+find_curvepos(item_curve *pp, double t, dimen *xp, dimen *yp)
 {
-int x1 = pp->x0 + pp->cx1;
-int x2 = pp->x0 + pp->cx2;
-int y1 = pp->y0 + pp->cy1;
-int y2 = pp->y0 + pp->cy2;
+dimen x1 = pp->x0 + pp->cx1;
+dimen x2 = pp->x0 + pp->cx2;
+dimen y1 = pp->y0 + pp->cy1;
+dimen y2 = pp->y0 + pp->cy2;
 
 double ax = (double)(pp->x1 - 3*x2 + 3*x1 - pp->x0);
 double bx = (double)(3*x2 - 6*x1 + 3*pp->x0);
@@ -52,8 +62,8 @@ double ay = (double)(pp->y1 - 3*y2 + 3*y1 - pp->y0);
 double by = (double)(3*y2 - 6*y1 + 3*pp->y0);
 double cy = (double)(3*(y1 - pp->y0));
 
-*xp = (int)(ax*t*t*t + bx*t*t + cx*t) + pp->x0;
-*yp = (int)(ay*t*t*t + by*t*t + cy*t) + pp->y0;
+*xp = (dimen)(ax*t*t*t + bx*t*t + cx*t) + pp->x0;
+*yp = (dimen)(ay*t*t*t + by*t*t + cy*t) + pp->y0;
 }
 
 
@@ -62,18 +72,18 @@ double cy = (double)(3*(y1 - pp->y0));
 *            Find labelled item                  *
 *************************************************/
 
-/* Finds the item with the given label.
+/* Finds the item with the given label. The value of each node in the tree of
+labels is a pointer to its item.
 
 Argument:  the label name
-Returns:   a pointer to the item
+Returns:   a pointer to the item, or NULL
 */
 
 item *
 findlabel(uschar *word)
 {
-for (label *ii = label_base; ii != NULL; ii = ii->next)
-  if (Ustrcmp(word, ii->name) == 0) return ii->itemptr;
-return NULL;
+tree_node *tn = tree_search(label_root, word);
+return (tn == NULL)? NULL : (item *)tn->value;
 }
 
 
@@ -84,8 +94,8 @@ return NULL;
 
 /* This is called for drawing items that are allowed to be labelled. It is not
 called for the "text" item. Put the given item on the item chain and set it up
-as the base item. If nextlabel points to one or more labels, point each of them
-back to this item and then add the label(s) to the chain of labels.
+as the base item. If nextlabel points to one or more labels, add each of them to
+the tree of labels, pointing to this item.
 
 Argument :  the new item
 Returns:    nothing
@@ -97,19 +107,14 @@ chain_label(item *newitem)
 if (lastitem == NULL) main_item_base = newitem; else lastitem->next = newitem;
 baseitem = lastitem = newitem;
 
-if (nextlabel != NULL)
+for (label *lb = nextlabel; lb != NULL; lb = lb->next)
   {
-  label *lastlabel = nextlabel;
-  for (;;)
-    {
-    lastlabel->itemptr = newitem;
-    if (lastlabel->next == NULL) break;
-    lastlabel = lastlabel->next;
-    }
-  lastlabel->next = label_base;
-  label_base = nextlabel;
-  nextlabel = NULL;
+  tree_node *tn = getstore(sizeof(tree_node) + Ustrlen(lb->name));
+  Ustrcpy(tn->name, lb->name);
+  tn->value = (uschar *)newitem;
+  (void)tree_insertnode(&label_root, tn);
   }
+nextlabel = NULL;
 }
 
 
@@ -118,108 +123,922 @@ if (nextlabel != NULL)
 *        Substitute variables in a line          *
 *************************************************/
 
-/* The size of the output buffer is assumed to be INPUT_LINESIZE. We look
-for the special notation &$ that is used in Aspic macros, and do not treat
-that $ as introducing a variable.
+/* We look for the special notation &$ that is used in Aspic macros, and do
+not treat that $ as introducing a variable. The raw line is not zero-terminated
+(it may be in a mapped file), so its length is passed.
 
 Arguments:
   raw        the raw input line
+  rawlen     the length of the raw input line
   cooked     where to put the cooked input line
+  size       the size of the cooked buffer
 
-Returns:     nothing
+Returns:     the length of the cooked line
 */
 
-static void
-subs_vars(uschar *raw, uschar *cooked)
+static int
+subs_vars(uschar *raw, int rawlen, uschar *cooked, int size)
 {
-int left = INPUT_LINESIZE;
+int left = size;
 BOOL bracketed, toolong;
 uschar *p, *s, *t;
+uschar *rawend = raw + rawlen;
 uschar name[64];
 
 substituting = TRUE;   /* Errors to reflect raw line */
 
-for (s = raw, t = cooked; *s != 0; )
+for (s = raw, t = cooked; s < rawend; )
   {
+  size_t n;
+  uschar *e;
+
   if (left < 2)
     {
     /* LCOV_EXCL_START */
-    error_moan(26);
+    error_moan(26);
+    exit(EXIT_FAILURE);
+    /* LCOV_EXCL_STOP */
+    }
+
+  /* Find the next $ or & with memchr(), which is usually much faster than a
+  byte-by-byte loop, and copy the run of ordinary characters before it in one
+  go. A run of n characters needs n+1 bytes of space, as it would if copied
+  singly with the check above. */
+
+  e = memchr(s, '$', rawend - s);
+  if (e == NULL) e = rawend;
+  p = memchr(s, '&', e - s);
+  if (p != NULL) e = p;
+
+  if ((n = e - s) > 0)
+    {
+    if (n > (size_t)(left - 1))
+      {
+      /* LCOV_EXCL_START */
+      error_moan(26);
+      exit(EXIT_FAILURE);
+      /* LCOV_EXCL_STOP */
+      }
+    memcpy(t, s, n);
+    s += n;
+    t += n;
+    left -= n;
+    continue;
+    }
+
+  /* Now at & or $ */
+
+  if (*s == '&')
+    {
+    *t++ = *s++;
+    left--;
+    if (s < rawend && (*s == '$' || *s == '&')) { *t++ = *s++; left--; }
+    continue;
+    }
+
+  if (s + 1 < rawend && s[1] == '$')
+    {
+    *t++ = '$';
+    s += 2;
+    left--;
+    continue;
+    }
+
+  if (++s < rawend && *s == '{')
+    {
+    bracketed = TRUE;
+    s++;
+    }
+  else bracketed = FALSE;
+
+  toolong = FALSE;
+  p = name;
+  while (s < rawend && (isalpha(*s) || isdigit(*s)))
+    {
+    if (!toolong)
+      {  
+      if ((size_t)(p - name) >= sizeof(name) - 1) toolong = TRUE;
+        else *p++ = *s;
+      } 
+    s++;   
+    } 
+  *p = 0;
+
+  subs_ptr = s - raw;   /* Offset for errors */
+
+  if (bracketed)
+    {
+    if (s < rawend && *s == '}') s++; else error_moan(27, name);
+    }
+
+  if (*name == 0) error_moan(17); 
+  else if (toolong) error_moan(43); 
+  else
+    {
+    tree_node *tn = find_local(name);
+    if (tn == NULL) tn = tree_search(varroot, name);
+    if (tn == NULL)
+      {
+      error_moan(6, "", name);
+      }
+    else
+      {
+      int len = Ustrlen(tn->value);
+      if (left < len + 1)
+        {
+        error_moan(25, name);
+        exit(EXIT_FAILURE);
+        }
+      Ustrcpy(t, tn->value);
+      t += len;
+      left -= len;
+      }
+    }
+  }
+
+*t = 0;
+substituting = FALSE;
+return t - cooked;
+}
+
+
+
+/*************************************************
+*       Find the start of a loop body            *
+*************************************************/
+
+/* The body of a loop is substituted afresh for each iteration, so when a line
+contains the start of a "for" or "repeat" command, substitution must stop after
+its opening brace. Commands are recognized at the start of the line and after
+semicolons that are not in quotes or braces, so the body of a macro that is
+being defined is not affected. Nor are the continuation lines of a macro
+definition, which are wholly substituted. Labels are skipped.
+
+Arguments:
+  raw        the raw line
+  len        its length
+
+Returns:     the offset after the brace, or len if there is no loop
+*/
+
+static int
+find_loop_body(uschar *raw, int len)
+{
+int i = 0;
+int depth = 0;
+BOOL cmdstart = TRUE;
+
+if (defining_macro) return len;
+
+while (i < len)
+  {
+  int c = raw[i];
+
+  /* Check the command word, if there is one. */
+
+  if (cmdstart)
+    {
+    int j, k;
+    while (i < len && (raw[i] == ' ' || raw[i] == '\t')) i++;
+    if (i >= len || raw[i] == '#') break;
+    for (j = i; j < len && (isalpha(raw[j]) || isdigit(raw[j])); j++);
+    for (k = j; k < len && (raw[k] == ' ' || raw[k] == '\t'); k++);
+    if (j > i && k < len && raw[k] == ':')     /* Label */
+      {
+      i = k + 1;
+      continue;
+      }
+    if ((j - i == 3 && Ustrncmp(raw + i, "for", 3) == 0) ||
+        (j - i == 6 && Ustrncmp(raw + i, "repeat", 6) == 0))
+      {
+      for (; k < len && raw[k] != ';' && raw[k] != '\"'; k++)
+        if (raw[k] == '{') return k + 1;
+      }
+    cmdstart = FALSE;
+    continue;
+    }
+
+  /* Skip over the rest of the command */
+
+  switch (c)
+    {
+    case '\"':
+    while (++i < len && raw[i] != '\"' && raw[i] != '\n');
+    break;
+
+    case '$':
+    if (i + 1 < len && raw[i+1] == '$') i++;
+    else if (i + 1 < len && raw[i+1] == '{')
+      while (i + 1 < len && raw[i] != '}') i++;
+    break;
+
+    case '{':
+    depth++;
+    break;
+
+    case '}':
+    if (depth > 0) depth--;
+    break;
+
+    case ';':
+    if (depth == 0) cmdstart = TRUE;
+    break;
+    }
+
+  i++;
+  }
+
+return len;
+}
+
+
+
+/*************************************************
+*    Substitute variables, except in loop body   *
+*************************************************/
+
+/* If the line starts a loop, the text after the opening brace is copied
+without substitution. The caller must record the offset of that text, which
+is returned.
+
+Arguments:
+  raw        the raw input line
+  rawlen     the length of the raw input line
+  cooked     where to put the cooked input line
+  size       the size of the cooked buffer
+
+Returns:     offset of unsubstituted text in the cooked line, or -1
+*/
+
+static int
+substitute_line(uschar *raw, int rawlen, uschar *cooked, int size)
+{
+int k = find_loop_body(raw, rawlen);
+int n = subs_vars(raw, k, cooked, size);
+
+if (k >= rawlen) return -1;
+if (rawlen - k > size - n - 1)
+  {
+  /* LCOV_EXCL_START */
+  error_moan(26);
+  exit(EXIT_FAILURE);
+  /* LCOV_EXCL_STOP */
+  }
+memcpy(cooked + n, raw + k, rawlen - k);
+cooked[n + rawlen - k] = 0;
+return n;
+}
+
+
+
+/*************************************************
+*     Substitute the rest of the current line    *
+*************************************************/
+
+/* This is called when reading reaches the text that follows the closing brace
+of a loop body on the same line. That text is not substituted until then, so
+that it sees the final value of the loop variable. It may start another loop.
+Errors reflect just the text that is being substituted.
+
+Arguments:  none
+Returns:    nothing
+*/
+
+void
+substitute_rest(void)
+{
+static uschar buffer[INPUT_LINESIZE];
+int len;
+
+if (unsubstituted < 0 || no_variables) return;
+
+len = Ustrlen(in_line + chptr);
+memcpy(buffer, in_line + chptr, len);
+in_raw = buffer;
+in_raw_length = len;
+unsubstituted = substitute_line(buffer, len, in_line + chptr,
+  INPUT_LINESIZE - chptr);
+if (unsubstituted >= 0) unsubstituted += chptr;
+lex_line();
+}
+
+
+
+/*************************************************
+*         Abandon an overlong macro line         *
+*************************************************/
+
+/* This is called when substituting into a line of a macro or loop body would
+overflow in_line. The line is terminated where it has got to, so that it can
+be reflected safely. When the arguments come from a row of a data file, the
+row is identified, because it is the cause.
+
+Arguments:
+  lp         the active loop, or NULL
+  t          where the line has got to
+
+Returns:     nothing; processing is abandoned
+*/
+
+static void
+line_too_long(loop *lp, uschar *t)
+{
+*t = 0;
+chptr = (int)(t - in_line);
+if (lp != NULL && lp->data != NULL) error_moan(69, lp->row, lp->dataname);
+  else error_moan(26);
+exit(EXIT_FAILURE);
+}
+
+
+
+/*************************************************
+*    Handle && and &$ after an inner loop body   *
+*************************************************/
+
+/* In the lines of a macro or loop body, && and &$ are not handled in the text
+of an inner loop body, so that each iteration of the inner loop has its own
+value for &$. The same applies to any text that follows the closing brace on
+the same line, so it is handled here, once the inner loop has finished and the
+outer value has been restored. Another inner loop body that starts in the text
+is again left alone. When variables are disabled, none of this happens, and
+the lines of a loop body do not have && and &$ handled at all.
+
+Arguments:  none
+Returns:    nothing
+*/
+
+void
+expand_rest(void)
+{
+uschar buffer[INPUT_LINESIZE];
+uschar *t = in_line + chptr;
+uschar *f = buffer;
+uschar *body;
+int len;
+
+if (no_variables) return;
+
+len = Ustrlen(t);
+memcpy(buffer, t, len + 1);
+body = buffer + find_loop_body(buffer, len);
+
+while (*f != 0)
+  {
+  if (t - in_line >= INPUT_LINESIZE - 12) line_too_long(NULL, t);
+  if (*f == '&' && f < body && (f[1] == '&' || f[1] == '$'))
+    {
+    if (f[1] == '&') *t++ = '&'; else
+      t += sprintf(CS t, "%d", macro_id);
+    f += 2;
+    }
+  else *t++ = *f++;
+  }
+*t = 0;
+lex_line();
+}
+
+
+
+/*************************************************
+*        Read the next row of a data file        *
+*************************************************/
+
+/* For the "data" command, each iteration sets the macro arguments from the
+fields of the next row of the data file. Blank and comment lines are skipped;
+missing fields leave their arguments empty.
+
+Argument:  the loop
+Returns:   TRUE if there is another row
+*/
+
+static BOOL
+next_row(loop *lp)
+{
+int n;
+mac_arg *ap;
+uschar *fields[DATA_MAXFIELDS];
+uschar buffer[DATA_ROWSIZE];
+
+for (;;)
+  {
+  n = input_getrow(lp->data, fields, (lp->argcount > 0)? lp->argcount : 1,
+    buffer, sizeof(buffer));
+  lp->row++;
+  if (n > 0) break;
+  if (n == -1) return FALSE;
+  if (n == -2)
+    {
+    int save_chptr = chptr;
+    error_moan(61, lp->row, lp->dataname);
+    chptr = save_chptr;         /* Only the row is skipped */
+    }
+  }
+
+ap = lp->args;
+for (int i = 0; ap != NULL; ap = ap->next, i++)
+  {
+  if (i < n) Ustrcpy(ap->text, fields[i]); else ap->text[0] = 0;
+  }
+return TRUE;
+}
+
+
+
+/*************************************************
+*         Move on to the next loop iteration     *
+*************************************************/
+
+/* This is called when a loop is started, and at the end of each iteration. If
+there is a loop variable, its value is updated.
+
+Arguments:
+  lp         the loop
+  first      TRUE for the first iteration
+
+Returns:     TRUE if there is another iteration
+*/
+
+BOOL
+next_iteration(loop *lp, BOOL first)
+{
+if (lp->data != NULL) return next_row(lp);
+if (!first)
+  {
+  lp->count--;
+  lp->value += lp->step;
+  }
+if (lp->count <= 0) return FALSE;
+if (lp->var != NULL)
+  {
+  (void)format_fixed(lp->valbuf, lp->value);
+  lp->var->value = lp->valbuf;
+  }
+return TRUE;
+}
+
+
+
+/*************************************************
+*              Finish with a loop                *
+*************************************************/
+
+/* The loop variable retains the final value that it was given. The loop's
+store is then kept for re-use.
+
+Argument:  the loop
+Returns:   nothing
+*/
+
+void
+end_loop(loop *lp)
+{
+if (lp->data != NULL) input_close(lp->data);
+if (lp->var != NULL && lp->var->value == lp->valbuf)
+  {
+  lp->var->value = lp->localvar? LOCAL_VALUE(lp->var) :
+    getstore(Ustrlen(lp->valbuf) + 1);
+  Ustrcpy(lp->var->value, lp->valbuf);
+  }
+freeloop(lp);
+}
+
+
+
+/*************************************************
+*          Split the current line into tokens    *
+*************************************************/
+
+/* This is called whenever in_line has been set up with new content. The line
+is scanned once, and the readers then pick up words and numbers from the
+resulting tokens rather than re-scanning the characters. Offsets are kept so
+that chptr and error reporting work exactly as before. Anything that is not a
+word, number, or quoted string is a single-character punctuation token.
+
+Arguments:  none
+Returns:    nothing
+*/
+
+void
+lex_line(void)
+{
+int i = 0;
+
+lexed_line = in_line;
+lex_count = 0;
+
+while (i < INPUT_LINESIZE && in_line[i] != 0)
+  {
+  token *t;
+  int c = in_line[i];
+
+  lex_map[i] = -1;
+  if (c == ' ' || c == '\n') { i++; continue; }
+
+  t = lex_tokens + lex_count;
+  lex_map[i] = lex_count++;
+  t->start = i;
+
+  if (isalpha(c))
+    {
+    t->type = tok_word;
+    while (isalpha(in_line[i]) || isdigit(in_line[i])) i++;
+    t->end = t->wordend = t->intend = i;
+    }
+
+  /* A number that is too large is given a value just over the maximum, so
+  that readnumber() can complain. */
+
+  else if (isdigit(c) || (c == '.' && isdigit(in_line[i+1])))
+    {
+    dimen n = 0;
+    int k = i;
+
+    t->type = tok_number;
+    while (isdigit(in_line[i]))
+      {
+      n = n * 10 + in_line[i++] - '0';
+      if (n > FIXED_MAX/1000) n = FIXED_MAX/1000 + 1;
+      }
+    t->intend = i;
+    t->intvalue = (int)n;
+    n = n * 1000;
+    if (in_line[i] == '.')
+      {
+      int m = 100;
+      while (isdigit(in_line[++i]))
+        {
+        n += (in_line[i] - '0') * m;
+        m /= 10;
+        }
+      }
+    t->value = (n > FIXED_MAX)? FIXED_MAX + 1 : n;
+    t->end = i;
+    while (isalpha(in_line[k]) || isdigit(in_line[k])) k++;
+    t->wordend = k;
+    }
+
+  /* A string extends to its closing quote, or to the end of the line if it is
+  unterminated. Doubled quotes do not terminate. */
+
+  else if (c == '\"')
+    {
+    t->type = tok_string;
+    for (i++; in_line[i] != 0 && in_line[i] != '\n'; i++)
+      {
+      if (in_line[i] == '\"' && in_line[++i] != '\"') break;
+      }
+    t->end = i;
+    t->wordend = t->intend = t->start;
+    }
+
+  else
+    {
+    t->type = tok_punct;
+    t->end = ++i;
+    t->wordend = t->intend = t->start;
+    }
+
+  for (int k = t->start + 1; k < i && k < INPUT_LINESIZE; k++) lex_map[k] = -1;
+  }
+
+if (i > INPUT_LINESIZE) i = INPUT_LINESIZE;
+lex_length = i;
+lex_skip[i] = i;
+while (--i >= 0)
+  lex_skip[i] = (in_line[i] == ' ' || in_line[i] == '\n')? lex_skip[i+1] : i;
+}
+
+
+
+/*************************************************
+*         Find the token at the current offset   *
+*************************************************/
+
+/* Returns NULL if no token starts at the current offset, for example if the
+offset is in the middle of a string or the line was not lexed. The caller then
+falls back to scanning characters. */
+
+static token *
+token_at(int offset)
+{
+int n;
+if (in_line != lexed_line || offset < 0 || offset >= lex_length) return NULL;
+n = lex_map[offset];
+return (n < 0)? NULL : lex_tokens + n;
+}
+
+
+
+/*************************************************
+*          Handle conditional lines              *
+*************************************************/
+
+/* Conditional lines are recognized in raw lines from input files, before
+variable substitution, and each must be on a line by itself. The stack records,
+for each open conditional, whether "else" has been seen. Lines in a branch that
+is not being obeyed are skipped here, without being substituted or lexed. */
+
+enum { cond_none, cond_if, cond_ifdef, cond_ifndef, cond_else, cond_endif };
+
+static BOOL cond_else_seen[COND_STACKSIZE];
+
+static const char *cond_words[] = {
+  NULL, "if", "ifdef", "ifndef", "else", "endif" };
+
+
+/* Local subroutine to give an error for a conditional line, reflecting the raw
+line in the same way as for a substitution error.
+
+Arguments:
+  p          points to the character at fault
+  n          the error number
+  s          a string argument for the error
+
+Returns:     nothing
+*/
+
+static void
+cond_error(uschar *p, int n, const char *s)
+{
+substituting = TRUE;
+subs_ptr = p - in_raw;
+error_moan(n, s);
+substituting = FALSE;
+}
+
+
+/* Local subroutine to skip spaces in a raw line. */
+
+static uschar *
+cond_skip_spaces(uschar *p, uschar *e)
+{
+while (p < e && (*p == ' ' || *p == '\t')) p++;
+return p;
+}
+
+
+/* Local subroutine to see if a raw line is a conditional line.
+
+Arguments:
+  p          the start of the line
+  e          the end of the line
+  after      where to return a pointer to the rest of the line
+
+Returns:     the type of conditional line, or cond_none
+*/
+
+static int
+cond_type(uschar *p, uschar *e, uschar **after)
+{
+int len;
+p = cond_skip_spaces(p, e);
+for (len = 0; p + len < e && isalpha(p[len]); len++);
+if (len < 2 || len > 6) return cond_none;
+if (p + len < e && !isspace(p[len]) && p[len] != ';') return cond_none;
+
+for (int i = cond_if; i <= cond_endif; i++)
+  {
+  if (Ustrlen(cond_words[i]) == len && Ustrncmp(p, cond_words[i], len) == 0)
+    {
+    *after = p + len;
+    return i;
+    }
+  }
+return cond_none;
+}
+
+
+/* Local subroutine to check that the rest of a conditional line is empty,
+apart from an optional semicolon and a comment.
+
+Arguments:
+  p          the current point in the line
+  e          the end of the line
+
+Returns:     TRUE if all is well; otherwise an error has been given
+*/
+
+static BOOL
+cond_end(uschar *p, uschar *e)
+{
+p = cond_skip_spaces(p, e);
+if (p < e && *p == ';') p = cond_skip_spaces(p + 1, e);
+if (p < e && *p != '\n' && *p != '\r' && *p != '#')
+  {
+  cond_error(p, 11, "End of line");
+  return FALSE;
+  }
+return TRUE;
+}
+
+
+/* Local subroutine to evaluate the condition on an "if", "ifdef", or "ifndef"
+line. The "ifdef" and "ifndef" tests just check for the existence of a
+variable. For "if", a variable on its own is true if it exists and its value is
+neither empty nor "0"; otherwise its value is compared with a string that
+follows "=" or "!=". The string may be a single word or be in quotes, where a
+quote is represented by two quotes, as in other strings.
+
+Arguments:
+  type       the type of line
+  p          the rest of the line, after the word
+  e          the end of the line
+
+Returns:     TRUE or FALSE; an error counts as FALSE
+*/
+
+static BOOL
+cond_evaluate(int type, uschar *p, uschar *e)
+{
+int n = 0;
+BOOL negate = FALSE;
+tree_node *tn;
+uschar name[64];
+uschar value[INPUT_LINESIZE];
+
+p = cond_skip_spaces(p, e);
+while (p < e && (isalpha(*p) || isdigit(*p)))
+  {
+  if (n >= (int)sizeof(name) - 1)
+    {
+    cond_error(p, 43, NULL);
+    return FALSE;
+    }
+  name[n++] = *p++;
+  }
+name[n] = 0;
+
+if (n == 0)
+  {
+  cond_error(p, 11, "Variable name");
+  return FALSE;
+  }
+
+tn = tree_search(varroot, name);
+if (type != cond_if)
+  return cond_end(p, e) && ((tn != NULL) == (type == cond_ifdef));
+
+p = cond_skip_spaces(p, e);
+if (p >= e || (*p != '=' && *p != '!'))
+  return cond_end(p, e) && tn != NULL && tn->value[0] != 0 &&
+    Ustrcmp(tn->value, "0") != 0;
+
+if (*p == '!')
+  {
+  if (p + 1 >= e || p[1] != '=')
+    {
+    cond_error(p, 11, "\"=\" or \"!=\"");
+    return FALSE;
+    }
+  negate = TRUE;
+  p++;
+  }
+p = cond_skip_spaces(p + 1, e);
+
+/* Read the value to compare with */
+
+n = 0;
+if (p < e && *p == '"')
+  {
+  for (;;)
+    {
+    if (++p >= e || *p == '\n')
+      {
+      cond_error(p, 21, NULL);
+      return FALSE;
+      }
+    if (*p == '"' && (++p >= e || *p != '"')) break;
+    value[n++] = *p;
+    }
+  }
+else while (p < e && !isspace(*p) && *p != ';') value[n++] = *p++;
+value[n] = 0;
+
+if (!cond_end(p, e)) return FALSE;
+return (tn != NULL && Ustrcmp(tn->value, value) == 0) != negate;
+}
+
+
+/* Local subroutine to skip lines in the current input file until the end of a
+conditional, or, if "else" is allowed, the start of its "else" branch. Nested
+conditionals are recognized, but their conditions are not evaluated. If the
+end of the file is reached, the check that is made there gives an error.
+
+Argument:  TRUE if "else" is allowed
+Returns:   nothing
+*/
+
+static void
+cond_skip(BOOL else_allowed)
+{
+int depth = 0;
+
+while ((in_raw = input_getline(main_input, &in_raw_length)) != NULL)
+  {
+  uschar *after;
+  uschar *e = in_raw + in_raw_length;
+  int type = cond_type(in_raw, e, &after);
+
+  if (type == cond_none) continue;
+  if (type == cond_else || type == cond_endif)
+    {
+    if (depth > 0)
+      {
+      if (type == cond_endif) depth--;
+      continue;
+      }
+    (void)cond_end(after, e);
+    if (type == cond_endif)
+      {
+      cond_depth--;
+      return;
+      }
+    if (cond_else_seen[cond_depth - 1])
+      cond_error(after - 4, 52, cond_words[type]);
+    cond_else_seen[cond_depth - 1] = TRUE;
+    if (else_allowed) return;
+    }
+  else depth++;
+  }
+}
+
+
+/* This is called for each line that is read from an input file. If it is a
+conditional line, it is processed, and any lines that are not to be obeyed are
+skipped.
+
+Arguments:  none
+Returns:    TRUE if the line was a conditional line
+*/
+
+static BOOL
+conditional_line(void)
+{
+uschar *after;
+uschar *e = in_raw + in_raw_length;
+int type = cond_type(in_raw, e, &after);
+int base = (included_from == NULL)? 0 : included_from->prevcond;
+
+switch (type)
+  {
+  case cond_none:
+  return FALSE;
+
+  case cond_if:
+  case cond_ifdef:
+  case cond_ifndef:
+  if (cond_depth >= COND_STACKSIZE)
+    {
+    /* LCOV_EXCL_START */
+    cond_error(after, 53, NULL);
     exit(EXIT_FAILURE);
     /* LCOV_EXCL_STOP */
     }
+  cond_else_seen[cond_depth++] = FALSE;
+  if (!cond_evaluate(type, after, e)) cond_skip(TRUE);
+  break;
 
-  if (*s == '&')
-    {
-    *t++ = *s++;
-    left--;
-    if (*s == '$' || *s == '&') { *t++ = *s++; left--; }
-    continue;
-    }
-
-  if (*s != '$')   { *t++ = *s++; left--; continue; }
+  /* In an obeyed branch, "else" starts a branch that is skipped */
 
-  if (s[1] == '$')
+  case cond_else:
+  case cond_endif:
+  if (cond_depth <= base)
     {
-    *t++ = '$';
-    s += 2;
-    left--;
-    continue;
+    cond_error(after - Ustrlen(cond_words[type]), 54, cond_words[type]);
+    break;
     }
-
-  if (*(++s) == '{')
+  (void)cond_end(after, e);
+  if (type == cond_endif) cond_depth--; else
     {
-    bracketed = TRUE;
-    s++;
+    if (cond_else_seen[cond_depth - 1]) cond_error(after - 4, 52, "else");
+    cond_else_seen[cond_depth - 1] = TRUE;
+    cond_skip(FALSE);
     }
-  else bracketed = FALSE;
+  break;
+  }
 
-  toolong = FALSE;
-  p = name;
-  while (isalpha(*s) || isdigit(*s)) 
-    {
-    if (!toolong)
-      {  
-      if ((size_t)(p - name) >= sizeof(name) - 1) toolong = TRUE;
-        else *p++ = *s;
-      } 
-    s++;   
-    } 
-  *p = 0;
+return TRUE;
+}
 
-  subs_ptr = s - raw;   /* Offset for errors */
 
-  if (bracketed)
-    {
-    if (*s == '}') s++; else error_moan(27, name);
-    }
+/* This is called at the end of each input file to check that all the
+conditionals that started in it have ended. There is no line to reflect.
 
-  if (*name == 0) error_moan(17); 
-  else if (toolong) error_moan(43); 
-  else
-    {
-    tree_node *tn = tree_search(varroot, name);
-    if (tn == NULL)
-      {
-      error_moan(6, "", name);
-      }
-    else
-      {
-      int len = Ustrlen(tn->value);
-      if (left < len + 1)
-        {
-        error_moan(25, name);
-        exit(EXIT_FAILURE);
-        }
-      Ustrcpy(t, tn->value);
-      t += len;
-      left -= len;
-      }
-    }
-  }
+Argument:  the value of cond_depth at the start of the file
+Returns:   nothing
+*/
 
-*t = 0;
-substituting = FALSE;
+static void
+cond_check_end(int base)
+{
+if (cond_depth > base)
+  {
+  reading = FALSE;
+  error_moan(55);
+  reading = TRUE;
+  cond_depth = base;
+  }
 }
 
 
@@ -242,34 +1061,111 @@ if (in_line[++chptr] != 0) return;
 
 if (in_line[0] != 0 && in_line[0] != '\n') Ustrcpy(in_prev, in_line);
 
-/* If a macro is active but there are no more lines, revert to the previous
-input environment. */
+/* If a macro or loop is active but there are no more lines, revert to the
+previous input environment. At the end of a loop body, start the next
+iteration if there is one; each iteration has its own value for &$. When a loop
+has finished, any text that followed its body can be substituted. */
 
 if (macactive != NULL)
   {
   macro *m = macactive;
+  loop *lp = m->loop;
+
+  if (m->nextline == NULL && lp != NULL && next_iteration(lp, FALSE))
+    {
+    m->nextline = lp->body;
+    m->args = lp->args;
+    free_locals(m);
+    macro_id = macro_count++;
+    }
+
   if (m->nextline == NULL)
     {
+    if (lp != NULL) end_loop(lp);
     macactive = m->previous;
+    unsubstituted = m->prevunsubstituted;
     freemacro(m);
     free_in_line(in_line);
     in_line = in_line_stack[--mac_stack_ptr];
     chptr = chptr_stack[mac_stack_ptr];
     macro_id = mac_count_stack[mac_stack_ptr];
+    lex_line();
+    if (lp != NULL)
+      {
+      if (macactive != NULL) expand_rest();
+      substitute_rest();
+      }
+    }
+
+  /* Get the next line of a loop body. Unless another loop body is being read,
+  substitute variables and then handle &$ and && as in a macro, but not in the
+  text of an inner loop body. */
+
+  else if (lp != NULL && lp->data == NULL)
+    {
+    uschar *f = (m->nextline)->text;
+    m->thisline = m->nextline;
+    m->nextline = (m->nextline)->next;
+    chptr = 0;
+
+    if (capturing_loop || no_variables)
+      {
+      Ustrcpy(in_line, f);
+      unsubstituted = capturing_loop? 0 : -1;
+      }
+    else
+      {
+      uschar buffer[INPUT_LINESIZE];
+      uschar *t = in_line;
+      int raw;
+
+      in_raw = f;
+      in_raw_length = Ustrlen(f);
+      raw = substitute_line(in_raw, in_raw_length, buffer, INPUT_LINESIZE);
+      unsubstituted = -1;
+
+      for (f = buffer; *f != 0;)
+        {
+        if (f - buffer == raw) unsubstituted = t - in_line;
+        /* LCOV_EXCL_START */
+        if (t - in_line >= INPUT_LINESIZE - 12) line_too_long(lp, t);
+        /* LCOV_EXCL_STOP */
+        if (*f == '&' && unsubstituted < 0 && (f[1] == '&' || f[1] == '$'))
+          {
+          if (f[1] == '&') *t++ = '&'; else
+            t += sprintf(CS t, "%d", macro_id);
+          f += 2;
+          }
+        else *t++ = *f++;
+        }
+      *t = 0;
+      }
+    lex_line();
     }
 
-  /* Get the next line from an active macro, substituting arguments. */
+  /* Get the next line from an active macro, substituting arguments. This is
+  also used for the "data" command. Unless variables are disabled, && and &$
+  are left alone in the text of an inner loop body, as in a loop body. */
 
   else
     {
+    unsubstituted = -1;
     uschar *t = in_line;
     uschar *f = (m->nextline)->text;
+    uschar *body = no_variables? f + Ustrlen(f) : capturing_loop? f :
+      f + find_loop_body(f, Ustrlen(f));
 
     while (*f != 0)
       {
+      if (t - in_line >= INPUT_LINESIZE - 12) line_too_long(lp, t);
       if (*f == '&')
         {
-        if (f[1] == '&')
+        if (f >= body && (f[1] == '&' || f[1] == '$'))
+          {
+          *t++ = *f++;
+          *t++ = *f++;
+          }
+        else if (f[1] == '&')
           {
           *t++ = '&';
           f += 2;
@@ -286,7 +1182,14 @@ if (macactive != NULL)
 	  int n = 0;
           while (isdigit((int)*(++f))) n = n*10 + (*f) - '0';
           while (--n > 0 && ap != NULL) ap = ap->next;
-          if (ap != NULL) { Ustrcpy(t, ap->text); t += Ustrlen(ap->text); }
+          if (ap != NULL)
+            {
+            int len = Ustrlen(ap->text);
+            if (t - in_line + len >= INPUT_LINESIZE - 12)
+              line_too_long(lp, t);
+            Ustrcpy(t, ap->text);
+            t += len;
+            }
           }
         }
       else *t++ = *f++;
@@ -294,34 +1197,40 @@ if (macactive != NULL)
     *t = 0;
     chptr = 0;
     m->nextline = (m->nextline)->next;
+    lex_line();
     }
   }
 
-/* Not in a macro. Read into in_raw, then scan for variables into in_line,
-unless variable substitution is disabled. Handle reverting at the end of an
-included file. */
+/* Not in a macro. Get the next raw line, which is usually in a mapped file,
+then scan for variables into in_line, unless variable substitution is disabled.
+Handle reverting at the end of an included file. */
 
 else while (!endfile)
   {
-  if (Ufgets(in_raw, INPUT_LINESIZE, main_input) == NULL)
+  if ((in_raw = input_getline(main_input, &in_raw_length)) == NULL)
     {
     if (included_from == NULL)  /* End of the main input */
       {
+      cond_check_end(0);
       endfile = TRUE;
       chptr = 0;
       in_line[0] = 0;
+      lex_line();
       }
     else                        /* End of an included file */
       {
       includestr *s = included_from;
+      cond_check_end(s->prevcond);
       free_in_line(in_line);
-      fclose(main_input);
+      input_close(main_input);
       main_input = s->prevfile;
       in_line = file_line_stack[--inc_stack_ptr];
       chptr = file_chptr_stack[inc_stack_ptr];
+      unsubstituted = s->prevunsubstituted;
       included_from = s->prev;
       s->prev = spare_included;
       spare_included = s;
+      lex_line();
       nextch();
       break;
       }
@@ -329,17 +1238,24 @@ else while (!endfile)
   else   /* Next line has been read */
     {
     /* LCOV_EXCL_START */
-    if (Ustrlen(in_raw) == INPUT_LINESIZE - 1 &&
-        in_raw[INPUT_LINESIZE - 1] != '\n')
+    if (in_raw_length >= INPUT_LINESIZE - 1)
       {
       reading = FALSE;      /* Stops it trying to reflect the line */
       error_moan(35, INPUT_LINESIZE - 1);
       exit(EXIT_FAILURE);   /* Best not try to continue */
       }
     /* LCOV_EXCL_STOP */
-    if (no_variables) Ustrcpy(in_line, in_raw); else subs_vars(in_raw, in_line);
+    if (conditional_line()) continue;
+    if (no_variables || capturing_loop)
+      {
+      memcpy(in_line, in_raw, in_raw_length);
+      in_line[in_raw_length] = 0;
+      unsubstituted = no_variables? -1 : 0;
+      }
+    else unsubstituted =
+      substitute_line(in_raw, in_raw_length, in_line, INPUT_LINESIZE);
     chptr = 0;
-    if (in_line[chptr] != '#') break;
+    if (in_line[chptr] != '#') { lex_line(); break; }
     }
   }
 }
@@ -350,13 +1266,21 @@ else while (!endfile)
 *         Get to next significant character      *
 *************************************************/
 
-/* The scan starts at the current character. */
+/* The scan starts at the current character. Within a lexed line we can jump
+straight to the next significant character; nextch() is needed only to move on
+to the next line. */
 
 void
 nextsigch(void)
 {
 while (in_line[chptr] == ' ' || in_line[chptr] == '\n')
   {
+  if (in_line == lexed_line && chptr < lex_length)
+    {
+    chptr = lex_skip[chptr];
+    if (in_line[chptr] != 0) continue;
+    chptr--;             /* Let nextch() find the end of the line */
+    }
   nextch();
   if (endfile) break;
   }
@@ -526,24 +1450,112 @@ return c;
 *             Read next word                     *
 *************************************************/
 
-/* The result is put in the global "word". If "wordread" is TRUE, there's
-already a previous word that was not used. */
+/* The result is put in the global "word". When a token starts at the current
+offset, its extent is already known; otherwise scan the characters. */
 
 void
 readword(void)
 {
 int n = 0;
-if (!wordread)
+token *t = token_at(chptr);
+if (t != NULL)
+  {
+  n = t->wordend - chptr;
+  if (n > WORD_SIZE - 1) { error_moan(36); exit(EXIT_FAILURE); }
+  memcpy(word, in_line + chptr, n);
+  chptr = t->wordend;
+  }
+else while (isalpha((int)in_line[chptr]) || isdigit((int)in_line[chptr]))
+  {
+  if (n > WORD_SIZE - 2) { error_moan(36); exit(EXIT_FAILURE); }
+  word[n++] = in_line[chptr++];
+  }
+word[n] = 0;
+nextsigch();
+}
+
+
+
+/*************************************************
+*       Find the length of the next word         *
+*************************************************/
+
+/* The word is not read. Its extent is known if a token starts at the current
+offset; otherwise scan the characters.
+
+Arguments:  none
+Returns:    the length of the word at chptr, or zero if there isn't one
+*/
+
+static int
+word_length(void)
+{
+int n = chptr;
+token *t = token_at(chptr);
+if (t != NULL) return t->wordend - chptr;
+while (isalpha((int)in_line[n]) || isdigit((int)in_line[n])) n++;
+return n - chptr;
+}
+
+
+
+/*************************************************
+*         Check for a particular word            *
+*************************************************/
+
+/* The word at the current offset is compared with the given one. If they are
+the same, the word and any following white space are passed; otherwise nothing
+is consumed, so a word that is not wanted never has to be put back.
+
+Argument:   the word to look for
+Returns:    TRUE if it was found
+*/
+
+static BOOL
+match_word(const char *s)
+{
+int n = word_length();
+if (n == 0 || Ustrncmp(in_line + chptr, s, n) != 0 || s[n] != 0) return FALSE;
+chptr += n;
+nextsigch();
+return TRUE;
+}
+
+
+
+/*************************************************
+*            Read a label reference              *
+*************************************************/
+
+/* A label that refers to a cell of a grid has the row and column numbers in
+square brackets after the name, for example A[2][3]. Each number may be an
+expression. The complete label is left in word, in a standard form.
+
+Arguments:  none
+Returns:    nothing
+*/
+
+void
+readlabel(void)
+{
+readword();
+while (word[0] != 0 && in_line[chptr] == '[')
   {
-  while (isalpha((int)in_line[chptr]) || isdigit((int)in_line[chptr]))
+  int n, len;
+  nextch();
+  nextsigch();
+  n = readint();
+  if (in_line[chptr] != ']')
     {
-    if (n > WORD_SIZE - 2) { error_moan(36); exit(EXIT_FAILURE); }
-    word[n++] = in_line[chptr++];
+    error_moan(11, "\"]\"");
+    return;
     }
-  word[n] = 0;
+  len = Ustrlen(word);
+  if (len > WORD_SIZE - 14) { error_moan(36); exit(EXIT_FAILURE); }
+  sprintf(CS word + len, "[%d]", n);
+  nextch();
   nextsigch();
   }
-wordread = FALSE;
 }
 
 
@@ -594,6 +1606,166 @@ if (p != NULL)
 
 
 
+/*************************************************
+*          Read an arithmetic expression         *
+*************************************************/
+
+/* An expression in parentheses may be used wherever a number is expected. It
+is evaluated in the same fixed-point arithmetic as the rest of Aspic, and
+results are limited to the largest dimension. Because variables have
+already been substituted, every expression is a constant by the time it is
+read. After the first error in an expression, no more are reported for it. */
+
+static BOOL expr_failed;
+
+static dimen expr_sum(void);
+
+
+/* Local subroutine to divide, rounding to the nearest value and limiting the
+result to the largest dimension.
+
+Arguments:
+  n          the dividend
+  d          the divisor, which is not zero
+
+Returns:     n/d, rounded
+*/
+
+static dimen
+expr_divide(dimen n, dimen d)
+{
+dimen q;
+if (d < 0) { n = -n; d = -d; }
+q = (n >= 0)? (n + d/2)/d : -((d/2 - n)/d);
+if (q > FIXED_MAX) return FIXED_MAX;
+if (q < -FIXED_MAX) return -FIXED_MAX;
+return q;
+}
+
+
+/* Local subroutine to report an error, once per expression.
+
+Argument:  the text for the "expected" message
+Returns:   zero, as a value to carry on with
+*/
+
+static int
+expr_error(const char *s)
+{
+if (!expr_failed) error_moan(11, s);
+expr_failed = TRUE;
+return 0;
+}
+
+
+/* Read a factor: a signed number or a parenthesized sub-expression. */
+
+static dimen
+expr_factor(void)
+{
+dimen n;
+int sign = 1;
+
+nextsigch();
+while (in_line[chptr] == '-' || in_line[chptr] == '+')
+  {
+  if (in_line[chptr] == '-') sign = -sign;
+  nextch();
+  nextsigch();
+  }
+
+if (in_line[chptr] == '(')
+  {
+  nextch();
+  n = expr_sum();
+  if (in_line[chptr] != ')') return expr_error("Closing parenthesis");
+  nextch();
+  }
+else if (isdigit((int)in_line[chptr]) || in_line[chptr] == '.')
+  n = readnumber();
+else return expr_error("Number");
+
+nextsigch();
+return n * sign;
+}
+
+
+/* Read a term: factors separated by * or /. */
+
+static dimen
+expr_term(void)
+{
+dimen n = expr_factor();
+
+while (!expr_failed && (in_line[chptr] == '*' || in_line[chptr] == '/'))
+  {
+  int op = in_line[chptr];
+  dimen m;
+  nextch();
+  m = expr_factor();
+  if (op == '*')
+    {
+    /* A product that does not fit in 64 bits is certainly too large. */
+    if (n != 0 && llabs(m) > LLONG_MAX/llabs(n))
+      n = ((n < 0) != (m < 0))? -FIXED_MAX : FIXED_MAX;
+    else n = expr_divide(n * m, 1000);
+    }
+  else if (m == 0)
+    {
+    if (!expr_failed) error_moan(47);
+    expr_failed = TRUE;
+    }
+  else n = expr_divide(n * 1000, m);
+  }
+
+return n;
+}
+
+
+/* Read a sum: terms separated by + or -. */
+
+static dimen
+expr_sum(void)
+{
+dimen n = expr_term();
+
+while (!expr_failed && (in_line[chptr] == '+' || in_line[chptr] == '-'))
+  {
+  int op = in_line[chptr];
+  dimen m;
+  nextch();
+  m = expr_term();
+  m = (op == '+')? n + m : n - m;
+  n = (m > FIXED_MAX)? FIXED_MAX : (m < -FIXED_MAX)? -FIXED_MAX : m;
+  }
+
+return n;
+}
+
+
+/* Read a parenthesized expression. On entry, chptr is at the opening
+parenthesis; afterwards it points to the character after the closing one, as
+for a number.
+
+Arguments:  none
+Returns:    the fixed-point value
+*/
+
+static dimen
+readexpression(void)
+{
+dimen n;
+expr_failed = FALSE;
+nextch();
+n = expr_sum();
+if (expr_failed) return 0;
+if (in_line[chptr] != ')') return expr_error("Closing parenthesis");
+nextch();
+return n;
+}
+
+
+
 /*************************************************
 *                Read integer                    *
 *************************************************/
@@ -603,14 +1775,72 @@ readint(void)
 {
 int n = 0;
 int sign = 1;
+token *t;
 if (in_line[chptr] == '-')
   {
   sign = -1;
   nextch();
   }
-while (isdigit((int)in_line[chptr])) n = n * 10 + in_line[chptr++] - '0';
-nextsigch();
-return n * sign;
+if (in_line[chptr] == '(')
+  {
+  n = (int)expr_divide(readexpression(), 1000);
+  nextsigch();
+  return n * sign;
+  }
+t = token_at(chptr);
+if (t != NULL)
+  {
+  if (t->type == tok_number)
+    {
+    n = t->intvalue;
+    chptr = t->intend;
+    }
+  }
+else while (isdigit((int)in_line[chptr])) n = n * 10 + in_line[chptr++] - '0';
+nextsigch();
+return n * sign;
+}
+
+
+
+/*************************************************
+*      Convert digits to a fixed point number    *
+*************************************************/
+
+/* This is used by readnumber(), and for numbers in data files, so that they
+are converted in the same way. Digits after the third decimal place are
+ignored. A number that is too large is given a value just over the maximum.
+
+Arguments:
+  s          points to the first digit or the decimal point
+  endptr     where to return a pointer to the character after the number
+
+Returns:     the value
+*/
+
+dimen
+scan_fixed(uschar *s, uschar **endptr)
+{
+dimen n = 0;
+
+while (isdigit((int)*s))
+  {
+  n = n * 10 + *s++ - '0';
+  if (n > FIXED_MAX/1000) n = FIXED_MAX/1000 + 1;
+  }
+n = n * 1000;
+if (*s == '.')
+  {
+  int m = 100;
+  while (isdigit((int)*(++s)))
+    {
+    n += (*s - '0') * m;
+    m /= 10;
+    }
+  }
+
+*endptr = s;
+return (n > FIXED_MAX)? FIXED_MAX + 1 : n;
 }
 
 
@@ -622,11 +1852,12 @@ return n * sign;
 /* Afterwards, chptr points at the character immediately after the number on
 the input line. */
 
-int
+dimen
 readnumber(void)
 {
-int n = 0;
+dimen n = 0;
 int sign = 1;
+token *t;
 
 if (in_line[chptr] == '-')
   {
@@ -635,27 +1866,59 @@ if (in_line[chptr] == '-')
   }
 else if (in_line[chptr] == '+') nextch();
 
-while (isdigit((int)in_line[chptr])) n = n * 10 + in_line[chptr++] - '0';
-n = n * 1000;
-if (in_line[chptr] == '.')
+if (in_line[chptr] == '(') return readexpression() * sign;
+
+t = token_at(chptr);
+if (t != NULL && t->type == tok_number)
   {
-  int m = 100;
-  while (isdigit((int)in_line[++chptr]))
-    {
-    n += (in_line[chptr] - '0') * m;
-    m /= 10;
-    }
+  chptr = t->end;
+  n = t->value;
+  }
+else
+  {
+  uschar *end;
+  n = scan_fixed(in_line + chptr, &end);
+  chptr = (int)(end - in_line);
+  }
+
+if (n > FIXED_MAX)
+  {
+  error_moan(65, (int)(FIXED_MAX/1000));
+  n = FIXED_MAX;
   }
 return n * sign;
 }
 
 
 
+/*************************************************
+*            Read colour component               *
+*************************************************/
+
+/* Colour components are held in ints. A value that does not fit is limited,
+so that it is still out of range when checked by the caller.
+
+Arguments:  none
+Returns:    the fixed-point value
+*/
+
+int
+readcolour(void)
+{
+dimen n = readnumber();
+if (n > INT_MAX) return INT_MAX;
+if (n < -INT_MAX) return -INT_MAX;
+return (int)n;
+}
+
+
+
 /*************************************************
 *                Read vector value               *
 *************************************************/
 
-/* Called when '(' has been read, in order to read two dimensions.
+/* Called when '(' has been read, in order to read two dimensions, each of which
+may be an expression.
 
 Arguments:
   xx          where to put the first dimension
@@ -665,39 +1928,69 @@ Returns:      nothing
 */
 
 static void
-readvector(int *xx, int *yy)
+readvector(dimen *xx, dimen *yy)
 {
+expr_failed = FALSE;
 nextch();
-nextsigch();
-if (!isdigit((int)in_line[chptr]) && in_line[chptr] != '-')
+*xx = mag(expr_sum());
+if (expr_failed) return;
+if (in_line[chptr] != ',')
   {
-  error_moan(11, "Number");
+  error_moan(11, "Comma");
   return;
   }
-else
+
+nextch();
+*yy = mag(expr_sum());
+if (expr_failed) return;
+if (in_line[chptr] != ')')
   {
-  *xx = mag(readnumber());
-  if (in_line[chptr] != ',')
-    {
-    error_moan(11, "Comma");
-    return;
-    }
+  error_moan(11, "Closing parenthesis");
+  return;
+  }
 
-  nextch();
-  nextsigch();
-  if (!isdigit((int)in_line[chptr]) && in_line[chptr] != '-') error_moan(11, "Number"); else
+nextch();
+nextsigch();
+}
+
+
+
+/*************************************************
+*              Read a list of points             *
+*************************************************/
+
+/* The points are parenthesized pairs of coordinates, which may be expressions.
+They are collected in a work vector of x,y pairs, which is kept for re-use and
+doubled in size when necessary. The caller must copy or convert the points
+before the next call.
+
+Argument:  where to return the number of points
+Returns:   pointer to the points in the work vector
+*/
+
+dimen *
+readpoints(int *countptr)
+{
+static dimen *work = NULL;
+static int worksize = 0;
+int n = 0;
+
+while (in_line[chptr] == '(')
+  {
+  if (n + 2 > worksize)
     {
-    *yy = mag(readnumber());
-    if (in_line[chptr] != ')')
-      {
-      error_moan(11, "Closing parenthesis");
-      return;
-      }
+    dimen *newwork;
+    worksize = (worksize == 0)? 64 : 2 * worksize;
+    newwork = getstore(worksize * sizeof(dimen));
+    if (n > 0) memcpy(newwork, work, n * sizeof(dimen));
+    work = newwork;
     }
+  readvector(work + n, work + n + 1);
+  n += 2;
   }
-while (in_line[chptr] != ')' && !endfile) nextch();
-nextch();
-nextsigch();
+
+*countptr = n/2;
+return work;
 }
 
 
@@ -746,22 +2039,19 @@ Returns:   pointer to a stringchain item
 static stringchain *
 readstring(int justify)
 {
-int rotate = UNSET;
-int xadjust = 0;
-int yadjust = 0;
+dimen rotate = UNSET;
+dimen xadjust = 0;
+dimen yadjust = 0;
 int size = 0;
 int chcount = 0;
 int font = env->setfont;
 int startchptr = chptr;
 int endchptr;
-BOOL needSymbol = FALSE;
-BOOL needDingbats = FALSE;
 colour rgb = env->textcolour;
 uschar *s;
 stringchain *t;
 
-/* Scan for the end of the string, counting the number of bytes needed. We also
-check for special font requirements. */
+/* Scan for the end of the string, counting the number of bytes needed. */
 
 for (;;)
   {
@@ -793,28 +2083,6 @@ for (;;)
   /* LCOV_EXCL_STOP */
 
   chcount++;  /* Counts characters, not bytes */
-
-  /* See if this character is in the Symbol or Dingbats font */
-
-  if (c >= 384)
-    {
-    u2sencod *bot, *mid, *top;
-
-    bot = u2slist;
-    top = u2slist + u2scount;
-    while (top > bot)
-      {
-      mid = bot + (top - bot)/2;
-      if (c == mid->ucode) break;
-      if (mid->ucode < c ) bot = mid + 1; else top = mid;
-      }
-
-    if (top > bot)
-      {
-      if (mid->which == SF_SYMB) needSymbol = TRUE;
-        else needDingbats = TRUE;
-      }
-    }
   }
 
 /* Handle vector position adjustment */
@@ -841,28 +2109,29 @@ while (in_line[chptr] == '/')
   else if (isdigit(ch))
     {
     BOOL hasfraction;
+    dimen n;
     int k = chptr + 1;
 
     while (isdigit((int)in_line[k])) k++;
     hasfraction = in_line[k] == '.';
 
-    k = readnumber();
+    n = readnumber();
     if (!hasfraction && in_line[chptr] != ',')
       {
-      font = k/1000;
+      font = (int)(n/1000);
       }
 
     else  /* Read r,g,b */
       {
-      rgb.red = rgb.green = rgb.blue = k;
+      rgb.red = rgb.green = rgb.blue = (n > 1000)? 1001 : (int)n;
       if (in_line[chptr] == ',')
         {
         chptr++;
-        rgb.green = readnumber();
+        rgb.green = readcolour();
         if (in_line[chptr] == ',')
           {
           chptr++;
-          rgb.blue = readnumber();
+          rgb.blue = readcolour();
           }
         }
 
@@ -879,15 +2148,7 @@ while (in_line[chptr] == '/')
 if (font_base != NULL)
   {
   bindfont *b;
-  for (b = font_base; b != NULL; b = b->next)
-    {
-    if (font == b->number)
-      {
-      if (needSymbol) b->needSymbol = TRUE;
-      if (needDingbats) b->needDingbats = TRUE;
-      break;
-      }
-    }
+  for (b = font_base; b != NULL; b = b->next) if (font == b->number) break;
   if (b == NULL)
     {
     error_moan(4, font);
@@ -929,6 +2190,50 @@ return t;
 
 
 
+/*************************************************
+*       Note what a string needs for output      *
+*************************************************/
+
+/* The PostScript output contains only the encodings, font bindings, and
+procedures that the strings need, so for each string this records which parts
+of its font are used, and whether it is justified or rotated.
+
+Argument:  the string
+Returns:   nothing
+*/
+
+void
+note_string(stringchain *s)
+{
+bindfont *b;
+uschar *p = s->text;
+
+if (*p == 0) return;    /* Empty strings are not output */
+
+for (b = font_base; b != NULL; b = b->next) if (b->number == s->font) break;
+if (b == NULL) return;
+
+while (*p != 0)
+  {
+  int c, offset;
+  GETCHARINC(c, p);
+  (void)font_char(c, &offset);
+  switch (offset)
+    {
+    case 0: b->needLower = TRUE; break;
+    case 1: b->needUpper = TRUE; break;
+    case 2: b->needSymbol = TRUE; break;
+    case 3: b->needDingbats = TRUE; break;
+    }
+  }
+
+if (s->justify == just_centre) strings_centred = TRUE;
+  else if (s->justify == just_right) strings_right = TRUE;
+if (s->rotate != 0) strings_rotated = TRUE;
+}
+
+
+
 /*************************************************
 *          Read a chain of strings               *
 *************************************************/
@@ -946,7 +2251,7 @@ void
 readstringchain(item *p, int justify)
 {
 stringchain *s = NULL;
-int default_rotate = 0;
+dimen default_rotate = 0;
 
 while (in_line[chptr] == '\"')
   {
@@ -954,6 +2259,7 @@ while (in_line[chptr] == '\"')
   if (ss->rotate == UNSET) ss->rotate = default_rotate;
     else default_rotate = ss->rotate;
   ss->rrotate = (double)(ss->rotate * pi) / 180000.0;
+  note_string(ss);
   if (s == NULL) p->strings = ss; else s->next = ss;
   s = ss;
   }
@@ -979,47 +2285,42 @@ readjoin(BOOL position, BOOL moanifnone)
 {
 int dir = -1;
 
-readword();
-if (Ustrcmp(word, "") == 0)
+if (word_length() == 0)
   {
   error_moan(11, "word");
   dir = north;   /* Stops missing complaint */
   }
 
-else if (Ustrcmp(word, "top") == 0)
+else if (match_word("top"))
   {
   dir = north;
-  readword();
-  if (Ustrcmp(word, "right") == 0) dir = northeast;
-    else if (Ustrcmp(word, "left") == 0) dir = northwest;
-      else if (word[0]) wordread = TRUE;
+  if (match_word("right")) dir = northeast;
+    else if (match_word("left")) dir = northwest;
   }
 
-else if (Ustrcmp(word, "bottom") == 0)
+else if (match_word("bottom"))
   {
   dir = south;
-  readword();
-  if (Ustrcmp(word, "right") == 0) dir = southeast;
-    else if (Ustrcmp(word, "left") == 0) dir = southwest;
-      else if (word[0]) wordread = TRUE;
+  if (match_word("right")) dir = southeast;
+    else if (match_word("left")) dir = southwest;
   }
 
-else if (Ustrcmp(word, "left") == 0) dir = west;
-else if (Ustrcmp(word, "right") == 0) dir = east;
-else if (Ustrcmp(word, "centre") == 0 || Ustrcmp(word, "center") == 0)
-  dir = centre;
+else if (match_word("left")) dir = west;
+else if (match_word("right")) dir = east;
+else if (match_word("centre") || match_word("center")) dir = centre;
 else if (position)
   {
-  if (Ustrcmp(word, "start") == 0) dir = start;
-  else if (Ustrcmp(word, "end") == 0) dir = end;
-  else if (Ustrcmp(word, "middle") == 0) dir = middle;
+  if (match_word("start")) dir = start;
+  else if (match_word("end")) dir = end;
+  else if (match_word("middle")) dir = middle;
   }
 
-if (dir < 0)
+/* An unwanted word is left for the caller, unless it is an error. */
+
+if (dir < 0 && moanifnone)
   {
-  if (moanifnone)
-    error_moan(11, "top, bottom, left, right, centre, start, end, or middle");
-  else wordread = TRUE;
+  readword();
+  error_moan(11, "top, bottom, left, right, centre, start, end, or middle");
   }
 
 return dir;
@@ -1041,15 +2342,16 @@ Returns:         TRUE if a position was successfully read
 */
 
 static BOOL
-readposition(int *xx, int *yy)
+readposition(dimen *xx, dimen *yy)
 {
 item *relative = baseitem;
 item_box *rbox;
 item_curve *rcurve;
 item_line *rline;
 item_arc *rarc;
+item_poly *rpoly;
 
-int fraction = 0;
+dimen fraction = 0;
 int dir;
 
 *xx = *yy = 0;
@@ -1082,7 +2384,7 @@ set an absolute position). */
 
 if (dir < 0)
   {
-  readword();
+  readlabel();
   relative = findlabel(word);
   if (relative != NULL) baseitem = relative;
     else error_moan(11, "top, bottom, left, right, centre, start, end, middle, or label");
@@ -1091,14 +2393,12 @@ if (dir < 0)
 
 /* We have found a direction, expect optional "of <label>" */
 
-readword();
-if (Ustrcmp(word, "of") == 0)
+if (match_word("of"))
   {
-  readword();
+  readlabel();
   relative = findlabel(word);
   if (relative == NULL) { error_moan(10, word); return FALSE; }
   }
-else if (word[0]) wordread = TRUE;
 
 /* After "goto *", or if there have been no previous items, "relative" might be
 unset here, which is an error. */
@@ -1139,8 +2439,8 @@ switch (relative->type)
       double angle;
       if (dir == end) fraction = 1000 - fraction;
       angle = rarc->angle1 + (double)fraction * (rarc->angle2 - rarc->angle1) / 1000.0;
-      *xx = rarc->x + (int )(radius * cos(angle));
-      *yy = rarc->y + (int )(radius * sin(angle));
+      *xx = rarc->x + (dimen)(radius * cos(angle));
+      *yy = rarc->y + (dimen)(radius * sin(angle));
       fraction = 0;
       }
     else if (dir == start)
@@ -1210,80 +2510,80 @@ switch (relative->type)
     case north:
     *xx = rbox->x;
     *yy = rbox->y + rbox->depth/2;
-    if (fraction) *xx += ((fraction - 500)*rbox->width)/1000;
+    if (fraction) *xx += fixmul(fraction - 500, rbox->width);
     fraction = 0;
     break;
 
     case northeast:
-    if (rbox->boxtype == box_box)
+    if (rbox->boxtype == box_box || rbox->boxtype == box_place)
       {
       *xx = rbox->x + rbox->width/2;
       *yy = rbox->y + rbox->depth/2;
       }
     else
       {
-      *xx = rbox->x + (int )((double)((int )(rbox->width/2))*cos(0.25*pi));
-      *yy = rbox->y + (int )((double)((int )(rbox->depth/2))*sin(0.25*pi));
+      *xx = rbox->x + (dimen)((double)((dimen)(rbox->width/2))*cos(0.25*pi));
+      *yy = rbox->y + (dimen)((double)((dimen)(rbox->depth/2))*sin(0.25*pi));
       }
     break;
 
     case east:
     *xx = rbox->x + rbox->width/2;
     *yy = rbox->y;
-    if (fraction) *yy += ((fraction - 500)*rbox->depth)/1000;
+    if (fraction) *yy += fixmul(fraction - 500, rbox->depth);
     fraction = 0;
     break;
 
     case southeast:
-    if (rbox->boxtype == box_box)
+    if (rbox->boxtype == box_box || rbox->boxtype == box_place)
       {
       *xx = rbox->x + rbox->width/2;
       *yy = rbox->y - rbox->depth/2;
       }
     else
       {
-      *xx = rbox->x + (int )((double)((int )(rbox->width/2))*cos(-0.25*pi));
-      *yy = rbox->y + (int )((double)((int )(rbox->depth/2))*sin(-0.25*pi));
+      *xx = rbox->x + (dimen)((double)((dimen)(rbox->width/2))*cos(-0.25*pi));
+      *yy = rbox->y + (dimen)((double)((dimen)(rbox->depth/2))*sin(-0.25*pi));
       }
     break;
 
     case south:
     *xx = rbox->x;
     *yy = rbox->y - rbox->depth/2;
-    if (fraction) *xx += ((fraction - 500)*rbox->width)/1000;
+    if (fraction) *xx += fixmul(fraction - 500, rbox->width);
     fraction = 0;
     break;
 
     case southwest:
-    if (rbox->boxtype == box_box)
+    if (rbox->boxtype == box_box || rbox->boxtype == box_place)
       {
       *xx = rbox->x - rbox->width/2;
       *yy = rbox->y - rbox->depth/2;
       }
     else
       {
-      *xx = rbox->x + (int )((double)((int )(rbox->width/2))*cos(1.25*pi));
-      *yy = rbox->y + (int )((double)((int )(rbox->depth/2))*sin(1.25*pi));
+      *xx = rbox->x + (dimen)((double)((dimen)(rbox->width/2))*cos(1.25*pi));
+      *yy = rbox->y + (dimen)((double)((dimen)(rbox->depth/2))*sin(1.25*pi));
       }
     break;
 
     case west:
     *xx = rbox->x - rbox->width/2;
     *yy = rbox->y;
-    if (fraction) *yy += ((fraction - 500)*rbox->depth)/1000;
+    if (fraction) *yy += fixmul(fraction - 500, rbox->depth);
     fraction = 0;
     break;
 
     case northwest:
-    if (rbox->boxtype == box_box)
+    if (rbox->boxtype == box_box || rbox->boxtype == box_place)
       {
       *xx = rbox->x - rbox->width/2;
       *yy = rbox->y + rbox->depth/2;
       }
     else
       {
-      *xx = rbox->x + (int )((double)((int )(rbox->width/2))*cos(0.75*pi));
-      *yy = rbox->y + (int )((double)((int )(rbox->depth/2))*sin(0.75*pi));
+      *xx = rbox->x + (dimen)((double)((dimen)(rbox->width/2))*cos(0.75*pi));
+      *yy = rbox->y + (dimen)((double)((dimen)(rbox->depth/2))*sin(0.75*pi));
       }
     break;
 
@@ -1294,6 +2594,32 @@ switch (relative->type)
     }
   break;
 
+  case i_poly:
+  rpoly = (item_poly *)relative;
+  switch (dir)
+    {
+    case centre:
+    *xx = rpoly->x;
+    *yy = rpoly->y;
+    break;
+
+    case start:
+    *xx = rpoly->x0;
+    *yy = rpoly->y0;
+    break;
+
+    case end:
+    *xx = rpoly->x1;
+    *yy = rpoly->y1;
+    break;
+
+    default:
+    error_moan(13, rpoly->closed? "polygon" :
+      rpoly->smooth? "spline" : "polyline");
+    break;
+    }
+  break;
+
   case i_line:
   rline = (item_line *)relative;
   switch (dir)
@@ -1317,8 +2643,8 @@ switch (relative->type)
     *yy = rline->y;
     if (fraction )
       {
-      *xx += (fraction * rline->width)/1000;
-      *yy += (fraction * rline->depth)/1000;
+      *xx += fixmul(fraction, rline->width);
+      *yy += fixmul(fraction, rline->depth);
       fraction = 0;
       }
     break;
@@ -1328,8 +2654,8 @@ switch (relative->type)
     *yy = rline->y + rline->depth;
     if (fraction)
       {
-      *xx -= (fraction * rline->width)/1000;
-      *yy -= (fraction * rline->depth)/1000;
+      *xx -= fixmul(fraction, rline->width);
+      *yy -= fixmul(fraction, rline->depth);
       fraction = 0;
       }
     break;
@@ -1348,19 +2674,17 @@ if (fraction != 0) { error_moan(14); return FALSE; }
 
 /* Deal with vector offsets */
 
-readword();
-if (Ustrcmp(word, "plus") == 0)
+if (match_word("plus"))
   {
   if (in_line[chptr] == '(')
     {
-    int a, b;
+    dimen a, b;
     readvector(&a, &b);
     *xx += a;
     *yy += b;
     }
   else error_moan(11, "Parenthesized vector (x,y)");
   }
-else if (word[0]) wordread = TRUE;
 
 /* Indicate x and y set */
 
@@ -1369,202 +2693,323 @@ return TRUE;
 
 
 
+/*************************************************
+*          Build hash table for options          *
+*************************************************/
+
+/* Alternative spellings of option names. These match the changes that
+standardize_word() makes for command names. */
+
+static uschar *option_aliases[][2] = {
+  { US"color",    US"colour" },
+  { US"gray",     US"grey" },
+  { US"grayness", US"grey" },
+  { US"greyness", US"grey" }
+};
+
+#define option_aliases_count \
+  (sizeof(option_aliases)/sizeof(option_aliases[0]))
+
+/* The hash is FNV-1a with a seed and a final mix. The word need not be
+terminated, so that it can be hashed where it is in the input line.
+
+Arguments:
+  s          the word
+  n          its length
+  seed       the seed
+
+Returns:     the hash value
+*/
+
+static unsigned int
+option_hash(const uschar *s, int n, unsigned int seed)
+{
+unsigned int h = 2166136261u ^ seed;
+while (n-- > 0)
+  {
+  h ^= *s++;
+  h *= 16777619u;
+  }
+h ^= h >> 13;
+h *= 0x5bd1e995u;
+return h ^ (h >> 15);
+}
+
+/* Add an entry to an option hash table. A duplicate name is ignored, so that
+the first entry in the list wins, as it did when the list was searched.
+
+Arguments:
+  t          the table
+  name       the option name or alternative spelling
+  pp         the option
+
+Returns:     FALSE if there is a collision with a different name
+*/
+
+static BOOL
+add_arg_slot(arg_table *t, uschar *name, arg_item *pp)
+{
+arg_slot *slot = t->slots +
+  (option_hash(name, Ustrlen(name), t->seed) & t->mask);
+if (slot->name == NULL)
+  {
+  slot->name = name;
+  slot->item = pp;
+  return TRUE;
+  }
+return Ustrcmp(slot->name, name) == 0;
+}
+
+/* Called the first time an option table is used. The table has at least four
+times as many slots as names; seeds are tried until one is found that gives no
+collisions, so the hash is perfect and a lookup needs just one comparison. The
+alternative spellings are added for the options that are in the table.
+
+Argument:  the table
+Returns:   nothing
+*/
+
+static void
+build_arg_table(arg_table *t)
+{
+unsigned int count = option_aliases_count;
+unsigned int size = 4;
+arg_item *pp;
+
+for (pp = t->items; (pp->name)[0] != 0; pp++) count++;
+while (size < 4 * count) size <<= 1;
+
+t->slots = getstore(size * sizeof(arg_slot));
+t->mask = size - 1;
+
+for (t->seed = 0;; t->seed++)
+  {
+  BOOL ok = TRUE;
+  memset(t->slots, 0, size * sizeof(arg_slot));
+
+  for (pp = t->items; ok && (pp->name)[0] != 0; pp++)
+    {
+    ok = add_arg_slot(t, pp->name, pp);
+    for (size_t i = 0; ok && i < option_aliases_count; i++)
+      {
+      if (Ustrcmp(option_aliases[i][1], pp->name) == 0)
+        ok = add_arg_slot(t, option_aliases[i][0], pp);
+      }
+    }
+
+  if (ok) break;
+  }
+}
+
+
+
 /*************************************************
 *            Handle optional parameters          *
 *************************************************/
 
 /* This function reads things that are optional, depending on the item being
-read. The values are put into the item's block.
+read. The values are put into the item's block. Each option word is looked up
+where it lies in the input line; it is copied only for an error message.
 
 Arguments:
   p            the item block
-  table        the relevant optional items
+  table        the relevant table of optional items
 
 Returns:       nothing
 */
 
 void
-options(item *p, arg_item *table)
+options(item *p, arg_table *table)
 {
-wordread = FALSE;
+if (table->slots == NULL) build_arg_table(table);
 
 /* Loop for each options word */
 
-while (wordread || isalpha((int)in_line[chptr]))
+while (isalpha((int)in_line[chptr]))
   {
-  arg_item *pp = table;
-  readword();
-  standardize_word();   /* Allows for spelling variations */
+  arg_item *pp;
+  arg_slot *slot;
+  int arg1, arg2, type;
+  int n = word_length();
+
+  /* Look up the word, which may be an alternative spelling. For unknown
+  options, give a message and abandon the rest of this command. The error
+  function skips to semicolon or newline, but this gets to the end of a
+  multi-line coment. */
+
+  slot = table->slots +
+    (option_hash(in_line + chptr, n, table->seed) & table->mask);
+  if (slot->name == NULL || Ustrncmp(slot->name, in_line + chptr, n) != 0 ||
+      slot->name[n] != 0)
+    {
+    readword();
+    error_moan(7, word);
+    while (in_line[chptr] != ';' && !endfile) nextch();
+    continue;
+    }
 
-  /* Search the list for this command */
+  chptr += n;
+  nextsigch();
 
-  for (; (pp->name)[0] != 0; pp++)
-    {
-    if (Ustrcmp(wordstd, pp->name) == 0)  /* Compare standardized word */
-      {
-      /* Found the word; switch on its type */
+  /* Found the word; switch on its type */
 
-      int arg1 = pp->arg1;
-      int arg2 = pp->arg2;
-      int type = pp->type;
+  pp = slot->item;
+  arg1 = pp->arg1;
+  arg2 = pp->arg2;
+  type = pp->type;
 
-      switch(type)
-        {
-        case opt_bool:     /* Boolean, no data. Set and/or unset flags */
-	if (arg1 >= 0) *(int *)(((uschar *)p) + arg1) = TRUE;
-	if (arg2 >= 0) *(int *)(((uschar *)p) + arg2) = FALSE;
-        break;
+  switch(type)
+    {
+    case opt_bool:     /* Boolean, no data. Set and/or unset flags */
+    if (arg1 >= 0) *(int *)(((uschar *)p) + arg1) = TRUE;
+    if (arg2 >= 0) *(int *)(((uschar *)p) + arg2) = FALSE;
+    break;
 
-        case opt_xline:    /* x or y distances for lines and arrows */
-        case opt_xnline:   /* set first arg +/-; zero second arg if unset */
-        case opt_yline:
-        case opt_ynline:
-          {
-	  int value = (type == opt_xline || type == opt_xnline)? env->line_hw : env->line_vd;
-	  int sign = (type == opt_xnline || type == opt_ynline)? (-1) : (+1);
-          if (isdigit((int)in_line[chptr])) value = mag(readnumber());
-	  if (arg1 >= 0) *(int *)(((uschar *)p) + arg1) = value * sign;
-	  if (arg2 >= 0 && (*(int *)(((uschar *)p + arg2)) == UNSET))
-	    *(int *)(((uschar *)p) + arg2) = 0;
-          }
-        break;
+    case opt_dash:     /* No data; the dash length is filled in later */
+    *(dimen *)(((uschar *)p) + arg1) = TRUE;
+    break;
 
-        case opt_dim:      /* single dimension, magnified */
-	if (!isdigit((int)in_line[chptr])) error_moan(8); else *(int *)(((uschar *)p) + arg1) =
-          mag(readnumber());
-        break;
+    case opt_xline:    /* x or y distances for lines and arrows */
+    case opt_xnline:   /* set first arg +/-; zero second arg if unset */
+    case opt_yline:
+    case opt_ynline:
+      {
+      dimen value = (type == opt_xline || type == opt_xnline)? env->line_hw : env->line_vd;
+      int sign = (type == opt_xnline || type == opt_ynline)? (-1) : (+1);
+      if (isnumstart(in_line[chptr])) value = mag(readnumber());
+      if (arg1 >= 0) *(dimen *)(((uschar *)p) + arg1) = value * sign;
+      if (arg2 >= 0 && (*(dimen *)(((uschar *)p + arg2)) == UNSET))
+        *(dimen *)(((uschar *)p) + arg2) = 0;
+      }
+    break;
 
-        case opt_angle:    /* single angle -- don't magnify! */
-	if (!isdigit((int)in_line[chptr])) error_moan(11, "unsigned angle");
-          else *(int *)(((uschar *)p) + arg1) = readnumber();
-        break;
+    case opt_dim:      /* single dimension, magnified */
+    if (!isnumstart(in_line[chptr])) error_moan(8); else *(dimen *)(((uschar *)p) + arg1) =
+      mag(readnumber());
+    break;
 
-        case opt_grey:     /* grey level -- don't magnify! */
-	if (!isdigit((int)in_line[chptr])) error_moan(11, "grey level");
-          else
-            {
-            colour *c = (colour *)(((uschar *)p) + arg1);
-            c->red = c->green = c->blue = readnumber();
-            }
-        break;
+    case opt_angle:    /* single angle -- don't magnify! */
+    if (!isnumstart(in_line[chptr])) error_moan(11, "unsigned angle");
+      else *(dimen *)(((uschar *)p) + arg1) = readnumber();
+    break;
 
-        case opt_colour:   /* colour rgb -- don't magnify! */
+    case opt_grey:     /* grey level -- don't magnify! */
+    if (!isnumstart(in_line[chptr])) error_moan(11, "grey level");
+      else
+        {
+        colour *c = (colour *)(((uschar *)p) + arg1);
+        c->red = c->green = c->blue = readcolour();
+        }
+    break;
+
+    case opt_colour:   /* colour rgb -- don't magnify! */
+      {
+      colour *c = (colour *)(((uschar *)p) + arg1);
+      if (!isnumstart(in_line[chptr]) && in_line[chptr] != '-')
+        error_moan(11, "colour values");
+      else
+        {
+        c->red = readcolour();
+        if ((int)in_line[chptr] == ',')
           {
-          colour *c = (colour *)(((uschar *)p) + arg1);
-          if (!isdigit((int)in_line[chptr]) && in_line[chptr] != '-')
-            error_moan(11, "colour values");
-          else
-            {
-            c->red = readnumber();
-            if ((int)in_line[chptr] == ',')
-              {
-              chptr++;
-              while (isspace((int)in_line[chptr])) chptr++;
-              }
-            if (!isdigit((int)in_line[chptr]))
-              error_moan(11, "green and blue values");
-            else
-              {
-              c->green = readnumber();
-              if ((int)in_line[chptr] == ',')
-                {
-                chptr++;
-                while (isspace((int)in_line[chptr])) chptr++;
-                }
-              if (!isdigit((int)in_line[chptr]))
-                error_moan(11, "blue value");
-              else c->blue = readnumber();
-              }
-
-            if (c->red > 1000 || c->green > 1000 || c->blue > 1000)
-              error_moan(20);
-            }
+          chptr++;
+          while (isspace((int)in_line[chptr])) chptr++;
           }
-        break;
-
-        case opt_colgrey:   /* colour rgb or grey level -- don't magnify! */
+        if (!isnumstart(in_line[chptr]))
+          error_moan(11, "green and blue values");
+        else
           {
-          colour *c = (colour *)(((uschar *)p) + arg1);
-          if (!isdigit((int)in_line[chptr]) && in_line[chptr] != '-')
-            error_moan(11, "grey level or colour values");
-          else
+          c->green = readcolour();
+          if ((int)in_line[chptr] == ',')
             {
-            c->red = c->green = c->blue = readnumber();
-
-            if (in_line[chptr] == ',') chptr++;
+            chptr++;
             while (isspace((int)in_line[chptr])) chptr++;
-            if (isdigit((int)in_line[chptr]))
-              {
-              c->green = readnumber();
-              if (in_line[chptr] == ',') chptr++;
-              while (isspace((int)in_line[chptr])) chptr++;
-
-              if (!isdigit((int)in_line[chptr]))
-                error_moan(11, "blue value");
-              else c->blue = readnumber();
-              }
-
-            if (c->red > 1000 || c->green > 1000 || c->blue > 1000)
-              error_moan(20);
             }
+          if (!isnumstart(in_line[chptr]))
+            error_moan(11, "blue value");
+          else c->blue = readcolour();
           }
-        break;
 
-        case opt_int:      /* integer, +ve or -ve */
-        if (!isdigit((int)in_line[chptr]) && in_line[chptr] != '-')
-          error_moan(11, "integer");
-        else *(int *)(((uschar *)p) + arg1) = readint();
-        break;
+        if (c->red > 1000 || c->green > 1000 || c->blue > 1000)
+          error_moan(20);
+        }
+      }
+    break;
+
+    case opt_colgrey:   /* colour rgb or grey level -- don't magnify! */
+      {
+      colour *c = (colour *)(((uschar *)p) + arg1);
+      if (!isnumstart(in_line[chptr]) && in_line[chptr] != '-')
+        error_moan(11, "grey level or colour values");
+      else
+        {
+        c->red = c->green = c->blue = readcolour();
 
-        case opt_at:       /* absolute position */
+        if (in_line[chptr] == ',') chptr++;
+        while (isspace((int)in_line[chptr])) chptr++;
+        if (isnumstart(in_line[chptr]))
           {
-	  int x, y;
-          if (readposition(&x, &y))
-            {
-	    *(int *)(((uschar *)p) + arg1) = x;
-	    *(int *)(((uschar *)p) + arg2) = y;
-            }
+          c->green = readcolour();
+          if (in_line[chptr] == ',') chptr++;
+          while (isspace((int)in_line[chptr])) chptr++;
+
+          if (!isnumstart(in_line[chptr]))
+            error_moan(11, "blue value");
+          else c->blue = readcolour();
           }
-        break;
 
-        case opt_dir:     /* direction, given by table value */
-	*(int *)(((uschar *)p) + arg1) = (int)arg2;
-        break;
+        if (c->red > 1000 || c->green > 1000 || c->blue > 1000)
+          error_moan(20);
+        }
+      }
+    break;
+
+    case opt_number:   /* number, +ve or -ve -- don't magnify! */
+    if (!isnumstart(in_line[chptr]) && in_line[chptr] != '-')
+      error_moan(11, "number");
+    else *(dimen *)(((uschar *)p) + arg1) = readnumber();
+    break;
+
+    case opt_int:      /* integer, +ve or -ve */
+    if (!isnumstart(in_line[chptr]) && in_line[chptr] != '-')
+      error_moan(11, "integer");
+    else *(int *)(((uschar *)p) + arg1) = readint();
+    break;
+
+    case opt_at:       /* absolute position */
+      {
+      dimen x, y;
+      if (readposition(&x, &y))
+        {
+        *(dimen *)(((uschar *)p) + arg1) = x;
+        *(dimen *)(((uschar *)p) + arg2) = y;
+        }
+      }
+    break;
 
-	case opt_join:	  /* position specified by joining point */
+    case opt_dir:     /* direction, given by table value */
+    *(int *)(((uschar *)p) + arg1) = (int)arg2;
+    break;
+
+    case opt_join:    /* position specified by joining point */
+      {
+      int newpoint = readjoin(FALSE, TRUE);
+      if (newpoint >= 0)
+        {
+        *(int *)(((uschar *)p) + arg1) = newpoint;
+        if (match_word("to"))
           {
-	  int newpoint = readjoin(FALSE, TRUE);
-          if (newpoint >= 0)
-            {
-	    *(int *)(((uschar *)p) + arg1) = newpoint;
-            readword();
-            if (Ustrcmp(word, "to") == 0)
-              {
-              /* This yields FALSE if it just changes the base item */
-              if (readposition(&joined_xx, &joined_yy))
-                *(int *)(((uschar *)p) + arg2) = TRUE;
-              }
-            else if (word[0]) wordread = TRUE;
-            if (baseitem == NULL) error_moan(22);
-            }
+          /* This yields FALSE if it just changes the base item */
+          if (readposition(&joined_xx, &joined_yy))
+            *(int *)(((uschar *)p) + arg2) = TRUE;
           }
-        break;
+        if (baseitem == NULL) error_moan(22);
         }
-
-      nextsigch();
-      break;
       }
+    break;
     }
 
-  /* For unknown options, give a message and abandon the rest of this command.
-  The error function skips to semicolon or newline, but this gets to the end of
-  a multi-line coment. */
-
-  if ((pp->name)[0] == 0)
-    {
-    error_moan(7, word);
-    while (in_line[chptr] != ';' && !endfile) nextch();
-    }
+  nextsigch();
   }
 }
 
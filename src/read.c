@@ -28,8 +28,10 @@ static arg_item text_args[] = {
   { US"", 0, -1, -1 }
 };
 
+static arg_table text_table = { text_args, NULL, 0, 0 };
+
 static arg_item drawbbox_args[] = {
-  { US"dashed",      opt_bool, oo(item_box, dash1),                       -1 },
+  { US"dashed",      opt_dash, oo(item_box, dash1),                       -1 },
   { US"filled",      opt_colgrey, oo(item_box, shapefilled),              -1 },
   { US"thickness",   opt_dim,  oo(item_box, thickness),                   -1 },
   { US"colour",      opt_colour, oo(item_box, colour),                    -1 },
@@ -37,6 +39,8 @@ static arg_item drawbbox_args[] = {
   { US"", 0, -1, -1 }
 };
 
+static arg_table drawbbox_table = { drawbbox_args, NULL, 0, 0 };
+
 
 
 /*************************************************
@@ -50,11 +54,13 @@ item *lastitem;               /* last on list of items read */
 item *baseitem;               /* item to base next item on */
 item_box *drawbbox = NULL;    /* bounding box parameters */
 
-label *label_base;            /* base of list of labels */
+group *group_base = NULL;     /* chain of defined groups */
+
+tree_node *label_root;        /* tree of labels */
 label *nextlabel;             /* points to labels when command is read */
 
 int chptr = 0;                /* offset in current input line */
-int drawbboxoffset;           /* offset for drawn bounding box frame */
+dimen drawbboxoffset;         /* offset for drawn bounding box frame */
 int item_arg1;                /* First arg for some items */
 int item_arg2;                /* Second ditto */
 
@@ -66,6 +72,12 @@ uschar wordstd[WORD_SIZE];    /* copy with standardized spelling */
 uschar *in_line;              /* line currently being processed */
 uschar *in_prev;              /* previous linput line */
 uschar *in_raw;               /* raw line, before variable substitution */
+int     in_raw_length;        /* length of raw line */
+int     unsubstituted = -1;   /* offset of raw loop body text in in_line */
+
+BOOL capturing_loop = FALSE;  /* TRUE while reading a loop body */
+BOOL defining_macro = FALSE;  /* TRUE while reading a macro body */
+loop *pending_loop = NULL;    /* loop to start when its command is complete */
 
 
 
@@ -77,7 +89,8 @@ static void
 c_bindfont(void)
 {
 bindfont *f;
-int number, size;
+int number;
+dimen size;
 int n = 0;
 uschar s[1024];
 
@@ -110,6 +123,7 @@ f->next = font_base;
 font_base = f;
 f->number = number;
 f->size = size;
+f->needLower = f->needUpper = FALSE;
 f->needSymbol = f->needDingbats = FALSE;
 Ustrcpy(f->name, s);
 }
@@ -123,7 +137,7 @@ Ustrcpy(f->name, s);
 static void
 c_include(void)
 {
-FILE *nf;
+input_file *nf;
 includestr *s;
 uschar *t = word;
 BOOL isinmac = macactive != NULL;
@@ -148,7 +162,7 @@ include because afterwards carries on with this line. */
 
 if (in_line[chptr] != ';') error_moan(3);
 
-nf = fopen(CS word, "r");
+nf = input_open(word);
 if (nf == NULL)
   {
   error_moan(1, word, "input", strerror(errno));
@@ -163,6 +177,8 @@ if (spare_included == NULL) s = getstore(sizeof(includestr)); else
 
 s->prev = included_from;
 s->prevfile = main_input;
+s->prevunsubstituted = unsubstituted;
+s->prevcond = cond_depth;
 included_from = s;
 
 file_line_stack[inc_stack_ptr] = in_line;
@@ -173,6 +189,8 @@ in_line[0] = ';';
 in_line[1] = '\n';
 in_line[2] = 0;
 chptr = 0;
+unsubstituted = -1;
+lex_line();
 
 main_input = nf;
 }
@@ -180,19 +198,38 @@ main_input = nf;
 
 
 /*************************************************
-*               The SET command                  *
+*          The SET and LOCAL commands            *
 *************************************************/
 
+/* The "set" command changes a local variable if there is one with the given
+name; otherwise it sets a global variable. The "local" command (item_arg1 is
+TRUE) creates a variable that belongs to the innermost active macro, or to the
+current row of a "data" command that is obeying a macro. It is discarded when
+the macro finishes. */
+
 static void
 c_set(void)
 {
 tree_node *tn;
+macro *m = NULL;
 int n = 0;
 uschar s[1024];
 
 readword();
 if (word[0] == 0) { error_moan(17); return; }
 
+if (item_arg1)
+  {
+  for (m = macactive; m != NULL; m = m->previous)
+    if (m->name[0] != 0 || m->loop->data != NULL) break;
+  if (m == NULL) { error_moan(66); return; }
+  if (Ustrlen(word) >= LOCAL_NAMESIZE)
+    {
+    error_moan(67, LOCAL_NAMESIZE - 1);
+    return;
+    }
+  }
+
 nextsigch();
 if (in_line[chptr] != '"') { error_moan(11, "quoted string"); return; }
 
@@ -210,6 +247,24 @@ for (;;)
 s[n] = 0;
 nextsigch();
 
+/* A local's value is always copied into its own block, which is big enough
+for any string on an input line. */
+
+if (m != NULL)
+  {
+  for (tn = m->locals; tn != NULL; tn = tn->left)
+    if (Ustrcmp(tn->name, word) == 0) break;
+  if (tn == NULL) tn = getlocal(m, word);
+  }
+else tn = find_local(word);
+
+if (tn != NULL)
+  {
+  tn->value = LOCAL_VALUE(tn);
+  Ustrcpy(tn->value, s);
+  return;
+  }
+
 tn = tree_search(varroot, word);
 
 if (tn == NULL)
@@ -249,16 +304,13 @@ text->next = NULL;
 text->strings = NULL;
 text->level = env->level;
 
-if (text->level > max_level) max_level = text->level;
-if (text->level < min_level) min_level = text->level;
-
 /* Mark various values as "unset" */
 
 text->x = text->y = UNSET;
 
 /* Read optional parameters */
 
-options((item *)text, text_args);
+options((item *)text, &text_table);
 
 /* Set up default position if required. Both coordinates will have been set by
 any positioning option, so we only need to test one. */
@@ -296,6 +348,11 @@ if (text->x == UNSET)
     text->y = lastbox->y;
     break;
 
+    case i_poly:
+    text->x = baseitem->x;
+    text->y = baseitem->y;
+    break;
+
     case i_line:
     lastline = (item_line *)baseitem;
     text->x = lastline->x + lastline->width/2;
@@ -368,7 +425,7 @@ drawbbox->shapefilled = unfilled;
 drawbbox->strings = NULL;
 
 nextsigch();
-options((item *)drawbbox, drawbbox_args);
+options((item *)drawbbox, &drawbbox_table);
 if (drawbbox->dash1 != 0)
   {
   drawbbox->dash1 = env->boxdash1;
@@ -385,18 +442,18 @@ if (drawbbox->dash1 != 0)
 static void
 c_env(void)
 {
-int value = readnumber();
+dimen value = readnumber();
 if (item_arg2) value = mag(value);
-*((int *)(((uschar *)env) + item_arg1)) = value;
+*((dimen *)(((uschar *)env) + item_arg1)) = value;
 }
 
 static void
 c_env2(void)
 {
-*((int *)(((uschar *)env) + item_arg1)) = readnumber();
+*((dimen *)(((uschar *)env) + item_arg1)) = readnumber();
 if (in_line[chptr] == ',') chptr++;
 nextsigch();
-*((int *)(((uschar *)env) + item_arg2)) = readnumber();
+*((dimen *)(((uschar *)env) + item_arg2)) = readnumber();
 }
 
 static void
@@ -411,7 +468,7 @@ static void
 c_env4(void)
 {
 colour *c = (colour *)(((uschar *)env) + item_arg1);
-c->red = c->green = c->blue = readnumber();
+c->red = c->green = c->blue = readcolour();
 }
 
 /* Colour */
@@ -420,13 +477,13 @@ static void
 c_env5(void)
 {
 colour *c = (colour *)(((uschar *)env) + item_arg1);
-c->red = readnumber();
+c->red = readcolour();
 if (in_line[chptr] == ',') chptr++;
 nextsigch();
-c->green = readnumber();
+c->green = readcolour();
 if (in_line[chptr] == ',') chptr++;
 nextsigch();
-c->blue = readnumber();
+c->blue = readcolour();
 }
 
 /* Grey level or colour; -1 means "not filled" for filling values. */
@@ -435,14 +492,14 @@ static void
 c_env6(void)
 {
 colour *c = (colour *)(((uschar *)env) + item_arg1);
-c->red = c->green = c->blue = readnumber();
+c->red = c->green = c->blue = readcolour();
 if (in_line[chptr] == ',') chptr++;
 while (isspace((int)in_line[chptr])) chptr++;
-if (!isdigit((int)in_line[chptr])) return;
-c->green = readnumber();
+if (!isnumstart(in_line[chptr])) return;
+c->green = readcolour();
 if (in_line[chptr] == ',') chptr++;
 while (isspace((int)in_line[chptr])) chptr++;
-c->blue = readnumber();
+c->blue = readcolour();
 }
 
 
@@ -466,31 +523,31 @@ resolution = readnumber();
 static void
 c_mag(void)
 {
-int newmag = readnumber();
-env->arcradius = (newmag * env->arcradius)/1000;
-env->arrow_x = (newmag * env->arrow_x)/1000;
-env->arrow_y = (newmag * env->arrow_y)/1000;
-env->boxwidth = (newmag * env->boxwidth)/1000;
-env->boxdash1 = (newmag * env->boxdash1)/1000;
-env->boxdash2 = (newmag * env->boxdash2)/1000;
-env->boxdepth = (newmag * env->boxdepth)/1000;
-env->boxthickness = (newmag * env->boxthickness)/1000;
-env->cirdash1 = (newmag * env->cirdash1)/1000;
-env->cirdash2 = (newmag * env->cirdash2)/1000;
-env->cirradius = (newmag * env->cirradius)/1000;
-env->cirthickness = (newmag * env->cirthickness)/1000;
-env->ellwidth = (newmag * env->ellwidth)/1000;
-env->elldash1 = (newmag * env->elldash1)/1000;
-env->elldash2 = (newmag * env->elldash2)/1000;
-env->elldepth = (newmag * env->elldepth)/1000;
-env->ellthickness = (newmag * env->ellthickness)/1000;
-env->linedash1 = (newmag * env->linedash1)/1000;
-env->linedash2 = (newmag * env->linedash2)/1000;
-env->linedepth = (newmag * env->linedepth)/1000;
-env->linethickness = (newmag * env->linethickness)/1000;
-env->line_hw = (newmag * env->line_hw)/1000;
-env->line_vd = (newmag * env->line_vd)/1000;
-env->magnification = (newmag * env->magnification)/1000;
+dimen newmag = readnumber();
+env->arcradius = fixmul(newmag, env->arcradius);
+env->arrow_x = fixmul(newmag, env->arrow_x);
+env->arrow_y = fixmul(newmag, env->arrow_y);
+env->boxwidth = fixmul(newmag, env->boxwidth);
+env->boxdash1 = fixmul(newmag, env->boxdash1);
+env->boxdash2 = fixmul(newmag, env->boxdash2);
+env->boxdepth = fixmul(newmag, env->boxdepth);
+env->boxthickness = fixmul(newmag, env->boxthickness);
+env->cirdash1 = fixmul(newmag, env->cirdash1);
+env->cirdash2 = fixmul(newmag, env->cirdash2);
+env->cirradius = fixmul(newmag, env->cirradius);
+env->cirthickness = fixmul(newmag, env->cirthickness);
+env->ellwidth = fixmul(newmag, env->ellwidth);
+env->elldash1 = fixmul(newmag, env->elldash1);
+env->elldash2 = fixmul(newmag, env->elldash2);
+env->elldepth = fixmul(newmag, env->elldepth);
+env->ellthickness = fixmul(newmag, env->ellthickness);
+env->linedash1 = fixmul(newmag, env->linedash1);
+env->linedash2 = fixmul(newmag, env->linedash2);
+env->linedepth = fixmul(newmag, env->linedepth);
+env->linethickness = fixmul(newmag, env->linethickness);
+env->line_hw = fixmul(newmag, env->line_hw);
+env->line_vd = fixmul(newmag, env->line_vd);
+env->magnification = fixmul(newmag, env->magnification);
 }
 
 
@@ -511,7 +568,7 @@ if (in_line[chptr] == '*')
 else
   {
   item *ii;
-  readword();
+  readlabel();
   ii = findlabel(word);
   if (ii == NULL) error_moan(10, word);
   baseitem = ii;
@@ -524,20 +581,27 @@ else
 *                   The MACRO command            *
 *************************************************/
 
-/* Local subroutine to search for end of macro text.
+/* Local subroutine to search for end of macro text. When the text is in braces,
+nested braces (for example, round a loop body) are skipped.
 
 Arguments:
   ptr         current input pointer
   term        terminating character
+  depth       points to the current brace nesting depth
 
 Returns:      the end pointer
 */
 
 static int
-find_mac_end(int ptr, uschar term)
+find_mac_end(int ptr, uschar term, int *depth)
 {
-while (in_line[ptr] != term && in_line[ptr] != 0)
+while ((in_line[ptr] != term || *depth > 0) && in_line[ptr] != 0)
   {
+  if (term == '}')
+    {
+    if (in_line[ptr] == '{') (*depth)++;
+      else if (in_line[ptr] == '}') (*depth)--;
+    }
   if (in_line[++ptr] == '\"')
     {
     while (in_line[++ptr] != '\"' && in_line[ptr] != 0) {};
@@ -581,11 +645,14 @@ static void
 c_macro(void)
 {
 uschar term = ';';
+int depth = 0;
 macro *m = getstore(sizeof(macro));
 mac_line **ptrnext = &(m->nextline);
 
 m->nextline = NULL;
 m->argcount = 0;
+m->loop = NULL;
+m->locals = NULL;
 readword();
 Ustrcpy(m->name, word);
 
@@ -594,10 +661,11 @@ if (in_line[chptr] == '{') { term = '}'; chptr++; }
 for (;;)
   {
   int n;
-  int length = find_mac_end(chptr, term) - chptr;
+  int length = find_mac_end(chptr, term, &depth) - chptr;
   mac_line *line = getstore(length + 2 + offsetof(mac_line, text));
   *ptrnext = line;
   line->next = NULL;
+  line->inner = NULL;
   ptrnext = &(line->next);
   Ustrncpy(line->text, in_line+chptr, length);
   line->text[length] = 0;
@@ -616,7 +684,9 @@ for (;;)
   else
     {
     chptr--;       /* just before final 0 */
+    defining_macro = TRUE;
     nextch();
+    defining_macro = FALSE;
     if (endfile)
       {
       chptr = 0;   /* Make it reflect previous line */
@@ -634,6 +704,526 @@ macroot = m;
 
 
 
+/*************************************************
+*              The REPEAT and FOR commands       *
+*************************************************/
+
+/* Local subroutine to read the body of a loop, which follows an opening brace
+that has already been passed. The lines of the body are saved as they are read,
+without variable substitution, in the same way as the lines of a macro. Quoted
+strings, comments, and nested braces are skipped. The text that follows the
+closing brace is left unsubstituted until reading reaches it, after the loop
+has been obeyed. Afterwards, chptr is left at the next significant character.
+
+Arguments:
+  lp         the loop block, or NULL if the body is just to be skipped
+  ib         if not NULL, where to record the position of the closing brace
+
+Returns:     nothing
+*/
+
+static void
+read_loop_body(loop *lp, inner_body *ib)
+{
+int depth = 0;
+int ptr = chptr;
+BOOL newline = FALSE;
+mac_line **ptrnext = (lp == NULL)? NULL : &(lp->body);
+
+capturing_loop = TRUE;
+
+for (;;)
+  {
+  int c = in_line[ptr];
+
+  if (c == 0 || (c == '}' && depth == 0))
+    {
+    if (lp != NULL)
+      {
+      int length = ptr - chptr;
+      mac_line *line = get_loop_line();
+      *ptrnext = line;
+      line->next = NULL;
+      line->inner = NULL;
+      ptrnext = &(line->next);
+      Ustrncpy(line->text, in_line+chptr, length);
+      line->text[length] = 0;
+      if (c != 0)
+        {
+        line->text[length] = ' ';
+        line->text[length+1] = 0;
+        }
+      }
+    chptr = ptr;
+    if (c != 0) break;
+
+    chptr--;         /* just before final 0 */
+    nextch();
+    newline = TRUE;
+    if (endfile)
+      {
+      capturing_loop = FALSE;
+      chptr = 0;     /* Make it reflect previous line */
+      error_moan(44);
+      exit(EXIT_FAILURE);
+      }
+    ptr = chptr;
+    continue;
+    }
+
+  switch (c)
+    {
+    case '\"':
+    while (in_line[++ptr] != '\"' && in_line[ptr] != '\n' &&
+      in_line[ptr] != 0) {};
+    if (in_line[ptr] != '\"') ptr--;
+    break;
+
+    case '$':
+    if (in_line[ptr+1] == '$') ptr++;
+    else if (in_line[ptr+1] == '{')
+      {
+      while (in_line[ptr+1] != '}' && in_line[ptr+1] != 0) ptr++;
+      if (in_line[ptr+1] == '}') ptr++;
+      }
+    break;
+
+    case '#':
+    while (in_line[ptr+1] != '\n' && in_line[ptr+1] != 0) ptr++;
+    break;
+
+    case '{':
+    depth++;
+    break;
+
+    case '}':
+    depth--;
+    break;
+    }
+
+  ptr++;
+  }
+
+capturing_loop = FALSE;
+chptr++;
+if (ib != NULL)
+  {
+  ib->endline = (newline && macactive != NULL)? macactive->thisline : NULL;
+  ib->end = chptr;
+  }
+if (unsubstituted >= 0) unsubstituted = chptr;
+nextsigch();
+}
+
+
+/* Local subroutine to find the offset of the current position in the line of
+a loop body that is being obeyed. This is possible only when the rest of
+in_line is the same as the end of that line, which it is unless substitution
+has changed it.
+
+Arguments:   none
+Returns:     the offset in the line's text, or -1
+*/
+
+static int
+body_offset(void)
+{
+macro *m = macactive;
+int offset;
+
+if (m == NULL || m->loop == NULL || m->loop->data != NULL ||
+    m->thisline == NULL) return -1;
+offset = (int)(Ustrlen(m->thisline->text) - Ustrlen(in_line + chptr));
+if (offset < 0 || Ustrcmp(m->thisline->text + offset, in_line + chptr) != 0)
+  return -1;
+return offset;
+}
+
+
+/* Local subroutine to pass over a loop body that was kept when it was first
+read, leaving everything as read_loop_body() would.
+
+Argument:    the kept body
+Returns:     nothing
+*/
+
+static void
+skip_kept_body(inner_body *ib)
+{
+if (ib->endline == NULL) chptr += ib->end - ib->start; else
+  {
+  macactive->nextline = ib->endline->next;
+  macactive->thisline = ib->endline;
+  Ustrcpy(in_prev, in_line);
+  Ustrcpy(in_line, ib->endline->text);
+  chptr = ib->end;
+  unsubstituted = 0;
+  lex_line();
+  }
+if (unsubstituted >= 0) unsubstituted = chptr;
+nextsigch();
+}
+
+
+/* Local subroutine to check for the opening brace and read the body. If all
+is well, the loop is set up to start when the command has been completely
+processed; otherwise the loop block is given up. When the loop is inside the
+body of another loop, its body is kept by the line in which it starts the first
+time it is read, and afterwards it is re-used instead of being read again.
+
+Argument:    the loop block
+Returns:     nothing
+*/
+
+static void
+loop_body(loop *lp)
+{
+macro *m = macactive;
+mac_line *line = NULL;
+inner_body *ib = NULL;
+inner_body kept;
+int start;
+
+if (in_line[chptr] != '{')
+  {
+  error_moan(11, "\"{\"");
+  end_loop(lp);
+  return;
+  }
+chptr++;
+start = body_offset();
+
+/* Use a kept body if there is one. */
+
+if (start >= 0)
+  {
+  line = m->thisline;
+  for (ib = line->inner; ib != NULL; ib = ib->next)
+    if (ib->start == start) break;
+  }
+
+if (ib != NULL)
+  {
+  lp->body = ib->body;
+  lp->keepbody = TRUE;
+  skip_kept_body(ib);
+  }
+
+/* Otherwise read the body, and keep it if it is in another loop's body. */
+
+else if (start < 0) read_loop_body(lp, NULL); else
+  {
+  int startptr = chptr;
+  read_loop_body(lp, &kept);
+  if (macactive == m)
+    {
+    ib = get_inner_body();
+    ib->next = line->inner;
+    line->inner = ib;
+    ib->start = start;
+    ib->body = lp->body;
+    ib->endline = kept.endline;
+    ib->end = (kept.endline == NULL)? start + kept.end - startptr : kept.end;
+    lp->keepbody = TRUE;
+    }
+  }
+
+pending_loop = lp;
+}
+
+
+/* Local subroutine to skip the body of a loop after an error in its
+arguments. Error recovery will have moved chptr on, so the position of the
+opening brace must be found first; -1 means there isn't one.
+
+Argument:    the offset of the opening brace, or -1
+Returns:     nothing
+*/
+
+static void
+skip_loop_body(int brace)
+{
+if (brace < 0) return;
+chptr = brace + 1;
+read_loop_body(NULL, NULL);
+}
+
+
+/* Local subroutine to find the opening brace before the arguments are read.
+
+Arguments:   none
+Returns:     the offset of the brace, or -1
+*/
+
+static int
+find_loop_brace(void)
+{
+int ptr = chptr;
+while (in_line[ptr] != '{' && in_line[ptr] != ';' && in_line[ptr] != 0) ptr++;
+return (in_line[ptr] == '{')? ptr : -1;
+}
+
+
+/* Main routine for REPEAT */
+
+static void
+c_repeat(void)
+{
+loop *lp = getloop();
+
+lp->body = NULL;
+lp->keepbody = FALSE;
+lp->var = NULL;
+lp->data = NULL;
+lp->args = NULL;
+lp->count = readint();
+lp->value = lp->step = 0;
+loop_body(lp);
+}
+
+
+/* Main routine for FOR. The number of iterations is computed at the start, so
+that accumulated rounding cannot affect it. */
+
+static void
+c_for(void)
+{
+loop *lp;
+tree_node *tn;
+BOOL localvar;
+dimen from, to;
+int brace = find_loop_brace();
+dimen count;
+
+readword();
+if (word[0] == 0)
+  {
+  error_moan(17);
+  skip_loop_body(brace);
+  return;
+  }
+
+tn = find_local(word);
+localvar = tn != NULL;
+if (tn == NULL) tn = tree_search(varroot, word);
+if (tn == NULL)
+  {
+  tn = getstore(sizeof(tree_node) + Ustrlen(word));
+  Ustrcpy(tn->name, word);
+  tn->value = US"";
+  (void)tree_insertnode(&varroot, tn);
+  }
+
+readword();
+if (Ustrcmp(word, "from") != 0)
+  {
+  error_moan(11, "\"from\"");
+  skip_loop_body(brace);
+  return;
+  }
+from = readnumber();
+nextsigch();
+
+readword();
+if (Ustrcmp(word, "to") != 0)
+  {
+  error_moan(11, "\"to\"");
+  skip_loop_body(brace);
+  return;
+  }
+to = readnumber();
+nextsigch();
+
+lp = getloop();
+lp->body = NULL;
+lp->keepbody = FALSE;
+lp->var = tn;
+lp->localvar = localvar;
+lp->data = NULL;
+lp->args = NULL;
+lp->value = from;
+lp->step = (to >= from)? 1000 : -1000;
+
+if (Ustrncmp(in_line + chptr, "step", 4) == 0 &&
+    !isalnum((int)in_line[chptr+4]))
+  {
+  readword();
+  lp->step = readnumber();
+  nextsigch();
+  if (lp->step == 0)
+    {
+    error_moan(45);
+    end_loop(lp);
+    skip_loop_body(brace);
+    return;
+    }
+  }
+
+count = (to - from)/lp->step + 1;
+lp->count = (count < 0)? 0 : (count > INT_MAX)? INT_MAX : (int)count;
+loop_body(lp);
+}
+
+
+/* Start a loop once its command has been read. The position of the command's
+terminator is saved, so that reading continues from there afterwards. If there
+are no iterations, nothing happens.
+
+Argument:    the loop
+Returns:     nothing
+*/
+
+static void
+start_loop(loop *lp)
+{
+macro *m;
+
+if (!next_iteration(lp, TRUE))
+  {
+  end_loop(lp);
+  if (macactive != NULL) expand_rest();
+  return;
+  }
+
+if (mac_stack_ptr >= MAC_STACKSIZE)
+  {
+  error_moan(46);
+  exit(EXIT_FAILURE);
+  }
+
+in_line_stack[mac_stack_ptr] = in_line;
+chptr_stack[mac_stack_ptr] = chptr - 1;
+mac_count_stack[mac_stack_ptr++] = macro_id;
+
+m = getmacro();
+m->name[0] = 0;
+m->loop = lp;
+m->nextline = lp->body;
+m->thisline = NULL;
+m->args = lp->args;
+m->argcount = lp->argcount;
+m->prevunsubstituted = unsubstituted;
+m->locals = NULL;
+
+in_line = get_in_line();
+in_line[0] = 0;
+chptr = -1;
+
+m->previous = macactive;
+macactive = m;
+macro_id = macro_count++;
+nextch();
+}
+
+
+
+/*************************************************
+*               The DATA command                 *
+*************************************************/
+
+/* The name of the data file is in quotes, and may be followed by "header" to
+skip its first row. Then comes either "using" and the name of a macro, or a
+shape, which is handled by data_items() in rditem.c. In the first case, the
+macro is obeyed for each row of the file, with its arguments set from the
+fields of the row. This is done like a loop whose body is the macro, with the
+rows being read one at a time, as each iteration starts. The rows are not
+turned into input lines, so there is no substitution or parsing of the macro
+call. */
+
+static void
+c_data(void)
+{
+int n = 0;
+int row = 0;
+input_file *f;
+loop *lp;
+macro *m;
+mac_arg **ap;
+uschar name[DATA_NAMESIZE];
+
+if (in_line[chptr] != '"')
+  {
+  error_moan(11, "Quoted file name");
+  return;
+  }
+
+for (;;)
+  {
+  if (in_line[++chptr] == '\n' || in_line[chptr] == 0)
+    {
+    error_moan(21);
+    return;
+    }
+  if (in_line[chptr] == '"' && in_line[++chptr] != '"') break;
+  if (n < (int)sizeof(name) - 1) name[n++] = in_line[chptr];
+  }
+name[n] = 0;
+nextsigch();
+
+if ((f = input_open(name)) == NULL)
+  {
+  error_moan(1, name, "input", strerror(errno));
+  return;
+  }
+
+readword();
+if (Ustrcmp(word, "header") == 0)
+  {
+  uschar *field;
+  uschar buffer[DATA_ROWSIZE];
+  while (input_getrow(f, &field, 1, buffer, sizeof(buffer)) == 0) row++;
+  row++;
+  readword();
+  }
+
+if (Ustrcmp(word, "using") != 0)
+  {
+  data_items(f, name);
+  input_close(f);
+  return;
+  }
+
+readword();
+for (m = macroot; m != NULL; m = m->previous)
+  if (Ustrcmp(m->name, word) == 0) break;
+
+if (m == NULL || m->argcount > DATA_MAXFIELDS)
+  {
+  if (word[0] == 0) error_moan(11, "Macro name");
+    else if (m == NULL) error_moan(60, word);
+      else error_moan(62, word, DATA_MAXFIELDS);
+  input_close(f);
+  return;
+  }
+
+lp = getloop();
+lp->body = m->nextline;
+lp->keepbody = FALSE;
+lp->var = NULL;
+lp->count = 0;
+lp->value = lp->step = 0;
+lp->data = f;
+Ustrcpy(lp->dataname, name);
+lp->argcount = m->argcount;
+lp->args = NULL;
+lp->row = row;
+
+/* The argument blocks are re-used for each row. */
+
+ap = &(lp->args);
+for (int i = 0; i < lp->argcount; i++)
+  {
+  mac_arg *arg = get_data_arg();
+  arg->next = NULL;
+  *ap = arg;
+  ap = &(arg->next);
+  }
+
+pending_loop = lp;
+}
+
+
+
 /*************************************************
 *          Push and pop environment              *
 *************************************************/
@@ -675,6 +1265,88 @@ if (env->previous == NULL) error_moan(18); else
 
 
 
+/*************************************************
+*               The GROUP command                *
+*************************************************/
+
+/* The items that are drawn in the body of a group are put on the group's own
+chain, starting at the origin as if they were the first in the picture, and
+labels defined in the body are local to it. The environment is pushed at the
+start and popped at the end, so changes within the body do not leak out. The
+body is not read here; the command ends at the opening brace and the commands
+in the body are read normally. The closing brace is handled by end_group(). */
+
+static group  *current_group = NULL;
+static int     group_count = 0;
+static item   *saved_item_base;
+static item   *saved_lastitem;
+static item   *saved_baseitem;
+static tree_node *saved_label_root;
+
+static void
+c_group(void)
+{
+group *g;
+int brace = find_loop_brace();
+
+readword();
+if (word[0] == 0 || current_group != NULL)
+  {
+  if (word[0] == 0) error_moan(11, "Group name"); else error_moan(48);
+  skip_loop_body(brace);
+  return;
+  }
+if (in_line[chptr] != '{') { error_moan(11, "\"{\""); return; }
+chptr++;
+
+g = getstore(sizeof(group) + Ustrlen(word));
+Ustrcpy(g->name, word);
+g->items = NULL;
+g->number = ++group_count;
+g->used = FALSE;
+current_group = g;
+
+saved_item_base = main_item_base;
+saved_lastitem = lastitem;
+saved_baseitem = baseitem;
+saved_label_root = label_root;
+main_item_base = lastitem = baseitem = NULL;
+label_root = NULL;
+
+c_push();
+}
+
+
+/* Called when a closing brace is read where a command is expected. The group's
+bounding box is computed now, because it is needed to position placements.
+
+Arguments:  none
+Returns:    nothing
+*/
+
+static void
+end_group(void)
+{
+group *g = current_group;
+
+c_pop();
+g->items = main_item_base;
+main_item_base = saved_item_base;
+lastitem = saved_lastitem;
+baseitem = saved_baseitem;
+label_root = saved_label_root;
+
+find_items_bbox(g->items, g->bbox);
+if (g->bbox[0] > g->bbox[2]) g->bbox[0] = g->bbox[1] = g->bbox[2] =
+  g->bbox[3] = 0;
+
+g->next = group_base;
+group_base = g;
+current_group = NULL;
+}
+
+
+
 /*************************************************
 *               Table of commands                *
 *************************************************/
@@ -708,6 +1380,7 @@ static command_item cmdtab[] = {
   { US"circleradius",  c_env,   offsetof(environment, cirradius),     TRUE },
   { US"circlethickness", c_env, offsetof(environment, cirthickness),  TRUE },
   { US"curve",         c_curve, is_norm, FALSE },
+  { US"data",          c_data,        0,     0 },
   { US"down",          c_down,        0,     0 },
   { US"ellipse",       c_circle,is_norm, FALSE },
   { US"ellipsecolour", c_env5,  offsetof(environment, ellcolour),   FALSE },
@@ -718,7 +1391,10 @@ static command_item cmdtab[] = {
   { US"ellipsethickness", c_env, offsetof(environment, ellthickness), TRUE },
   { US"ellipsewidth",  c_env,   offsetof(environment, ellwidth),      TRUE },
   { US"fontdepth",     c_env,   offsetof(environment, fontdepth),     TRUE },
+  { US"for",           c_for,         0,     0 },
   { US"goto",          c_goto,        0,     0 },
+  { US"grid",          c_grid,  is_norm,     0 },
+  { US"group",         c_group,       0,     0 },
   { US"hlinelength",   c_env,   offsetof(environment, line_hw),       TRUE },
   { US"iarc",          c_arc,   is_invi,     0 },
   { US"ibox",          c_box,   is_invi,     0 },
@@ -727,6 +1403,9 @@ static command_item cmdtab[] = {
   { US"iellipse",      c_circle,is_invi, FALSE },
   { US"iline",         c_line,  is_invi, FALSE },
   { US"include",       c_include,     0,     0 },
+  { US"ipolygon",      c_poly,  is_invi, poly_closed },
+  { US"ipolyline",     c_poly,  is_invi, poly_open },
+  { US"ispline",       c_poly,  is_invi, poly_smooth },
   { US"left",          c_left,        0,     0 },
   { US"level",         c_env3,  offsetof(environment, level),        FALSE },
   { US"line",          c_line,  is_norm, FALSE },
@@ -734,15 +1413,21 @@ static command_item cmdtab[] = {
   { US"linedash",      c_env2,  offsetof(environment, linedash1), offsetof(environment,linedash2) },
   { US"linegrey",      c_env4,  offsetof(environment, linecolour),   FALSE },
   { US"linethickness", c_env,   offsetof(environment, linethickness), TRUE },
+  { US"local",         c_set,      TRUE,     0 },
   { US"magnify",       c_mag,         0,     0 },
   { US"macro",         c_macro,       0,     0 },
+  { US"place",         c_place, is_norm,     0 },
+  { US"polygon",       c_poly,  is_norm, poly_closed },
+  { US"polyline",      c_poly,  is_norm, poly_open },
   { US"pop",           c_pop,         0,     0 },
   { US"push",          c_push,        0,     0 },
+  { US"repeat",        c_repeat,      0,     0 },
   { US"resolution",    c_resolution,  0,     0 },
   { US"right",         c_right,       0,     0 },
-  { US"set",           c_set,         0,     0 },
+  { US"set",           c_set,     FALSE,     0 },
   { US"setfont",       c_env3,  offsetof(environment, setfont),      FALSE },
   { US"shapefill",     c_env6,  offsetof(environment, shapefilled),  FALSE },
+  { US"spline",        c_poly,  is_norm, poly_smooth },
   { US"text",          c_text,        0,     0 },
   { US"textcolour",    c_env5,  offsetof(environment, textcolour),   FALSE },
   { US"textdepth",     c_env,   offsetof(environment, linedepth),     TRUE },
@@ -801,6 +1486,13 @@ while (in_line[chptr] != ';' && in_line[chptr] != '|' && argcount < m->argcount)
 
 if (in_line[chptr] == '|') { nextch(); nextsigch(); }
 
+if (mac_stack_ptr >= MAC_STACKSIZE)
+  {
+  error_moan(46);
+  exit(EXIT_FAILURE);
+  }
+
+mm->prevunsubstituted = unsubstituted;
 in_line_stack[mac_stack_ptr] = in_line;
 chptr_stack[mac_stack_ptr] = chptr;
 mac_count_stack[mac_stack_ptr++] = macro_id;
@@ -871,7 +1563,7 @@ macro_count = 0;
 
 baseitem = lastitem = NULL;
 
-label_base = NULL;
+label_root = NULL;
 nextlabel = NULL;
 
 chptr = 0;
@@ -880,11 +1572,13 @@ in_line[1] = 0;
 in_prev[0] = '\n';
 in_prev[1] = 0;
 endfile = FALSE;
+lex_line();
 
 /* The main loop */
 
 for (;;)
   {
+  if (unsubstituted >= 0 && chptr >= unsubstituted) substitute_rest();
   nextsigch();
   while (in_line[chptr] == ';' && !endfile) { nextch(); nextsigch(); }
   if (endfile) break;
@@ -899,6 +1593,13 @@ for (;;)
       while (in_line[++chptr] != 0) {};
       chptr--;
       }
+    else if (in_line[chptr] == '}' && current_group != NULL)
+      {
+      chptr++;
+      nextsigch();
+      end_group();
+      if (in_line[chptr] != ';') error_moan(3);
+      }
     else
       {
       if (chptr == 0) chptr = 1;  /* Show this line, not previous */
@@ -921,7 +1622,6 @@ for (;;)
       label *newlabel = getstore(sizeof(label));
       Ustrcpy(newlabel->name, word);
       newlabel->next = nextlabel;
-      newlabel->itemptr = NULL;
       nextlabel = newlabel;
       }
     }
@@ -988,11 +1688,18 @@ for (;;)
      if (m == NULL) { error_moan(2, word); continue; }
      }
 
-    /* Was built-in; check terminator */
+    /* Was built-in; check terminator. The "group" command is terminated by
+    the opening brace of its body, which has already been read. */
 
-    else
+    else if (cmdtab[i].function != c_group)
       {
-      if (in_line[chptr++] != ';') { error_moan(3); continue; }
+      if (in_line[chptr++] != ';')
+        {
+        if (pending_loop != NULL) end_loop(pending_loop);
+        pending_loop = NULL;
+        error_moan(3);
+        continue;
+        }
       }
 
     /* If a non-macro command was labelled, but the label hasn't been used up,
@@ -1009,8 +1716,25 @@ for (;;)
         nextlabel = thislabel->next;
         }
       }
+
+    /* A loop command is complete; start obeying its body. */
+
+    if (pending_loop != NULL)
+      {
+      loop *lp = pending_loop;
+      pending_loop = NULL;
+      start_loop(lp);
+      }
     }
   }
+
+/* Close an unterminated group so that its items are not lost. */
+
+if (current_group != NULL)
+  {
+  error_moan(49, current_group->name);
+  end_group();
+  }
 }
 
 /* End of read.c */
@@ -0,0 +1,648 @@
+/*************************************************
+*                      ASPIC                     *
+*************************************************/
+
+/* Copyright (c) University of Cambridge 1991 - 2023 */
+/* Created: October 2026 */
+/* Last modified: October 2026 */
+
+/* This module contains the output layer that is used by the writing modules.
+Output is put into a large buffer, which is written to a file descriptor with
+write() or writev() when it is full, so there is no stdio overhead for each
+item. Numbers are formatted here rather than by printf(), and a format string
+is scanned by out_printf() itself, which recognizes only the few conversions
+that are needed.
+
+Output can also be put into a memory buffer that is supplied by the caller. If
+the buffer becomes full, the rest of the output is discarded, and this is
+reported by out_close().
+
+Output, or part of it, may be compressed; each buffer is then passed to
+wrzip.c, which writes the compressed data via out_write_raw(). */
+
+
+#include "aspic.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+
+/*************************************************
+*            Global and local variables          *
+*************************************************/
+
+/* The current position and end of the buffer are global so that out_char()
+can be a macro. */
+
+uschar *out_ptr = NULL;
+uschar *out_end = NULL;
+
+static uschar out_static[OUT_BUFFERSIZE];  /* Buffer for file output */
+static uschar *out_start = NULL;           /* Start of the current buffer */
+static int    out_fd = -1;                 /* File descriptor, or -1 */
+static uschar *out_memory = NULL;          /* Caller's buffer, or NULL */
+static size_t out_memsize = 0;             /* Size of the caller's buffer */
+static BOOL   out_overflow = FALSE;        /* Memory buffer was too small */
+static long int out_total = 0;             /* Bytes written to the file */
+static dimen  out_unit = 0;                /* Unit for %R and %U, or 0 */
+static BOOL   out_minimal = FALSE;         /* Use format_fixed_min() */
+static BOOL   out_zip = FALSE;             /* Compress file output */
+
+static const char *digits = "0123456789abcdef0123456789ABCDEF";
+
+
+
+/*************************************************
+*          Write a vector of blocks              *
+*************************************************/
+
+/* Partial writes and interrupted calls are retried. A failure to write is a
+hard error. For a memory buffer, the blocks are copied into it, and anything
+that does not fit is discarded.
+
+Arguments:
+  v          the vector of blocks, which is modified
+  count      the number of blocks
+
+Returns:     nothing
+*/
+
+static void
+write_blocks(struct iovec *v, int count)
+{
+if (out_fd < 0)
+  {
+  for (; count > 0; v++, count--)
+    {
+    size_t n = out_memsize - out_total;
+    if (v->iov_len > n) out_overflow = TRUE; else n = v->iov_len;
+    memcpy(out_memory + out_total, v->iov_base, n);
+    out_total += n;
+    }
+  return;
+  }
+
+while (count > 0)
+  {
+  ssize_t n = (count == 1)? write(out_fd, v->iov_base, v->iov_len) :
+    writev(out_fd, v, count);
+
+  if (n < 0)
+    {
+    if (errno == EINTR) continue;
+    /* LCOV_EXCL_START */
+    error_moan(68, strerror(errno));
+    exit(EXIT_FAILURE);
+    /* LCOV_EXCL_STOP */
+    }
+
+  out_total += n;
+  while (count > 0 && (size_t)n >= v->iov_len)
+    {
+    n -= v->iov_len;
+    v++;
+    count--;
+    }
+  if (count > 0)
+    {
+    v->iov_base = (char *)v->iov_base + n;
+    v->iov_len -= n;
+    }
+  }
+}
+
+
+
+/*************************************************
+*         Write data without compression         *
+*************************************************/
+
+/* This is used by wrzip.c for compressed data.
+
+Arguments:
+  s          the data
+  n          its length
+
+Returns:     nothing
+*/
+
+void
+out_write_raw(const uschar *s, size_t n)
+{
+struct iovec v;
+v.iov_base = (void *)s;
+v.iov_len = n;
+if (n > 0) write_blocks(&v, 1);
+}
+
+
+
+/*************************************************
+*          Set up the output buffer              *
+*************************************************/
+
+/* Uncompressed output to a memory buffer is put straight into the rest of the
+caller's buffer. Otherwise, and when the caller's buffer is full, the local
+buffer is used.
+
+Arguments:  none
+Returns:    nothing
+*/
+
+static void
+set_buffer(void)
+{
+if (out_memory != NULL && !out_zip && (size_t)out_total < out_memsize)
+  {
+  out_start = out_ptr = out_memory + out_total;
+  out_end = out_memory + out_memsize;
+  }
+else
+  {
+  out_start = out_ptr = out_static;
+  out_end = out_static + OUT_BUFFERSIZE;
+  }
+}
+
+
+
+/*************************************************
+*           Start output to a file               *
+*************************************************/
+
+/* Argument:  an open file descriptor
+   Returns:   nothing
+*/
+
+void
+out_open_fd(int fd)
+{
+out_fd = fd;
+out_memory = NULL;
+out_overflow = FALSE;
+out_zip = FALSE;
+out_total = 0;
+set_buffer();
+}
+
+
+
+/*************************************************
+*         Compress output to a file              *
+*************************************************/
+
+/* This is called after out_open_fd(), either before anything is output, for
+a compressed file, or part way through, for a compressed stream within a file.
+Any pending uncompressed output is written first. The output is compressed
+until out_compress_end() or out_close() is called.
+
+Argument:  ZIP_GZIP or ZIP_ZLIB
+Returns:   nothing
+*/
+
+void
+out_compress(int format)
+{
+out_flush();
+out_zip = TRUE;
+set_buffer();
+zip_start(format);
+}
+
+
+
+/*************************************************
+*           End compressed output                *
+*************************************************/
+
+/* The compressed data is completed, and subsequent output is not compressed.
+
+Arguments:  none
+Returns:    nothing
+*/
+
+void
+out_compress_end(void)
+{
+out_flush();
+zip_data(NULL, 0, TRUE);
+out_zip = FALSE;
+set_buffer();
+}
+
+
+
+/*************************************************
+*       Start output to a memory buffer          *
+*************************************************/
+
+/* The buffer belongs to the caller, and its contents are valid after
+out_close() has returned a non-negative length. Output may be compressed, as it
+may for a file.
+
+Arguments:
+  buffer     the buffer
+  size       its size
+
+Returns:     nothing
+*/
+
+void
+out_open_memory(uschar *buffer, size_t size)
+{
+out_fd = -1;
+out_memory = buffer;
+out_memsize = size;
+out_overflow = FALSE;
+out_zip = FALSE;
+out_total = 0;
+set_buffer();
+}
+
+
+
+/*************************************************
+*          Find the current output offset        *
+*************************************************/
+
+/* This is used for the cross-reference table of a PDF file. It is not
+meaningful while output is being compressed.
+
+Arguments:  none
+Returns:    the number of bytes output so far
+*/
+
+long int
+out_position(void)
+{
+return out_total + (out_ptr - out_start);
+}
+
+
+
+/*************************************************
+*              Empty the buffer                  *
+*************************************************/
+
+/* For a file, or when compressing, the buffer is written. Uncompressed output
+to a memory buffer is already in place, so it is just counted, unless the
+caller's buffer was full and it was put into the local buffer, in which case
+it is discarded.
+
+Arguments:  none
+Returns:    nothing
+*/
+
+void
+out_flush(void)
+{
+if (out_zip) zip_data(out_start, out_ptr - out_start, FALSE);
+else if (out_memory == NULL) out_write_raw(out_start, out_ptr - out_start);
+else if (out_start != out_static) out_total += out_ptr - out_start;
+else if (out_ptr > out_start) out_overflow = TRUE;
+set_buffer();
+}
+
+
+
+/*************************************************
+*              Finish output                     *
+*************************************************/
+
+/* Any remaining data is written, and a file descriptor other than the
+standard output is closed.
+
+Arguments:  none
+Returns:    the number of bytes of output, or -1 if a memory buffer was too
+              small
+*/
+
+long int
+out_close(void)
+{
+long int yield;
+
+if (out_zip) out_compress_end(); else out_flush();
+if (out_fd >= 0 && out_fd != STDOUT_FILENO && close(out_fd) != 0)
+  {
+  /* LCOV_EXCL_START */
+  error_moan(68, strerror(errno));
+  exit(EXIT_FAILURE);
+  /* LCOV_EXCL_STOP */
+  }
+yield = out_overflow? -1 : out_total;
+
+out_fd = -1;
+out_memory = NULL;
+out_zip = FALSE;
+out_ptr = out_end = out_start = NULL;
+return yield;
+}
+
+
+
+/*************************************************
+*              Output a block of bytes           *
+*************************************************/
+
+/* When writing to a file, a block that does not fit in the buffer is written
+together with the buffer's contents by writev(), without being copied. When
+compressing, the two are passed to the compressor in turn.
+
+Arguments:
+  s          the bytes
+  n          the number of bytes
+
+Returns:     nothing
+*/
+
+void
+out_bytes(const uschar *s, size_t n)
+{
+size_t left = out_end - out_ptr;
+
+if (n <= left)
+  {
+  memcpy(out_ptr, s, n);
+  out_ptr += n;
+  return;
+  }
+
+if (out_zip)
+  {
+  zip_data(out_start, out_ptr - out_start, FALSE);
+  zip_data(s, n, FALSE);
+  out_ptr = out_start;
+  return;
+  }
+
+if (out_memory == NULL)
+  {
+  struct iovec v[2];
+  v[0].iov_base = out_start;
+  v[0].iov_len = out_ptr - out_start;
+  v[1].iov_base = (void *)s;
+  v[1].iov_len = n;
+  write_blocks(v, 2);
+  out_ptr = out_start;
+  return;
+  }
+
+/* A memory buffer has overflowed; keep what fits and discard the rest. */
+
+memcpy(out_ptr, s, left);
+out_ptr += left;
+out_flush();
+out_overflow = TRUE;
+}
+
+
+
+/*************************************************
+*              Output a string                   *
+*************************************************/
+
+/* Argument:  a zero-terminated string
+   Returns:   nothing
+*/
+
+void
+out_string(const uschar *s)
+{
+out_bytes(s, Ustrlen(s));
+}
+
+
+
+/*************************************************
+*          Output an integer in any base         *
+*************************************************/
+
+/* The digits are generated backwards in a local buffer.
+
+Arguments:
+  value      the number
+  base       8, 10, or 16
+  upper      TRUE for upper case hex letters
+  width      minimum width, padded with zeros or spaces
+  zero       TRUE for zero padding
+
+Returns:     nothing
+*/
+
+static void
+out_number(long long int value, int base, BOOL upper, int width, BOOL zero)
+{
+uschar buffer[40];
+uschar *p = buffer + sizeof(buffer);
+unsigned long long int u = (value < 0 && base == 10)?
+  0ull - (unsigned long long int)value : (unsigned long long int)value;
+const char *d = digits + (upper? 16 : 0);
+
+do { *(--p) = d[u % base]; u /= base; } while (u != 0);
+if (width > 30) width = 30;
+if (zero)
+  {
+  while (buffer + sizeof(buffer) - p < width - (value < 0 && base == 10))
+    *(--p) = '0';
+  if (value < 0 && base == 10) *(--p) = '-';
+  }
+else
+  {
+  if (value < 0 && base == 10) *(--p) = '-';
+  while (buffer + sizeof(buffer) - p < width) *(--p) = ' ';
+  }
+
+out_bytes(p, buffer + sizeof(buffer) - p);
+}
+
+
+
+/*************************************************
+*              Output an integer                 *
+*************************************************/
+
+/* Argument:  the number
+   Returns:   nothing
+*/
+
+void
+out_int(long long int value)
+{
+out_number(value, 10, FALSE, 0, FALSE);
+}
+
+
+
+/*************************************************
+*           Output a fixed-point number          *
+*************************************************/
+
+/* The number is formatted by format_fixed() in write.c, or by
+format_fixed_min() for minimized output, straight into the buffer if there is
+room.
+
+Argument:  the number, in thousandths
+Returns:   nothing
+*/
+
+void
+out_fixed(dimen x)
+{
+int (*format)(uschar *, dimen) = out_minimal? format_fixed_min : format_fixed;
+
+if (out_end - out_ptr >= FIXED_SIZE) out_ptr += format(out_ptr, x); else
+  {
+  uschar buffer[FIXED_SIZE];
+  out_bytes(buffer, format(buffer, x));
+  }
+}
+
+
+
+/*************************************************
+*          Set minimal number format             *
+*************************************************/
+
+/* When this is set, fixed-point numbers are rounded to the resolution and
+written without a zero before the point. It is used for minimized SVG.
+
+Argument:  TRUE for minimal numbers
+Returns:   nothing
+*/
+
+void
+out_set_minimal(BOOL minimal)
+{
+out_minimal = minimal;
+}
+
+
+
+/*************************************************
+*          Set the unit for dimensions           *
+*************************************************/
+
+/* When a unit is set, coordinates (%R) are output as whole numbers of units,
+and other dimensions (%U) as fixed-point numbers of units. This is used for
+compact output, where the drawing is scaled so that one unit is the resolution.
+
+Argument:  the unit, in thousandths of a point, or 0 for output in points
+Returns:   nothing
+*/
+
+void
+out_set_unit(dimen unit)
+{
+out_unit = unit;
+}
+
+
+
+/*************************************************
+*     Output a rounded fixed-point number        *
+*************************************************/
+
+/* This combines rnd() and out_fixed() for coordinates. When the resolution is
+one thousandth of a point, which is the default, there is no rounding to do.
+The rounded value is an exact multiple of the resolution, so when a unit is
+set (it is always the resolution) a whole number is output.
+
+Argument:  the number, in thousandths
+Returns:   nothing
+*/
+
+void
+out_fixed_rounded(dimen x)
+{
+if (out_unit != 0) out_int(rnd(x)/out_unit);
+  else out_fixed((resolution == 1)? x : rnd(x));
+}
+
+
+
+/*************************************************
+*         Output an unrounded dimension          *
+*************************************************/
+
+/* When a unit is set, the value is rounded to the nearest thousandth of a unit.
+
+Argument:  the dimension, in thousandths of a point
+Returns:   nothing
+*/
+
+static void
+out_dimension(dimen x)
+{
+if (out_unit != 0)
+  {
+  dimen n = x * 1000;
+  x = (n + ((n < 0)? -out_unit : out_unit)/2) / out_unit;
+  }
+out_fixed(x);
+}
+
+
+
+/*************************************************
+*            Formatted output                    *
+*************************************************/
+
+/* Only these conversions are recognized: %c, %d, %o, %x, %X, %s, and %%, with
+an optional width that may start with a zero, and %F and %R, which output a
+dimen in fixed-point format, as out_fixed() and out_fixed_rounded() do. %U is
+like %F, but is for a dimension, which is affected by out_set_unit(). The
+arguments for %F, %R, and %U must be of type dimen.
+
+Arguments:
+  format     the format
+  ...        the values
+
+Returns:     nothing
+*/
+
+void
+out_printf(const char *format, ...)
+{
+va_list ap;
+const char *p = format;
+
+va_start(ap, format);
+
+for (;;)
+  {
+  int width = 0;
+  BOOL zero = FALSE;
+  const char *q = strchr(p, '%');
+
+  if (q == NULL)
+    {
+    out_string(US p);
+    break;
+    }
+  if (q > p) out_bytes(US p, q - p);
+
+  p = q + 1;
+  if (*p == '0') { zero = TRUE; p++; }
+  while (isdigit((unsigned char)*p)) width = width * 10 + *p++ - '0';
+
+  switch (*p++)
+    {
+    case 'c': out_char(va_arg(ap, int)); break;
+    case 'd': out_number(va_arg(ap, int), 10, FALSE, width, zero); break;
+    case 'o': out_number(va_arg(ap, unsigned int), 8, FALSE, width, zero); break;
+    case 'x': out_number(va_arg(ap, unsigned int), 16, FALSE, width, zero); break;
+    case 'X': out_number(va_arg(ap, unsigned int), 16, TRUE, width, zero); break;
+    case 's': out_string(US va_arg(ap, char *)); break;
+    case 'F': out_fixed(va_arg(ap, dimen)); break;
+    case 'R': out_fixed_rounded(va_arg(ap, dimen)); break;
+    case 'U': out_dimension(va_arg(ap, dimen)); break;
+    case '%': out_char('%'); break;
+    default: p--; break;     /* LCOV_EXCL_LINE */
+    }
+  }
+
+va_end(ap);
+}
+
+/* End of wrfile.c */
@@ -13,6 +13,16 @@ output format. */
 #include "aspic.h"
 
 
+/* The table for font_char(), which maps characters from U+0180 to U+FFFF that
+are not in the first two fonts. There is a page of 256 entries for each block
+of characters that has any in the table; the rest share an empty page. An entry
+is the font offset times 256 plus the code within the font, or zero if the
+character is not available. */
+
+static unsigned short int empty_page[256];
+static unsigned short int *font_char_pages[256];
+
+
 
 
 /*************************************************
@@ -41,10 +51,10 @@ Arguments:
 Returns:    the line depth
 */
 
-int
+dimen
 find_linedepth(item *p, stringchain *s)
 {
-int fontsize = 12000;    /* default */
+dimen fontsize = 12000;  /* default */
 for (bindfont *b = font_base; b != NULL; b = b->next)
   {
   if (b->number == s->font)
@@ -72,10 +82,10 @@ Arguments:
 Returns:    the font depth
 */
 
-int
+dimen
 find_fontdepth(item *p, stringchain *s)
 {
-int fontdepth = 6000;    /* default */
+dimen fontdepth = 6000;  /* default */
 for (bindfont *b = font_base; b != NULL; b = b->next)
   {
   if (b->number == s->font)
@@ -90,6 +100,95 @@ return (fontdepth > p->fontdepth)? fontdepth : p->fontdepth;
 
 
 
+/*************************************************
+*       Find the font and code for a character   *
+*************************************************/
+
+/* Each bound font is output as up to four fonts. The first two are the text
+font with two different encodings, and the others are the Symbol and Dingbats
+fonts, for characters that are not in the text font. Characters beyond the
+first two fonts are looked up in a table that is set up by init_font_chars().
+
+Arguments:
+  c         the Unicode character
+  offset    where to return the font offset, 0-3
+
+Returns:    the code within the font
+*/
+
+int
+font_char(int c, int *offset)
+{
+unsigned int e;
+
+/* Chars < 256 are in the first font, Unicode encoded */
+
+if (c < 256) { *offset = 0; return c; }
+
+/* Chars < 384 are in the second font, Unicode encoded - 256 */
+
+if (c < 384) { *offset = 1; return c - 256; }
+
+/* Others are either non-Unicode encoded in the second font, or in the Symbol
+or Dingbats fonts, or not available. */
+
+e = (c < 0x10000)? font_char_pages[c >> 8][c & 0xff] : 0;
+if (e == 0)
+  {
+  *offset = 0;
+  return 0x00a4;    /* Currency symbol for "unknown" */
+  }
+
+*offset = e >> 8;
+return e & 0xff;
+}
+
+
+
+/*************************************************
+*       Set up the table for font_char()         *
+*************************************************/
+
+/* This is called once, before any input is read. Characters in nonulist take
+precedence over those in u2slist.
+
+Arguments:
+  c         the Unicode character
+  offset    the font offset, 1-3
+  code      the code within the font
+
+Returns:    nothing
+*/
+
+static void
+set_font_char(int c, int offset, int code)
+{
+unsigned short int *page = font_char_pages[c >> 8];
+
+if (page == empty_page)
+  {
+  page = getstore(sizeof(empty_page));
+  memset(page, 0, sizeof(empty_page));
+  font_char_pages[c >> 8] = page;
+  }
+
+if (page[c & 0xff] == 0)
+  page[c & 0xff] = (unsigned short int)(offset*256 + code);
+}
+
+
+void
+init_font_chars(void)
+{
+for (int i = 0; i < 256; i++) font_char_pages[i] = empty_page;
+for (int i = 0; i < nonucount; i++) set_font_char(nonulist[i], 1, i + 128);
+for (int i = 0; i < u2scount; i++)
+  set_font_char(u2slist[i].ucode, (u2slist[i].which == SF_SYMB)? 2 : 3,
+    u2slist[i].scode);
+}
+
+
+
 /*************************************************
 *          Determine the bounding box            *
 *************************************************/
@@ -106,13 +205,13 @@ Returns:     nothing
 */
 
 static void
-setbbox(int *box, int x, int y, int w, int d)
+setbbox(dimen *box, dimen x, dimen y, dimen w, dimen d)
 {
-int xx = x + w;
-int yy = y + d;
+dimen xx = x + w;
+dimen yy = y + d;
 
-if (x > xx) { int temp = x; x = xx; xx = temp; }
-if (y > yy) { int temp = y; y = yy; yy = temp; }
+if (x > xx) { dimen temp = x; x = xx; xx = temp; }
+if (y > yy) { dimen temp = y; y = yy; yy = temp; }
 
 if (x  < box[0]) box[0] = x;
 if (y  < box[1]) box[1] = y;
@@ -121,25 +220,31 @@ if (yy > box[3]) box[3] = yy;
 }
 
 
-/* This is the function that is called from outside.
+/* This function finds the bounding box of a chain of items. It is used for the
+main chain and for the items in a group. If there are no visible items, the
+box is left with its minima greater than its maxima.
 
-Argument:   pointer to a vector of 4 units
-Returns:    nothing
+Arguments:
+  base       the start of the chain
+  box        pointer to a vector of 4 units
+
+Returns:     nothing
 */
 
 void
-find_bbox(int *box)
+find_items_bbox(item *base, dimen *box)
 {
 item *p;
-int x, y;
+dimen x, y;
 
-box[0] = box[1] = INT_MAX;
-box[2] = box[3] = INT_MIN;
+box[0] = box[1] = LLONG_MAX;
+box[2] = box[3] = LLONG_MIN;
 
 /* Scan all the items, ignoring those that are invisible, unless they have
-attached strings or a set shapefilled value. */
+attached strings or a set shapefilled value. A placed group is treated as a
+box. */
 
-for (p = main_item_base; p != NULL; p = p->next)
+for (p = base; p != NULL; p = p->next)
   {
   if (p->style == is_invi &&
       p->strings == NULL &&
@@ -151,7 +256,7 @@ for (p = main_item_base; p != NULL; p = p->next)
     case i_arc:
       {
       item_arc *pp = (item_arc *)p;
-      int bx, by, cx, cy;
+      dimen bx, by, cx, cy;
       double a1 = pp->angle1;
       double a2 = pp->angle2;
 
@@ -163,10 +268,10 @@ for (p = main_item_base; p != NULL; p = p->next)
       while (a2 > 2.0*pi) { a1 -= 2.0*pi; a2 -= 2.0*pi; }
       while (a2 < 0) { a1 += 2.0*pi; a2 += 2.0*pi; }
 
-      bx = (int )((double)(pp->radius) * cos(a1));
-      by = (int )((double)(pp->radius) * sin(a1));
-      cx = (int )((double)(pp->radius) * cos(a2));
-      cy = (int )((double)(pp->radius) * sin(a2));
+      bx = (dimen)((double)(pp->radius) * cos(a1));
+      by = (dimen)((double)(pp->radius) * sin(a1));
+      cx = (dimen)((double)(pp->radius) * cos(a2));
+      cy = (dimen)((double)(pp->radius) * sin(a2));
 
       if (a1 < 0)   /* We know a2 must be > 0 */
 	{
@@ -199,10 +304,10 @@ for (p = main_item_base; p != NULL; p = p->next)
     case i_curve:
       {
       item_curve *pp = (item_curve *)p;
-      int th = pp->thickness;
+      dimen th = pp->thickness;
       for (double t = 0.0; t <= 1.0; t += 0.1)
         {
-        int x, y;
+        dimen x, y;
         find_curvepos(pp, t, &x, &y);
         if (x - th < box[0]) box[0] = x - th;
         if (y - th < box[1]) box[1] = y - th;
@@ -215,8 +320,8 @@ for (p = main_item_base; p != NULL; p = p->next)
     case i_box:
       {
       item_box *pp = (item_box *)p;
-      int bx = pp->x - pp->width/2 - pp->thickness/2;
-      int by = pp->y - pp->depth/2 - pp->thickness/2;
+      dimen bx = pp->x - pp->width/2 - pp->thickness/2;
+      dimen by = pp->y - pp->depth/2 - pp->thickness/2;
       setbbox(box, bx, by, pp->width + pp->thickness,
         pp->depth + pp->thickness);
       }
@@ -225,11 +330,11 @@ for (p = main_item_base; p != NULL; p = p->next)
     case i_line:
       {
       item_line *pp = (item_line *)p;
-      int x = pp->x;
-      int y = pp->y;
-      int width = pp->width;
-      int depth = pp->depth;
-      int t = pp->thickness;
+      dimen x = pp->x;
+      dimen y = pp->y;
+      dimen width = pp->width;
+      dimen depth = pp->depth;
+      dimen t = pp->thickness;
 
       if (width == 0) { x -= t/2; width = t; }             /* Vertical line */
       if (depth == 0) { y -= t/2; depth = t; }             /* Horizontal line */
@@ -240,7 +345,7 @@ for (p = main_item_base; p != NULL; p = p->next)
 
       if (pp->arrow_start || pp->arrow_end)
 	{
-	int ww = pp->arrow_y;
+	dimen ww = pp->arrow_y;
 	if (width == 0) { x -= ww/2; width = ww; }
 	else if (depth == 0) { y -= ww/2; depth = ww; }
 	}
@@ -249,6 +354,22 @@ for (p = main_item_base; p != NULL; p = p->next)
       }
     break;
 
+    case i_poly:
+      {
+      item_poly *pp = (item_poly *)p;
+      dimen th = pp->thickness/2;
+      for (int i = 0; i < 2*pp->count; i += 2)
+        {
+        dimen x = pp->points[i];
+        dimen y = pp->points[i+1];
+        if (x - th < box[0]) box[0] = x - th;
+        if (y - th < box[1]) box[1] = y - th;
+        if (x + th > box[2]) box[2] = x + th;
+        if (y + th > box[3]) box[3] = y + th;
+        }
+      }
+    break;
+
     /* All strings are handled below, so there's nothing to do for i_text. */
 
     case i_text:
@@ -269,9 +390,9 @@ for (p = main_item_base; p != NULL; p = p->next)
     for (;;)
       {
       bindfont *f;
-      int len = s->chcount;
-      int depth = p->fontdepth;
-      int bx, by, bw, bd;
+      dimen len = s->chcount;
+      dimen depth = p->fontdepth;
+      dimen bx, by, bw, bd;
 
       for (f = font_base; f != NULL; f = f->next)
         { if (f->number == s->font) break; }
@@ -303,13 +424,13 @@ for (p = main_item_base; p != NULL; p = p->next)
         double rsin = sin(s->rrotate);
         double rcos = cos(s->rrotate);
 
-        int nbx = (int)((double)(bx - x) * rcos - (double)(by - y) * rsin);
-        int nby = (int)((double)(by - y) * rcos + (double)(bx - x) * rsin);
+        dimen nbx = (dimen)((double)(bx - x) * rcos - (double)(by - y) * rsin);
+        dimen nby = (dimen)((double)(by - y) * rcos + (double)(bx - x) * rsin);
 
-        int nbw = (int)((double)bd * rsin + (double)bw * rcos);
-        int nbd = (int)((double)bw * rsin + (double)bd * rcos);
+        dimen nbw = (dimen)((double)bd * rsin + (double)bw * rcos);
+        dimen nbd = (dimen)((double)bw * rsin + (double)bd * rcos);
 
-        bx = nbx - (int)((double)bd * rsin);
+        bx = nbx - (dimen)((double)bd * rsin);
         by = nby;
 
         bw = nbw;
@@ -329,12 +450,25 @@ for (p = main_item_base; p != NULL; p = p->next)
       depth = find_linedepth(p, s);
       if (s->rotate == 0) y -= depth; else
         {
-        y -= (int)((double)depth * cos(s->rrotate));
-        x += (int)((double)depth * sin(s->rrotate));
+        y -= (dimen)((double)depth * cos(s->rrotate));
+        x += (dimen)((double)depth * sin(s->rrotate));
         }
       }
     }
   }
+}
+
+
+/* This is the function that is called from outside for the whole picture.
+
+Argument:   pointer to a vector of 4 units
+Returns:    nothing
+*/
+
+void
+find_bbox(dimen *box)
+{
+find_items_bbox(main_item_base, box);
 
 /* Adjust the values if a frame is required */
 
@@ -349,6 +483,72 @@ if (drawbbox != NULL)
 
 
 
+/*************************************************
+*          Sort a chain of items by level        *
+*************************************************/
+
+/* The writers draw the items one level at a time, lowest first, keeping their
+original order within each level. Instead of scanning the whole chain once for
+each level in the range that is used, the items are put into a vector that is
+sorted once. A merge sort is used because it is stable. Usually all the items
+are at the same level, so there is nothing to sort.
+
+Arguments:
+  base       the start of the chain
+  countptr   where to return the number of items
+
+Returns:     the sorted vector
+*/
+
+item **
+sort_items(item *base, int *countptr)
+{
+int n = 0;
+BOOL sorted = TRUE;
+item **v, **w;
+
+for (item *p = base; p != NULL; p = p->next)
+  {
+  if (p->next != NULL && p->next->level < p->level) sorted = FALSE;
+  n++;
+  }
+
+v = getstore((2*n + 1) * sizeof(item *));
+w = v + n;
+n = 0;
+for (item *p = base; p != NULL; p = p->next) v[n++] = p;
+*countptr = n;
+if (sorted) return v;
+
+/* Merge runs of width items, doubling the width each time, alternating
+between the two halves of the store. */
+
+for (int width = 1; width < n; width *= 2)
+  {
+  item **t;
+  for (int i = 0; i < n; i += 2*width)
+    {
+    int j = i;
+    int a = i;
+    int amax = (i + width < n)? i + width : n;
+    int b = amax;
+    int bmax = (i + 2*width < n)? i + 2*width : n;
+
+    while (a < amax && b < bmax)
+      w[j++] = (v[b]->level < v[a]->level)? v[b++] : v[a++];
+    while (a < amax) w[j++] = v[a++];
+    while (b < bmax) w[j++] = v[b++];
+    }
+  t = v;
+  v = w;
+  w = t;
+  }
+
+return v;
+}
+
+
+
 /*************************************************
 *           Round dimension to resolution        *
 *************************************************/
@@ -362,11 +562,11 @@ Arguments:
 Returns:      the rounded dimension
 */
 
-int
-rnd(int value)
+dimen
+rnd(dimen value)
 {
 int sign = (value < 0)? (-1) : (+1);
-div_t split = div(abs(value), resolution);
+lldiv_t split = lldiv(llabs(value), resolution);
 if (split.rem > resolution/2) split.quot++;
 return split.quot * resolution * sign;
 }
@@ -377,36 +577,103 @@ return split.quot * resolution * sign;
 *           Coordinate to fixed point string     *
 *************************************************/
 
-/* This function converts a dimension into a fixed-point string. A large
-circular buffer is used so that several results can be in existence at once
-(e.g. several values in a single fprintf() call).
+/* This function converts a dimension into a fixed-point string, without
+trailing zeros after the point, and without the point for a whole number. The
+digits are generated two at a time from a table. The three fractional digits
+are always written, and the trailing zeros are then dropped by adjusting the
+length. This is called for every coordinate that is output, so it writes
+straight into the output buffer where possible (see out_fixed()).
 
 Arguments:
+ buffer        where to put the string, at least FIXED_SIZE bytes
  x             the dimension
 
-Returns:       pointer to a string
+Returns:       the length of the string, which is zero-terminated
 */
 
-static uschar fixed_buffer[200];
-static int   fixed_ptr = 0;
+static const char digit_pairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
 
-uschar *
-fixed(int x)
+int
+format_fixed(uschar *buffer, dimen x)
 {
-uschar *p = fixed_buffer + fixed_ptr;
-int n = 0;
-if (x < 0) { *p = '-'; x = -x; n++; }
-n = sprintf(CS(p + n), "%d", x/1000);
-n = (int)(x%1000);
-if (n != 0)
+uschar digits[20];
+uschar *p = digits + sizeof(digits);
+unsigned long long int u = (x < 0)?
+  0ull - (unsigned long long int)x : (unsigned long long int)x;
+unsigned long long int whole = u / 1000;
+unsigned int frac = (unsigned int)(u % 1000);
+int n;
+
+while (whole >= 100)
+  {
+  unsigned long long int q = whole / 100;
+  p -= 2;
+  memcpy(p, digit_pairs + 2*(whole - 100*q), 2);
+  whole = q;
+  }
+if (whole >= 10)
+  {
+  p -= 2;
+  memcpy(p, digit_pairs + 2*whole, 2);
+  }
+else *(--p) = '0' + whole;
+
+buffer[0] = '-';
+n = (x < 0);
+memcpy(buffer + n, p, digits + sizeof(digits) - p);
+n += digits + sizeof(digits) - p;
+
+if (frac != 0)
+  {
+  buffer[n] = '.';
+  memcpy(buffer + n + 1, digit_pairs + 2*(frac/10), 2);
+  buffer[n + 3] = '0' + frac % 10;
+  n += 4 - (frac % 10 == 0) - (frac % 100 == 0);
+  }
+
+buffer[n] = 0;
+return n;
+}
+
+
+
+/*************************************************
+*     Coordinate to minimal fixed point string   *
+*************************************************/
+
+/* This is used for minimized output. The dimension is rounded to the
+resolution, and a zero before the point is omitted, so that, for example, 0.5
+is written as .5 and -0.25 as -.25.
+
+Arguments:
+ buffer        where to put the string, at least FIXED_SIZE bytes
+ x             the dimension
+
+Returns:       the length of the string, which is zero-terminated
+*/
+
+int
+format_fixed_min(uschar *buffer, dimen x)
+{
+int n = format_fixed(buffer, (resolution == 1)? x : rnd(x));
+int z = (buffer[0] == '-');
+
+if (buffer[z] == '0' && buffer[z+1] == '.')
   {
-  int m = (int)Ustrlen(p);
-  m += sprintf(CS(p + m), ".%03d", n);
-  while (p[m-1] == '0') p[--m] = 0;       /* Remove trailing zeroes */
+  memmove(buffer + z, buffer + z + 1, n - z);
+  n--;
   }
-fixed_ptr += 20;
-if (fixed_ptr >= 200) fixed_ptr = 0;
-return p;
+return n;
 }
 
 
@@ -430,8 +697,8 @@ Returns:        nothing
 */
 
 void
-smallarc(int radius1, int radius2, double angle1, double angle2,
-  void (*rbezier)(int , int , int , int , int , int ))
+smallarc(dimen radius1, dimen radius2, double angle1, double angle2,
+  void (*rbezier)(dimen, dimen, dimen, dimen, dimen, dimen))
 {
 double r1 = (double) radius1;
 double r2 = (double) radius2;
@@ -467,7 +734,7 @@ by = (-45.0*yp + 36.0*yq - 9.0*y3 + 18.0*y0)/2.0;
 y1 = y0 + cy/3.0;
 y2 = y1 + (cy+by)/3.0;
 
-rbezier((int )(x1-x0), (int )(y1-y0), (int )(x2-x0), (int )(y2-y0), (int )(x3-x0), (int )(y3-y0));
+rbezier((dimen)(x1-x0), (dimen)(y1-y0), (dimen)(x2-x0), (dimen)(y2-y0), (dimen)(x3-x0), (dimen)(y3-y0));
 }
 
 
@@ -485,11 +752,11 @@ Arguments:
 */
 
 void
-stringpos(item *p, int *xx, int *yy)
+stringpos(item *p, dimen *xx, dimen *yy)
 {
 stringchain *s, *ss;
-int x = p->x;
-int y = p->y;
+dimen x = p->x;
+dimen y = p->y;
 int n = 0;
 int i;
 
@@ -534,8 +801,8 @@ else if (p->type == i_arc)
   if (arc->angle1 > arc->angle2) angle += pi;
   if (arc->cw) angle += pi;
 
-  x += (int )(radius * cos(angle)) + 6000;  /* Move a little bit away */
-  y += (int )(radius * sin(angle));
+  x += (dimen)(radius * cos(angle)) + 6000;  /* Move a little bit away */
+  y += (dimen)(radius * sin(angle));
   angle = fabs(angle);
 
   if (angle > 3.0*pi/8.0 && angle < 5.0*pi/8.0)
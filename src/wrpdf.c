@@ -0,0 +1,1338 @@
+/*************************************************
+*                      ASPIC                     *
+*************************************************/
+
+/* Copyright (c) University of Cambridge 1991 - 2023 */
+/* Created: October 2026 */
+/* Last modified: October 2026 */
+
+/* This module generates output as a single-page PDF file. The drawing follows
+the PostScript output in wrps.c, but PDF has no procedures and no relative path
+operators, so coordinates are absolute, and the graphics state for a path is
+set before the path is started, because it cannot be changed inside one. Each
+placed group is written once, as a form XObject. The fonts are the standard 14
+PDF fonts, chosen by looking at the names in the font bindings, so nothing is
+embedded. The content streams are compressed, except when testing, so that the
+test output does not depend on the compressor. */
+
+
+#include "aspic.h"
+
+
+/*************************************************
+*               Local variables                  *
+*************************************************/
+
+/* Objects with fixed numbers; the fonts and the groups follow them. */
+
+enum { obj_catalog = 1, obj_pages, obj_page, obj_resources, obj_info,
+  obj_contents, obj_contents_length, obj_lower, obj_upper, obj_fonts };
+
+/* The standard fonts. The first eight are in the same order as the widths in
+text_font_widths[]. */
+
+static const char *std_fonts[] = {
+  "Times-Roman", "Times-Bold", "Times-Italic", "Times-BoldItalic",
+  "Helvetica", "Helvetica-Bold", "Helvetica-Oblique", "Helvetica-BoldOblique",
+  "Courier", "Courier-Bold", "Courier-Oblique", "Courier-BoldOblique",
+  "Symbol", "ZapfDingbats" };
+
+enum { sf_times = 0, sf_helvetica = 4, sf_courier = 8, sf_symbol = 12,
+  sf_dingbats = 13 };
+
+static dimen bbox[4];
+
+static long int *offsets;      /* Offsets of the objects */
+static int *group_objects;     /* Object numbers of the groups */
+
+static colour line_fill_colour;
+static colour stroke_colour;
+static colour set_fill_colour;
+static colour set_stroke_colour;
+
+static dimen set_linedash1;
+static dimen set_linedash2;
+static dimen set_linewidth;
+
+static dimen stroke_thickness;
+static dimen stroke_dash1;
+static dimen stroke_dash2;
+
+static dimen at_x;
+static dimen at_y;
+static dimen current_x;         /* The end of the current path */
+static dimen current_y;
+
+static BOOL fillpending;
+static BOOL strokepending;
+static BOOL path_open;
+
+static item *pathstart;
+
+
+
+/*************************************************
+*          Local initialization                  *
+*************************************************/
+
+void
+init_pdf(void)
+{
+bindfont *f = getstore(sizeof(bindfont) + Ustrlen("Times-Roman"));
+
+f->next = font_base;
+font_base = f;
+f->number = 0;
+f->size = 12000;
+f->needLower = f->needUpper = FALSE;
+f->needSymbol = f->needDingbats = FALSE;
+Ustrcpy(f->name, "Times-Roman");
+
+resolution = 120;       /* 0.12 == 600 dpi for default resolution */
+}
+
+
+
+/*************************************************
+*          Choose a standard font                *
+*************************************************/
+
+/* The family is recognized from a few common words in the name, with Times as
+the default; the style is chosen in the same way.
+
+Argument:  the font name from the binding
+Returns:   an index in std_fonts
+*/
+
+static int
+std_font(uschar *name)
+{
+int n;
+
+if (Ustrstr(name, "Symbol") != NULL) return sf_symbol;
+if (Ustrstr(name, "Dingbats") != NULL) return sf_dingbats;
+
+if (Ustrstr(name, "Helvetica") != NULL || Ustrstr(name, "Arial") != NULL ||
+    Ustrstr(name, "Sans") != NULL)
+  n = sf_helvetica;
+else if (Ustrstr(name, "Courier") != NULL || Ustrstr(name, "Mono") != NULL)
+  n = sf_courier;
+else n = sf_times;
+
+if (Ustrstr(name, "Bold") != NULL) n += 1;
+if (Ustrstr(name, "Italic") != NULL || Ustrstr(name, "Oblique") != NULL)
+  n += 2;
+return n;
+}
+
+
+
+/*************************************************
+*          Find the width of a character         *
+*************************************************/
+
+/*
+Arguments:
+  font       the index of the standard font
+  offset     the font offset, as returned by font_char()
+  c          the code within the font
+
+Returns:     the width in thousandths of the font size
+*/
+
+static int
+char_width(int font, int offset, int c)
+{
+if (offset == 2 || font == sf_symbol) return symbol_widths[c];
+if (offset == 3 || font == sf_dingbats) return dingbats_widths[c];
+if (font >= sf_courier) return 600;
+c += offset * 256;
+return (c < encoding_count)? text_font_widths[font*encoding_count + c] : 0;
+}
+
+
+
+/*************************************************
+*         See if a font is used by strings       *
+*************************************************/
+
+/*
+Arguments:
+  b          the font binding
+  offset     the font offset, 0-3
+
+Returns:     TRUE if any string uses the font
+*/
+
+static BOOL
+font_needed(bindfont *b, int offset)
+{
+switch (offset)
+  {
+  case 0: return b->needLower;
+  case 1: return b->needUpper;
+  case 2: return b->needSymbol;
+  default: return b->needDingbats;
+  }
+}
+
+
+
+/*************************************************
+*             Objects and streams                *
+*************************************************/
+
+/* Start an object, remembering its offset for the cross-reference table. */
+
+static void
+start_object(int n)
+{
+offsets[n] = out_position();
+out_printf("%d 0 obj\n", n);
+}
+
+
+/* Start a stream object. Its length is written afterwards as the next object.
+A stream with a bounding box is a form XObject for a group.
+
+Arguments:
+  n          the object number
+  box        the bounding box, or NULL
+
+Returns:     the offset of the start of the data
+*/
+
+static long int
+start_stream(int n, dimen *box)
+{
+start_object(n);
+out_string(US"<<");
+if (box != NULL)
+  out_printf(" /Type /XObject /Subtype /Form /BBox [%F %F %F %F] "
+    "/Resources %d 0 R\n", box[0], box[1], box[2], box[3], obj_resources);
+out_printf(" /Length %d 0 R%s >>\nstream\n", n + 1,
+  testing? "" : " /Filter /FlateDecode");
+if (!testing) out_compress(ZIP_ZLIB);
+return out_position();
+}
+
+
+/* End a stream object, and write its length object.
+
+Arguments:
+  n          the object number
+  start      the offset of the start of the data
+
+Returns:     nothing
+*/
+
+static void
+end_stream(int n, long int start)
+{
+long int length;
+if (!testing) out_compress_end();
+length = out_position() - start;
+out_string(US"\nendstream\nendobj\n");
+start_object(n + 1);
+out_printf("%d\nendobj\n", (int)length);
+}
+
+
+/* Write a text string, escaping as necessary. If it is not all printing ASCII
+it is written in hex, as UTF-16 with a byte order mark. */
+
+static void
+write_text_string(uschar *s)
+{
+uschar *p;
+
+for (p = s; *p != 0; p++) if (*p < 32 || *p > 126) break;
+
+if (*p == 0)
+  {
+  out_char('(');
+  for (p = s; *p != 0; p++)
+    {
+    if (*p == '(' || *p == ')' || *p == '\\') out_char('\\');
+    out_char(*p);
+    }
+  out_char(')');
+  }
+
+else
+  {
+  out_string(US"<FEFF");
+  while (*s != 0)
+    {
+    int c;
+    GETCHARINC(c, s);
+    if (c < 0x10000) out_printf("%04X", c); else
+      {
+      c -= 0x10000;
+      out_printf("%04X%04X", 0xd800 + (c >> 10), 0xdc00 + (c & 0x3ff));
+      }
+    }
+  out_char('>');
+  }
+}
+
+
+
+/*************************************************
+*             Drawing functions                  *
+*************************************************/
+
+/* This is an absolute move. As in the PostScript output, a move to where the
+current path already ends is omitted, so that the path continues. */
+
+static
+void move(dimen x, dimen y)
+{
+x = x - bbox[0];
+y = y - bbox[1];
+if (path_open && llabs(x - current_x) < 10 && llabs(y - current_y) < 10) return;
+out_printf("%R %R m\n", x, y);
+current_x = x;
+current_y = y;
+path_open = TRUE;
+}
+
+
+/* Relative line */
+
+static void
+rline(dimen x, dimen y)
+{
+current_x += x;
+current_y += y;
+out_printf("%R %R l\n", current_x, current_y);
+}
+
+
+/* Relative bezier */
+
+static void
+rbezier(dimen x1, dimen y1, dimen x2, dimen y2, dimen x3, dimen y3)
+{
+out_printf("%R %R %R %R %R %R c\n", current_x + x1, current_y + y1,
+  current_x + x2, current_y + y2, current_x + x3, current_y + y3);
+current_x += x3;
+current_y += y3;
+}
+
+
+/* Fill and/or stroke the current path */
+
+static void
+paint(BOOL fill, BOOL stroke)
+{
+out_string(US (fill? (stroke? "B\n" : "f\n") : stroke? "S\n" : "n\n"));
+path_open = FALSE;
+}
+
+
+
+/*************************************************
+*          Set line thickness & colour           *
+*************************************************/
+
+static void
+set_thickness(dimen t)
+{
+if (t != set_linewidth)
+  {
+  if (t < minimum_thickness) t = minimum_thickness;
+  out_printf("%U w\n", t);
+  set_linewidth = t;
+  }
+}
+
+
+/* Fill and stroke colours are separate in PDF. */
+
+static void
+setcolour(colour c, BOOL stroke)
+{
+colour *set = stroke? &set_stroke_colour : &set_fill_colour;
+
+if (!samecolour(c, *set))
+  {
+  if (c.red == c.green && c.green == c.blue)
+    out_printf("%F %s\n", (dimen)c.red, stroke? "G" : "g");
+  else
+    out_printf("%F %F %F %s\n", (dimen)c.red, (dimen)c.green, (dimen)c.blue,
+      stroke? "RG" : "rg");
+  *set = c;
+  }
+}
+
+
+
+/*************************************************
+*                  Set dashedness                *
+*************************************************/
+
+static void
+set_dash(dimen dash1, dimen dash2)
+{
+if (dash1 != set_linedash1 || (dash1 != 0 && dash2 != set_linedash2))
+  {
+  if (dash1 == 0)
+    out_string(US"[] 0 d\n");
+  else
+    out_printf("[%U %U] 0 d\n", dash1, dash2);
+  set_linedash1 = dash1;
+  set_linedash2 = dash2;
+  }
+}
+
+
+
+/*************************************************
+*             Write strings                      *
+*************************************************/
+
+/* Write out all the string items attached to a given item. The characters in a
+single string may end up in more than one font. PDF has no way of measuring a
+string, so the widths of the standard fonts are used to position strings that
+are not left-justified. */
+
+static void
+write_strings(item *p)
+{
+stringchain *s = p->strings;
+dimen x, y;
+
+if (s == NULL) return;     /* There are no strings */
+stringpos(p, &x, &y);      /* Find the position for the strings */
+
+for (;;)
+  {
+  dimen depth;
+  uschar *ss = s->text;
+
+  if (*ss != 0)
+    {
+    bindfont *b;
+    int currentoffset = -1;
+    int font = sf_times;
+    dimen size = 12000;
+    dimen sx = x + s->xadjust - bbox[0];
+    dimen sy = y + s->yadjust - bbox[1];
+    double cosr = cos(s->rrotate);
+    double sinr = sin(s->rrotate);
+
+    for (b = font_base; b != NULL; b = b->next)
+      {
+      if (b->number == s->font)
+        {
+        font = std_font(b->name);
+        size = b->size;
+        break;
+        }
+      }
+
+    /* Adjust the start for the justification */
+
+    if (s->justify != just_left)
+      {
+      long int width = 0;
+      while (*ss != 0)
+        {
+        int c, offset;
+        GETCHARINC(c, ss);
+        c = font_char(c, &offset);
+        width += char_width(font, offset, c);
+        }
+      width = (width * size) / 1000;
+      if (s->justify != just_right) width /= 2;
+      sx -= (dimen)((double)width * cosr);
+      sy -= (dimen)((double)width * sinr);
+      ss = s->text;
+      }
+
+    setcolour(s->rgb, FALSE);
+    out_string(US"BT ");
+    if (s->rotate == 0) out_printf("%R %R Td\n", sx, sy); else
+      out_printf("%F %F %F %F %R %R Tm\n", (dimen)(cosr * 1000.0),
+        (dimen)(sinr * 1000.0), (dimen)(-sinr * 1000.0), (dimen)(cosr * 1000.0),
+        sx, sy);
+
+    while (*ss != 0)
+      {
+      int c, offset;
+      GETCHARINC(c, ss);
+      c = font_char(c, &offset);
+
+      if (offset != currentoffset)
+        {
+        if (currentoffset >= 0) out_string(US") Tj ");
+        out_printf("/F%d %U Tf (", 4*s->font + offset, size);
+        currentoffset = offset;
+        }
+
+      if (c == '(' || c == ')' || c == '\\') out_char('\\');
+      if (c >= 32 && c < 127) out_char(c);
+        else out_printf("\\%03o", c);
+      }
+
+    out_string(US") Tj ET\n");
+    }
+
+  /* Move on to the next string; if we are not done, move down by its depth,
+  where "down" may be in any direction for a rotated string. */
+
+  s = s->next;
+  if (s == NULL) break;
+
+  depth = find_linedepth(p, s);
+  if (s->rotate == 0) y -= depth; else
+    {
+    y -= (dimen)((double)depth * cos(s->rrotate));
+    x += (dimen)((double)depth * sin(s->rrotate));
+    }
+  }
+}
+
+
+
+/*************************************************
+*          Start and end line stroking/filling   *
+*************************************************/
+
+/* The graphics state for a path of lines, arcs, and curves is set when it
+starts, because it cannot be changed within the path. */
+
+static void
+start_line_fillstroke(void)
+{
+if (fillpending) setcolour(line_fill_colour, FALSE);
+if (strokepending)
+  {
+  setcolour(stroke_colour, TRUE);
+  set_thickness(stroke_thickness);
+  set_dash(stroke_dash1, stroke_dash2);
+  }
+}
+
+
+/* This function is called when any existing path should either be filled or
+stroked or both. Afterwards, output any texts that are associated with the
+lines of the path, from its start to the current item.
+
+Arguments:
+  current     the current item, or NULL if we're at the end
+
+Returns:      nothing
+*/
+
+static void
+end_line_fillstroke(item *current)
+{
+if (path_open) paint(fillpending, strokepending);
+
+while (pathstart != NULL && pathstart != current)
+  {
+  write_strings(pathstart);
+  pathstart = pathstart->next;
+  }
+
+line_fill_colour = unfilled;
+strokepending = fillpending = FALSE;
+pathstart = NULL;
+}
+
+
+
+/*************************************************
+*             Draw an arrow head                 *
+*************************************************/
+
+static void
+arrowhead(dimen x, dimen y, dimen xx, dimen yy, double angle, colour filled)
+{
+double s = sin(angle);
+double c = cos(angle);
+BOOL fill = !samecolour(filled, unfilled);
+
+dimen x1 = (dimen)((double)yy*s*0.5);
+dimen y1 = (dimen)((double)yy*c*0.5);
+dimen x2 = (dimen)((double)xx*c);
+dimen y2 = (dimen)((double)xx*s);
+
+if (fill) setcolour(filled, FALSE);
+set_thickness(400);
+setcolour(stroke_colour, TRUE);
+
+move(x, y);
+rline(x1, -y1);
+rline(x2 - x1, y2 + y1);
+rline(-x2 -x1, y1 - y2);
+rline(x1, -y1);
+paint(fill, TRUE);
+}
+
+
+
+/*************************************************
+*            Draw an elliptical arc              *
+*************************************************/
+
+static void
+arc(int clockwise, dimen x, dimen y, dimen radius1, dimen radius2, double angle1,
+  double angle2)
+{
+if (!clockwise)
+  {
+  while (angle1 > angle2) angle2 += 2.0*pi;
+  while (angle2 - angle1 > 0.5*pi)
+    {
+    smallarc(radius1, radius2, angle1, angle1 + 0.49*pi, rbezier);
+    angle1 += 0.49*pi;
+    }
+  }
+
+else
+  {
+  while (angle1 < angle2) angle2 -= 2.0*pi;
+  while (angle1 - angle2 > 0.5*pi)
+    {
+    smallarc(radius1, radius2, angle1, angle1 - 0.49*pi, rbezier);
+    angle1 -= 0.49*pi;
+    }
+  }
+
+smallarc(radius1, radius2, angle1, angle2, rbezier);
+
+at_x = x + (dimen)((double)radius1 * cos(angle2));
+at_y = y + (dimen)((double)radius2 * sin(angle2));
+}
+
+
+
+/*************************************************
+*               Process an arc                   *
+*************************************************/
+
+/*
+Arguments:
+  p               the arc item
+  move_needed     TRUE if move() needed
+  startx          where to move to
+  starty
+
+Returns:          nothing
+*/
+
+static void
+write_arc(item_arc *p, BOOL move_needed, dimen startx, dimen starty)
+{
+double radius = (double)p->radius;
+double angle1 = p->angle1;
+double angle2 = p->angle2;
+
+if (fillpending)
+  {
+  if (move_needed) move(startx, starty);
+  arc(p->cw, p->x, p->y, p->radius, p->radius, angle1, angle2);
+  return;
+  }
+
+/* Nothing to do if invisible, except write the strings. */
+
+if (p->style == is_invi)
+  {
+  write_strings((item *)p);
+  return;
+  }
+
+/* Draw the arc */
+
+if (move_needed) move(startx, starty);
+arc(p->cw, p->x, p->y, p->radius, p->radius, angle1, angle2);
+
+/* Draw the arrow heads as necessary; first ensure the path is drawn and texts
+upto and including this arc are output. */
+
+if (p->arrow_start || p->arrow_end)
+  {
+  double tilt = asin((double)(p->arrow_x) / (2.0*radius));
+
+  end_line_fillstroke((item *)p->next);
+  set_dash(0, 0);
+
+  if (p->arrow_start)
+    {
+    double angle = (p->cw)? (angle1 + pi/2.0 + tilt) : (angle1 - pi/2.0 - tilt);
+    arrowhead(p->x + (dimen)(radius * cos(angle1)), p->y + (dimen)(radius * sin(angle1)),
+      p->arrow_x, p->arrow_y, angle, p->arrow_filled);
+    }
+
+  if (p->arrow_end)
+    {
+    double angle = (p->cw)? (angle2 - pi/2.0 - tilt) : (angle2 + pi/2.0 + tilt);
+    arrowhead(p->x + (dimen)(radius * cos(angle2)), p->y + (dimen)(radius * sin(angle2)),
+      p->arrow_x, p->arrow_y, angle, p->arrow_filled);
+    }
+  }
+}
+
+
+
+/*************************************************
+*               Process a curve                  *
+*************************************************/
+
+/*
+Arguments:
+  p               the arc item
+  move_needed     TRUE if move() needed
+
+Returns:          nothing
+*/
+
+static void
+write_curve(item_curve *p, BOOL move_needed)
+{
+at_x = p->x1;
+at_y = p->y1;
+
+if (fillpending)
+  {
+  if (move_needed) move(p->x0, p->y0);
+  rbezier(p->cx1, p->cy1, p->cx2, p->cy2, p->x1 - p->x0, p->y1 - p->y0);
+  return;
+  }
+
+/* Nothing to do if invisible, except write the strings. */
+
+if (p->style == is_invi)
+  {
+  write_strings((item *)p);
+  return;
+  }
+
+/* Draw the curve */
+
+if (move_needed) move(p->x0, p->y0);
+rbezier(p->cx1, p->cy1, p->cx2, p->cy2, p->x1 - p->x0, p->y1 - p->y0);
+}
+
+
+
+/*************************************************
+*              Process a box                     *
+*************************************************/
+
+/* Note that circles and ellipses are coded as special kinds of "box" */
+
+static void
+write_box(item_box *p)
+{
+dimen x = p->x;
+dimen y = p->y;
+dimen width = p->width;
+dimen depth = p->depth;
+BOOL fill, stroke;
+
+/* A placed group draws its form, transformed to the placement. */
+
+if (p->boxtype == box_place)
+  {
+  item_place *pp = (item_place *)p;
+  dimen a = pp->scale, b = 0;
+  if (pp->rotate != 0)
+    {
+    double r = (double)pp->rotate * pi / 180000.0;
+    a = (dimen)((double)pp->scale * cos(r));
+    b = (dimen)((double)pp->scale * sin(r));
+    }
+  out_printf("q %F %F %F %F %R %R cm /G%d Do Q\n", a, b, -b, a,
+    x + pp->originx - bbox[0], y + pp->originy - bbox[1],
+    pp->group->number);
+  write_strings((item *)p);
+  return;
+  }
+
+/* If invisible, just write the strings, unless filled */
+
+fill = !samecolour(p->shapefilled, unfilled);
+stroke = p->style != is_invi;
+
+if (!stroke && !fill)
+  {
+  write_strings((item *)p);
+  return;
+  }
+
+if (fill) setcolour(p->shapefilled, FALSE);
+if (stroke)
+  {
+  set_thickness(p->thickness);
+  set_dash(p->dash1, p->dash2);
+  setcolour(p->colour, TRUE);
+  }
+
+/* Draw a rectangular box */
+
+if (p->boxtype == box_box)
+  {
+  move(x - width/2, y - depth/2);
+  rline(width, 0);
+  rline(0, depth);
+  rline(-width, 0);
+  }
+
+/* Draw a circle or ellipse */
+
+else
+  {
+  move(x + width/2, y);
+  arc(FALSE, x, y, width/2, depth/2, 0.0, 2.0*pi);
+  }
+
+out_string(US"h\n");
+paint(fill, stroke);
+write_strings((item *)p);
+}
+
+
+
+/*************************************************
+*          Process a polyline or polygon         *
+*************************************************/
+
+/* The whole path is written at once, as a move followed by lines, or curves
+for a spline. */
+
+static void
+write_poly(item_poly *p)
+{
+dimen *pp = p->points;
+dimen *ppend = pp + 2*p->count;
+BOOL fill = !samecolour(p->shapefilled, unfilled);
+BOOL stroke = p->style != is_invi;
+
+if (!stroke && !fill)
+  {
+  write_strings((item *)p);
+  return;
+  }
+
+if (fill) setcolour(p->shapefilled, FALSE);
+if (stroke)
+  {
+  set_thickness(p->thickness);
+  set_dash(p->dash1, p->dash2);
+  setcolour(p->colour, TRUE);
+  }
+
+move(pp[0], pp[1]);
+
+if (p->smooth) for (pp += 2; pp < ppend; pp += 6)
+  {
+  out_printf("%R %R %R %R %R %R c\n", pp[0] - bbox[0], pp[1] - bbox[1],
+    pp[2] - bbox[0], pp[3] - bbox[1], pp[4] - bbox[0], pp[5] - bbox[1]);
+  }
+
+else for (pp += 2; pp < ppend; pp += 2)
+  out_printf("%R %R l\n", pp[0] - bbox[0], pp[1] - bbox[1]);
+
+if (p->closed) out_string(US"h\n");
+paint(fill, stroke);
+
+at_x = p->x1;
+at_y = p->y1;
+write_strings((item *)p);
+}
+
+
+
+/*************************************************
+*               Process a line                   *
+*************************************************/
+
+static void
+write_line(item_line *p, BOOL move_needed)
+{
+double angle = 0.0;
+dimen x1 = p->x, y1 = p->y;
+dimen xw = p->width, yd = p->depth;
+dimen xx = 0, yy = 0;
+
+/* Filling: generate the line even if it is invisible; no arrow can be
+involved. */
+
+if (fillpending)
+  {
+  if (move_needed) move(x1, y1);
+  rline(xw, yd);
+  at_x = x1 + xw;
+  at_y = y1 + yd;
+  return;
+  }
+
+/* Not filling; no need to do anything for an invisible line, except write the
+strings. Otherwise, arrange to draw the line before any arrow heads so that a
+forward arrow joined onto a previous line gets the benefit of appropriate
+corner processing. */
+
+if (p->style == is_invi)
+  {
+  write_strings((item *)p);
+  return;
+  }
+
+/* If this is an arrow, compute data for arrow heads */
+
+if (p->arrow_start || p->arrow_end)
+  {
+  angle = atan2((double)p->depth, (double)p->width);
+  xx = (dimen)(((double)p->arrow_x) * cos(angle));
+  yy = (dimen)(((double)p->arrow_x) * sin(angle));
+  }
+
+/* Adjust the line according to the arrow heads. */
+
+if (p->arrow_start)
+  {
+  x1 += xx;
+  y1 += yy;
+  xw -= xx;
+  yd -= yy;
+  }
+
+if (p->arrow_end)
+  {
+  xw -= xx;
+  yd -= yy;
+  }
+
+/* Now draw the line */
+
+if (move_needed) move(x1, y1);
+rline(xw, yd);
+at_x = x1 + xw;
+at_y = y1 + yd;
+
+/* Now draw the arrow heads if required; ensure that this line's texts
+are output. */
+
+if (p->arrow_start)
+  {
+  end_line_fillstroke((item *)p->next);
+  set_dash(0, 0);
+  arrowhead(x1, y1, p->arrow_x, p->arrow_y, angle + pi, p->arrow_filled);
+  }
+
+if (p->arrow_end)
+  {
+  end_line_fillstroke((item *)p->next);
+  set_dash(0, 0);
+  arrowhead(x1 + xw, y1 + yd, p->arrow_x, p->arrow_y, angle, p->arrow_filled);
+  }
+}
+
+
+
+/*************************************************
+*            Write a chain of items              *
+*************************************************/
+
+/* This is called for the main chain of items, and for the items in each group
+that is placed. The items are drawn in level order, as sorted by sort_items(),
+keeping their original order within each level.
+
+Argument:   the start of the chain
+Returns:    nothing
+*/
+
+static void
+write_items(item *base)
+{
+int count;
+item *prev = NULL;
+item **sorted = sort_items(base, &count);
+
+for (int i = 0; i < count; i++)
+  {
+  item *p = sorted[i];
+  BOOL restart = FALSE;
+  BOOL move_needed = FALSE;
+  dimen startx = 0, starty = 0;
+  item_arc *ppa;
+  item_curve *ppc;
+  item_line *ppl;
+
+  /* A path cannot continue to an item at a different level, or across an
+  item at another level in the chain. */
+
+  if (prev != NULL && (prev->level != p->level || prev->next != p))
+    end_line_fillstroke(prev->next);
+  prev = p;
+
+  switch (p->type)
+    {
+    case i_arc:
+    ppa = (item_arc *)p;
+    if (ppa->arrow_start) restart = TRUE;
+    startx = p->x + (dimen)((double)ppa->radius * cos(ppa->angle1));
+    starty = p->y + (dimen)((double)ppa->radius * sin(ppa->angle1));
+    goto ARCLINE;
+
+    case i_curve:
+    ppc = (item_curve *)p;
+    startx = ppc->x0;
+    starty = ppc->y0;
+    goto ARCLINE;
+
+    case i_line:
+    ppl = (item_line *)p;
+    if (ppl->arrow_start) restart = TRUE;
+    startx = p->x;
+    starty = p->y;
+
+    /* Common code for lines and arcs and curves */
+
+    ARCLINE:
+
+    if (startx != at_x || starty != at_y) restart = TRUE;
+
+    /* Sort out the other conditions under which we have to terminate an
+    existing path. */
+
+    if (!samecolour(p->shapefilled, fillpending? line_fill_colour : unfilled))
+      restart = TRUE;
+
+    if (strokepending)
+      {
+      if (!samecolour(p->colour, stroke_colour) ||
+          p->style == is_invi ||
+          stroke_thickness != p->thickness ||
+          stroke_dash1 != p->dash1 ||
+          stroke_dash2 != p->dash2)
+        restart = TRUE;
+      }
+    else
+      {
+      if (p->style != is_invi) restart = TRUE;
+      }
+
+    /* If starting a new path, end any previous one. */
+
+    if (restart) end_line_fillstroke(p);
+
+    /* Start stroking */
+
+    if (!strokepending && p->style != is_invi)
+      {
+      stroke_thickness = p->thickness;
+      stroke_dash1 = p->dash1;
+      stroke_dash2 = p->dash2;
+      stroke_colour = p->colour;
+      strokepending = TRUE;
+      pathstart = p;
+      move_needed = TRUE;
+      }
+
+    /* Start filling */
+
+    if (!fillpending && !samecolour(p->shapefilled, unfilled))
+      {
+      line_fill_colour = p->shapefilled;
+      fillpending = TRUE;
+      pathstart = p;
+      move_needed = TRUE;
+      }
+
+    if (move_needed) start_line_fillstroke();
+
+    /* Write the arc or the line or the curve */
+
+    if (p->type == i_arc)
+      write_arc((item_arc *)p, move_needed, startx, starty);
+    else if (p->type == i_curve)
+      write_curve((item_curve *)p, move_needed);
+    else
+      write_line((item_line *)p, move_needed);
+    break;
+
+    case i_box:
+    end_line_fillstroke(p);
+    write_box((item_box *)p);
+    break;
+
+    case i_poly:
+    end_line_fillstroke(p);
+    write_poly((item_poly *)p);
+    break;
+
+    case i_text:
+    end_line_fillstroke(p);
+    write_strings(p);
+    break;
+    }
+  }
+
+end_line_fillstroke((prev == NULL)? NULL : prev->next);
+}
+
+
+
+/*************************************************
+*          Write the definition of a group       *
+*************************************************/
+
+/* Each group that is placed is written once, as a form XObject whose content
+draws its items relative to the origin. The cached graphics state is made
+unknown while the form is written, so that it sets everything it uses; a form
+is drawn in a saved graphics state, so the state outside is unaffected.
+
+Argument:   the most recently defined group not yet considered
+Returns:    nothing
+*/
+
+static void
+write_groups(group *g)
+{
+long int start;
+dimen save_bbox0 = bbox[0];
+dimen save_bbox1 = bbox[1];
+colour save_fill_colour = set_fill_colour;
+colour save_stroke_colour = set_stroke_colour;
+dimen save_linewidth = set_linewidth;
+dimen save_linedash1 = set_linedash1;
+dimen save_linedash2 = set_linedash2;
+
+if (g == NULL) return;
+write_groups(g->next);
+if (!g->used) return;
+
+bbox[0] = bbox[1] = 0;
+set_fill_colour = set_stroke_colour = unfilled;
+set_linewidth = set_linedash1 = -1;
+at_x = at_y = 0;
+
+start = start_stream(group_objects[g->number], g->bbox);
+write_items(g->items);
+end_stream(group_objects[g->number], start);
+
+bbox[0] = save_bbox0;
+bbox[1] = save_bbox1;
+set_fill_colour = save_fill_colour;
+set_stroke_colour = save_stroke_colour;
+set_linewidth = save_linewidth;
+set_linedash1 = save_linedash1;
+set_linedash2 = save_linedash2;
+at_x = at_y = 0;
+}
+
+
+
+/*************************************************
+*         Write an encoding for the text fonts   *
+*************************************************/
+
+/*
+Arguments:
+  n          the object number
+  first      the first name in encoding_names
+  count      the number of names
+
+Returns:     nothing
+*/
+
+static void
+write_encoding(int n, int first, int count)
+{
+int len = 0;
+start_object(n);
+out_string(US"<< /Type /Encoding /Differences [0");
+for (int i = first; i < first + count; i++)
+  {
+  int l = (int)strlen(encoding_names[i]) + 1;
+  if ((len += l) > 72) { out_char('\n'); len = l; }
+  out_printf("/%s", encoding_names[i]);
+  }
+out_string(US"] >>\nendobj\n");
+}
+
+
+
+/*************************************************
+*             Write PDF output file              *
+*************************************************/
+
+/* The coordinates are adjusted so that the bottom left of the bounding box is
+at (0,0). The objects are written in numerical order, except that the groups
+are written in the order they were defined. */
+
+void
+write_pdf(void)
+{
+tree_node *tn;
+group *g;
+dimen bboxthick = (drawbbox == NULL)? 0 : drawbbox->thickness;
+int object_count = obj_fonts;
+int font_count = 0;
+int group_count = 0;
+long int start, xref;
+
+set_fill_colour = set_stroke_colour = black;
+set_linewidth = -1;
+set_linedash1 = set_linedash2 = 0;
+line_fill_colour = unfilled;
+strokepending = FALSE;
+fillpending = FALSE;
+path_open = FALSE;
+pathstart = NULL;
+at_x = at_y = 0;
+
+/* Find the bounding box. */
+
+find_bbox(bbox);
+
+/* Count the objects. There are up to four fonts for each binding, depending
+on what the strings use, and two objects for each group that is placed. The
+groups are numbered from 1 in the order they were defined, so the most recent
+one has the largest number. */
+
+if (strings_exist) for (bindfont *b = font_base; b != NULL; b = b->next)
+  for (int i = 0; i < 4; i++) if (font_needed(b, i)) font_count++;
+object_count += font_count;
+
+if (group_base != NULL)
+  {
+  group_objects = getstore((group_base->number + 1) * sizeof(int));
+  for (g = group_base; g != NULL; g = g->next)
+    {
+    if (!g->used) continue;
+    group_objects[g->number] = object_count;
+    object_count += 2;
+    group_count++;
+    }
+  }
+
+offsets = getstore(object_count * sizeof(long int));
+
+/* Output the header, with a comment that contains binary characters, as is
+recommended, and the document structure. */
+
+out_string(US"%PDF-1.4\n%\342\343\317\323\n");
+
+start_object(obj_catalog);
+out_printf("<< /Type /Catalog /Pages %d 0 R >>\nendobj\n", obj_pages);
+
+start_object(obj_pages);
+out_printf("<< /Type /Pages /Kids [%d 0 R] /Count 1 >>\nendobj\n", obj_page);
+
+start_object(obj_page);
+out_printf("<< /Type /Page /Parent %d 0 R /MediaBox [0 0 %F %F]\n"
+  "/Resources %d 0 R /Contents %d 0 R >>\nendobj\n", obj_pages,
+  bbox[2] - bbox[0] + bboxthick, bbox[3] - bbox[1] + bboxthick,
+  obj_resources, obj_contents);
+
+/* The resources are shared by the page and the groups. The fonts are named as
+in the PostScript output. */
+
+start_object(obj_resources);
+out_string(US"<< /ProcSet [/PDF /Text]");
+
+if (font_count > 0)
+  {
+  int n = obj_fonts;
+  out_string(US"\n/Font <<");
+  for (bindfont *b = font_base; b != NULL; b = b->next)
+    {
+    for (int i = 0; i < 4; i++)
+      {
+      if (!font_needed(b, i)) continue;
+      out_printf(" /F%d %d 0 R", 4*b->number + i, n++);
+      }
+    }
+  out_string(US" >>");
+  }
+
+if (group_count > 0)
+  {
+  out_string(US"\n/XObject <<");
+  for (g = group_base; g != NULL; g = g->next)
+    if (g->used) out_printf(" /G%d %d 0 R", g->number, group_objects[g->number]);
+  out_string(US" >>");
+  }
+
+out_string(US" >>\nendobj\n");
+
+/* Document information */
+
+start_object(obj_info);
+out_string(US"<< /Title ");
+tn = tree_search(varroot, US"title");
+write_text_string(tn->value);
+out_string(US"\n/Creator ");
+tn = tree_search(varroot, US"creator");
+write_text_string(tn->value);
+out_printf("\n/Producer (Aspic%s%s) >>\nendobj\n", testing? "" : " ",
+  testing? "" : Version_String);
+
+/* The page contents */
+
+start = start_stream(obj_contents, NULL);
+
+/* Draw a bounding box frame if wanted */
+
+if (drawbbox != NULL)
+  {
+  drawbbox->width = bbox[2] - bbox[0];
+  drawbbox->depth = bbox[3] - bbox[1];
+  drawbbox->x = bbox[0] + drawbbox->width/2 + drawbbox->thickness/2;
+  drawbbox->y = bbox[1] + drawbbox->depth/2 + drawbbox->thickness/2;
+  write_box(drawbbox);
+  }
+
+/* Now process the items */
+
+write_items(main_item_base);
+end_stream(obj_contents, start);
+
+/* The text fonts use the same two encodings as in the PostScript output,
+except that the Symbol and Dingbats fonts keep their own. */
+
+write_encoding(obj_lower, 0, 256);
+write_encoding(obj_upper, 256, encoding_count - 256);
+
+if (font_count > 0)
+  {
+  int n = obj_fonts;
+  for (bindfont *b = font_base; b != NULL; b = b->next)
+    {
+    int font = std_font(b->name);
+    for (int i = 0; i < 4; i++)
+      {
+      if (!font_needed(b, i)) continue;
+      start_object(n++);
+      out_printf("<< /Type /Font /Subtype /Type1 /BaseFont /%s",
+        std_fonts[(i == 2)? sf_symbol : (i == 3)? sf_dingbats : font]);
+      if (i < 2 && font < sf_symbol)
+        out_printf(" /Encoding %d 0 R", (i == 0)? obj_lower : obj_upper);
+      out_string(US" >>\nendobj\n");
+      }
+    }
+  }
+
+/* Define the groups that are placed */
+
+write_groups(group_base);
+
+/* The cross-reference table; each entry must be exactly 20 bytes. */
+
+xref = out_position();
+out_printf("xref\n0 %d\n0000000000 65535 f \n", object_count);
+for (int i = 1; i < object_count; i++)
+  out_printf("%010d 00000 n \n", (int)offsets[i]);
+
+out_printf("trailer\n<< /Size %d /Root %d 0 R /Info %d 0 R >>\n"
+  "startxref\n%d\n%%%%EOF\n", object_count, obj_catalog, obj_info, (int)xref);
+}
+
+/* End of wrpdf.c */
@@ -16,28 +16,44 @@
 *               Local variables                  *
 *************************************************/
 
-static int bbox[4];
+static dimen bbox[4];
 
 static colour line_fill_colour;
 static colour stroke_colour;
 static colour set_colour;
 
-static int  set_linedash1;
-static int  set_linedash2;
-static int  set_linewidth;
+static dimen set_linedash1;
+static dimen set_linedash2;
+static dimen set_linewidth;
 
-static int  stroke_thickness;
-static int  stroke_dash1;
-static int  stroke_dash2;
+static dimen stroke_thickness;
+static dimen stroke_dash1;
+static dimen stroke_dash2;
 
-static int  at_x;
-static int  at_y;
+static dimen at_x;
+static dimen at_y;
 
 static BOOL fillpending;
 static BOOL strokepending;
 
 static item *pathstart;
 
+/* The operators that are used for each segment of a path, and for setting its
+properties, are output via this table. In compact mode (-epsmin) each of them
+is bound to a one-letter name in the prolog. */
+
+enum { op_move, op_line, op_curve, op_width, op_grey, op_rgb, op_dash,
+  op_stroke, op_fill, op_close, op_count };
+
+static const char *op_full[] = { "mymove", "rlineto", "rcurveto",
+  "setlinewidth", "setgray", "setrgbcolor", "setdash", "stroke", "fill",
+  "closepath" };
+
+static const char *op_short[] = { "M", "L", "C", "W", "G", "K", "D", "S", "F",
+  "P" };
+
+static const char **op = op_full;
+
 
 
 /*************************************************
@@ -53,6 +69,7 @@ f->next = font_base;
 font_base = f;
 f->number = 0;
 f->size = 12000;
+f->needLower = f->needUpper = FALSE;
 f->needSymbol = f->needDingbats = FALSE;
 Ustrcpy(f->name, "Times-Roman");
 
@@ -68,32 +85,30 @@ resolution = 120;       /* 0.12 == 600 dpi for default resolution */
 /* This is an absolute move. */
 
 static
-void move(int x, int y)
+void move(dimen x, dimen y)
 {
 x = x - bbox[0];
 y = y - bbox[1];
-fprintf(out_file, "%s %s mymove\n", fixed(rnd(x)), fixed(rnd(y)));
+out_printf("%R %R %s\n", x, y, op[op_move]);
 }
 
 
 /* Relative line */
 
 static void
-rline(int x, int y)
+rline(dimen x, dimen y)
 {
-fprintf(out_file, "%s %s rlineto\n", fixed(rnd(x)), fixed(rnd(y)));
+out_printf("%R %R %s\n", x, y, op[op_line]);
 }
 
 
 /* Relative bezier */
 
 static void
-rbezier(int x1, int y1, int x2, int y2, int x3, int y3)
+rbezier(dimen x1, dimen y1, dimen x2, dimen y2, dimen x3, dimen y3)
 {
-fprintf(out_file, "%s %s %s %s %s %s rcurveto\n",
-  fixed(rnd(x1)), fixed(rnd(y1)),
-  fixed(rnd(x2)), fixed(rnd(y2)),
-  fixed(rnd(x3)), fixed(rnd(y3)));
+out_printf("%R %R %R %R %R %R %s\n", x1, y1, x2, y2, x3, y3,
+  op[op_curve]);
 }
 
 
@@ -103,12 +118,12 @@ fprintf(out_file, "%s %s %s %s %s %s rcurveto\n",
 *************************************************/
 
 static void
-set_thickness(int t)
+set_thickness(dimen t)
 {
 if (t != set_linewidth)
   {
   if (t < minimum_thickness) t = minimum_thickness;
-  fprintf(out_file, "%s setlinewidth\n", CS fixed(t));
+  out_printf("%U %s\n", t, op[op_width]);
   set_linewidth = t;
   }
 }
@@ -122,12 +137,12 @@ if (c.red   != set_colour.red ||
   {
   if (c.red == c.green && c.green == c.blue)
     {
-    fprintf(out_file, "%s setgray\n", fixed(c.red));
+    out_printf("%F %s\n", (dimen)c.red, op[op_grey]);
     }
   else
     {
-    fprintf(out_file, "%s %s %s setrgbcolor\n",
-      fixed(c.red), fixed(c.green), fixed(c.blue));
+    out_printf("%F %F %F %s\n", (dimen)c.red, (dimen)c.green, (dimen)c.blue,
+      op[op_rgb]);
     }
   set_colour = c;
   }
@@ -140,14 +155,14 @@ if (c.red   != set_colour.red ||
 *************************************************/
 
 static void
-set_dash(int dash1, int dash2)
+set_dash(dimen dash1, dimen dash2)
 {
 if (dash1 != set_linedash1 || (dash1 != 0 && dash2 != set_linedash2))
   {
   if (dash1 == 0)
-    fprintf(out_file, "[] 0 setdash\n");
+    out_printf("[] 0 %s\n", op[op_dash]);
   else
-    fprintf(out_file, "[%s %s] 0 setdash\n", CS fixed(dash1), CS fixed(dash2));
+    out_printf("[%U %U] 0 %s\n", dash1, dash2, op[op_dash]);
   set_linedash1 = dash1;
   set_linedash2 = dash2;
   }
@@ -166,14 +181,14 @@ static void
 write_strings(item *p)
 {
 stringchain *s = p->strings;
-int x, y;
+dimen x, y;
 
 if (s == NULL) return;     /* There are no strings */
 stringpos(p, &x, &y);      /* Find the position for the strings */
 
 for (;;)
   {
-  int depth;
+  dimen depth;
   uschar *ss = s->text;
 
   if (*ss != 0)
@@ -188,81 +203,30 @@ for (;;)
       {
       int c, offset;
       GETCHARINC(c, ss);
-
-      /* Chars < 256 are in the first PS font, Unicode encoded */
-
-      if (c < 256) offset = 0;
-
-      /* Chars < 384 are in the second PS font, Unicode encoded - 256 */
-
-      else if (c < 384) { offset = 1; c -= 256; }
-
-      /* Seek for non-Unicode encoded in the second PS font; if not found,
-      seek characters in the Special or Dingbats fonts. */
-
-      else
-        {
-        int i;
-        for (i = 0; i < nonucount; i++)
-          {
-          if (c == nonulist[i])
-            {
-            offset = 1;
-            c = i + 128;
-            break;
-            }
-          }
-
-        if (i >= nonucount)
-          {
-          u2sencod *bot, *mid, *top;
-
-          bot = u2slist;
-          top = u2slist + u2scount;
-          while (top > bot)
-            {
-            mid = bot + (top - bot)/2;
-            if (c == mid->ucode) break;
-            if (mid->ucode < c ) bot = mid + 1; else top = mid;
-            }
-
-          if (top > bot)
-            {
-            offset = (mid->which == SF_SYMB)? 2 : 3;
-            c = mid->scode;
-            }
-          else
-            {
-            c = 0x00a4;    /* Currency symbol for "unknown" */
-            offset = 0;
-            }
-          }
-        }
-
-      /* We now have the value within the font and the font offset */
+      c = font_char(c, &offset);
 
       if (offset != currentoffset)
         {
-        if (currentoffset >= 0) fprintf(out_file, ") ");
-        fprintf(out_file, "f%d (", 4*s->font + offset);
+        if (currentoffset >= 0) out_string(US") ");
+        out_printf("f%d (", 4*s->font + offset);
         currentoffset = offset;
         count++;
         }
 
-      if (c == '(' || c == ')' || c == '\\') fputc('\\', out_file);
-      if (c >= 32 && c < 127) fputc(c, out_file);
-        else fprintf(out_file, "\\%.03o", c);
+      if (c == '(' || c == ')' || c == '\\') out_char('\\');
+      if (c >= 32 && c < 127) out_char(c);
+        else out_printf("\\%03o", c);
       }
 
-    fprintf(out_file, ") %d ", count);
-    if (s->rotate != 0) fprintf(out_file, "%s rot ", fixed(s->rotate));
+    out_printf(") %d ", count);
+    if (s->rotate != 0) out_printf("%F rot ", s->rotate);
 
-    fprintf(out_file, "%s",
+    out_string(
       (s->justify == just_left)? US"leftshow" :
       (s->justify == just_right)? US"rightshow" : US"centreshow");
 
-    if (s->rotate != 0) fprintf(out_file, " grestore");
-    fprintf(out_file, "\n");
+    if (s->rotate != 0) out_string(US" grestore");
+    out_char('\n');
     }
 
   /* Move on to the next string; if we are not done, move down by its depth,
@@ -274,8 +238,8 @@ for (;;)
   depth = find_linedepth(p, s);
   if (s->rotate == 0) y -= depth; else
     {
-    y -= (int)((double)depth * cos(s->rrotate));
-    x += (int)((double)depth * sin(s->rrotate));
+    y -= (dimen)((double)depth * cos(s->rrotate));
+    x += (dimen)((double)depth * sin(s->rrotate));
     }
   }
 }
@@ -302,8 +266,8 @@ end_line_fillstroke(item *current)
 if (line_fill_colour.red != unfilled.red)
   {
   setcolour(line_fill_colour);
-  if (strokepending) fprintf(out_file, "gsave fill grestore\n");
-    else fprintf(out_file, "fill\n");
+  if (strokepending) out_printf("gsave %s grestore\n", op[op_fill]);
+    else out_printf("%s\n", op[op_fill]);
   }
 
 if (strokepending)
@@ -311,7 +275,7 @@ if (strokepending)
   setcolour(stroke_colour);
   set_thickness(stroke_thickness);
   set_dash(stroke_dash1, stroke_dash2);
-  fprintf(out_file, "stroke\n");
+  out_printf("%s\n", op[op_stroke]);
   }
 
 while (pathstart != NULL && pathstart != current)
@@ -332,15 +296,15 @@ pathstart = NULL;
 *************************************************/
 
 static void
-arrowhead(int x, int y, int xx, int yy, double angle, colour filled)
+arrowhead(dimen x, dimen y, dimen xx, dimen yy, double angle, colour filled)
 {
 double s = sin(angle);
 double c = cos(angle);
 
-int x1 = (int )((double)yy*s*0.5);
-int y1 = (int )((double)yy*c*0.5);
-int x2 = (int )((double)xx*c);
-int y2 = (int )((double)xx*s);
+dimen x1 = (dimen)((double)yy*s*0.5);
+dimen y1 = (dimen)((double)yy*c*0.5);
+dimen x2 = (dimen)((double)xx*c);
+dimen y2 = (dimen)((double)xx*s);
 
 move(x, y);
 rline(x1, -y1);
@@ -351,12 +315,12 @@ rline(x1, -y1);
 if (filled.red != unfilled.red)
   {
   setcolour(filled);
-  fprintf(out_file, "gsave fill grestore\n");
+  out_printf("gsave %s grestore\n", op[op_fill]);
   }
 
 set_thickness(400);
 setcolour(stroke_colour);
-fprintf(out_file, "stroke\n");
+out_printf("%s\n", op[op_stroke]);
 }
 
 
@@ -366,7 +330,7 @@ fprintf(out_file, "stroke\n");
 *************************************************/
 
 static void
-arc(int clockwise, int x, int y, int radius1, int radius2, double angle1,
+arc(int clockwise, dimen x, dimen y, dimen radius1, dimen radius2, double angle1,
   double angle2)
 {
 if (!clockwise)
@@ -391,8 +355,8 @@ else
 
 smallarc(radius1, radius2, angle1, angle2, rbezier);
 
-at_x = x + (int )((double)radius1 * cos(angle2));
-at_y = y + (int )((double)radius2 * sin(angle2));
+at_x = x + (dimen)((double)radius1 * cos(angle2));
+at_y = y + (dimen)((double)radius2 * sin(angle2));
 }
 
 
@@ -412,7 +376,7 @@ Returns:          nothing
 */
 
 static void
-write_arc(item_arc *p, BOOL move_needed, int startx, int starty)
+write_arc(item_arc *p, BOOL move_needed, dimen startx, dimen starty)
 {
 double radius = (double)p->radius;
 double angle1 = p->angle1;
@@ -451,14 +415,14 @@ if (p->arrow_start || p->arrow_end)
   if (p->arrow_start)
     {
     double angle = (p->cw)? (angle1 + pi/2.0 + tilt) : (angle1 - pi/2.0 - tilt);
-    arrowhead(p->x + (int)(radius * cos(angle1)), p->y + (int)(radius * sin(angle1)),
+    arrowhead(p->x + (dimen)(radius * cos(angle1)), p->y + (dimen)(radius * sin(angle1)),
       p->arrow_x, p->arrow_y, angle, p->arrow_filled);
     }
 
   if (p->arrow_end)
     {
     double angle = (p->cw)? (angle2 - pi/2.0 - tilt) : (angle2 + pi/2.0 + tilt);
-    arrowhead(p->x + (int )(radius * cos(angle2)), p->y + (int )(radius * sin(angle2)),
+    arrowhead(p->x + (dimen)(radius * cos(angle2)), p->y + (dimen)(radius * sin(angle2)),
       p->arrow_x, p->arrow_y, angle, p->arrow_filled);
     }
   }
@@ -516,10 +480,25 @@ rbezier(p->cx1, p->cy1, p->cx2, p->cy2, p->x1 - p->x0, p->y1 - p->y0);
 static void
 write_box(item_box *p)
 {
-int x = p->x;
-int y = p->y;
-int width = p->width;
-int depth = p->depth;
+dimen x = p->x;
+dimen y = p->y;
+dimen width = p->width;
+dimen depth = p->depth;
+
+/* A placed group calls its procedure, transformed to the placement. */
+
+if (p->boxtype == box_place)
+  {
+  item_place *pp = (item_place *)p;
+  out_printf("gsave %R %R translate",
+    x + pp->originx - bbox[0],
+    y + pp->originy - bbox[1]);
+  if (pp->rotate != 0) out_printf(" %F rotate", pp->rotate);
+  if (pp->scale != 1000) out_printf(" %F dup scale", pp->scale);
+  out_printf(" G%d grestore\n", pp->group->number);
+  write_strings((item *)p);
+  return;
+  }
 
 /* If invisible, just write the strings, unless filled */
 
@@ -547,17 +526,87 @@ else
   arc(FALSE, x, y, width/2, depth/2, 0.0, 2.0*pi);
   }
 
-fprintf(out_file, "closepath\n");
+out_printf("%s\n", op[op_close]);
+
+/* Handle filling and stroking */
+
+if (!samecolour(p->shapefilled, unfilled))
+  {
+  if (p->style != is_invi) out_string(US"gsave ");
+  setcolour(p->shapefilled);
+  out_string(US op[op_fill]);
+  if (p->style != is_invi) out_string(US" grestore");
+  out_char('\n');
+  }
+
+if (p->style != is_invi)
+  {
+  set_thickness(p->thickness);
+  set_dash(p->dash1, p->dash2);
+  setcolour(p->colour);
+  out_printf("%s\n", op[op_stroke]);
+  }
+
+write_strings((item *)p);
+}
+
+
+
+/*************************************************
+*          Process a polyline or polygon         *
+*************************************************/
+
+/* The whole path is written at once, as a move followed by relative lines, or
+relative curves for a spline. Each line or curve goes between rounded absolute
+positions, so that rounding errors do not accumulate along the path. */
+
+static void
+write_poly(item_poly *p)
+{
+dimen *pp = p->points;
+dimen *ppend = pp + 2*p->count;
+dimen lastx, lasty;
+
+if (p->style == is_invi && samecolour(p->shapefilled, unfilled))
+  {
+  write_strings((item *)p);
+  return;
+  }
+
+move(pp[0], pp[1]);
+lastx = rnd(pp[0] - bbox[0]);
+lasty = rnd(pp[1] - bbox[1]);
+
+if (p->smooth) for (pp += 2; pp < ppend; pp += 6)
+  {
+  dimen x = rnd(pp[4] - bbox[0]);
+  dimen y = rnd(pp[5] - bbox[1]);
+  rbezier(pp[0] - bbox[0] - lastx, pp[1] - bbox[1] - lasty,
+    pp[2] - bbox[0] - lastx, pp[3] - bbox[1] - lasty, x - lastx, y - lasty);
+  lastx = x;
+  lasty = y;
+  }
+
+else for (pp += 2; pp < ppend; pp += 2)
+  {
+  dimen x = rnd(pp[0] - bbox[0]);
+  dimen y = rnd(pp[1] - bbox[1]);
+  rline(x - lastx, y - lasty);
+  lastx = x;
+  lasty = y;
+  }
+
+if (p->closed) out_printf("%s\n", op[op_close]);
 
 /* Handle filling and stroking */
 
 if (!samecolour(p->shapefilled, unfilled))
   {
-  if (p->style != is_invi) fprintf(out_file, "gsave ");
+  if (p->style != is_invi) out_string(US"gsave ");
   setcolour(p->shapefilled);
-  fprintf(out_file, "fill");
-  if (p->style != is_invi) fprintf(out_file, " grestore");
-  fprintf(out_file, "\n");
+  out_string(US op[op_fill]);
+  if (p->style != is_invi) out_string(US" grestore");
+  out_char('\n');
   }
 
 if (p->style != is_invi)
@@ -565,9 +614,11 @@ if (p->style != is_invi)
   set_thickness(p->thickness);
   set_dash(p->dash1, p->dash2);
   setcolour(p->colour);
-  fprintf(out_file, "stroke\n");
+  out_printf("%s\n", op[op_stroke]);
   }
 
+at_x = p->x1;
+at_y = p->y1;
 write_strings((item *)p);
 }
 
@@ -581,9 +632,9 @@ static void
 write_line(item_line *p, BOOL move_needed)
 {
 double angle = 0.0;
-int x1 = p->x, y1 = p->y;
-int xw = p->width, yd = p->depth;
-int xx = 0, yy = 0;
+dimen x1 = p->x, y1 = p->y;
+dimen xw = p->width, yd = p->depth;
+dimen xx = 0, yy = 0;
 
 /* Filling: generate the line even if it is invisible; no arrow can be
 involved. */
@@ -613,8 +664,8 @@ if (p->style == is_invi)
 if (p->arrow_start || p->arrow_end)
   {
   angle = atan2((double)p->depth, (double)p->width);
-  xx = (int )(((double)p->arrow_x) * cos(angle));
-  yy = (int )(((double)p->arrow_x) * sin(angle));
+  xx = (dimen)(((double)p->arrow_x) * cos(angle));
+  yy = (dimen)(((double)p->arrow_x) * sin(angle));
   }
 
 /* Adjust the line according to the arrow heads. */
@@ -660,6 +711,227 @@ if (p->arrow_end)
 
 
 
+/*************************************************
+*            Write a chain of items              *
+*************************************************/
+
+/* This is called for the main chain of items, and for the items in each group
+that is placed. The items are drawn in level order, as sorted by sort_items(),
+keeping their original order within each level.
+
+Argument:   the start of the chain
+Returns:    nothing
+*/
+
+static void
+write_items(item *base)
+{
+int count;
+item *prev = NULL;
+item **sorted = sort_items(base, &count);
+
+for (int i = 0; i < count; i++)
+  {
+  item *p = sorted[i];
+  BOOL restart = FALSE;
+  BOOL move_needed = FALSE;
+  dimen startx = 0, starty = 0;
+  item_arc *ppa;
+  item_curve *ppc;
+  item_line *ppl;
+
+  /* A path cannot continue to an item at a different level, or across an
+  item at another level in the chain. */
+
+  if (prev != NULL && (prev->level != p->level || prev->next != p))
+    end_line_fillstroke(prev->next);
+  prev = p;
+
+  switch (p->type)
+    {
+    case i_arc:
+    ppa = (item_arc *)p;
+    if (ppa->arrow_start) restart = TRUE;
+    startx = p->x + (dimen)((double)ppa->radius * cos(ppa->angle1));
+    starty = p->y + (dimen)((double)ppa->radius * sin(ppa->angle1));
+    goto ARCLINE;
+
+    case i_curve:
+    ppc = (item_curve *)p;
+    startx = ppc->x0;
+    starty = ppc->y0;
+    goto ARCLINE;
+
+    case i_line:
+    ppl = (item_line *)p;
+    if (ppl->arrow_start) restart = TRUE;
+    startx = p->x;
+    starty = p->y;
+
+    /* Common code for lines and arcs and curves */
+
+    ARCLINE:
+
+    if (startx != at_x || starty != at_y) restart = TRUE;
+
+    /* Sort out the other conditions under which we have to terminate an
+    existing path. */
+
+    if (!samecolour(p->shapefilled, fillpending? line_fill_colour : unfilled))
+      restart = TRUE;
+
+    if (strokepending)
+      {
+      if (!samecolour(p->colour, stroke_colour) ||
+          p->style == is_invi ||
+          stroke_thickness != p->thickness ||
+          stroke_dash1 != p->dash1 ||
+          stroke_dash2 != p->dash2)
+        restart = TRUE;
+      }
+    else
+      {
+      if (p->style != is_invi) restart = TRUE;
+      }
+
+    /* If starting a new path, end any previous one. */
+
+    if (restart) end_line_fillstroke(p);
+
+    /* Start stroking */
+
+    if (!strokepending && p->style != is_invi)
+      {
+      stroke_thickness = p->thickness;
+      stroke_dash1 = p->dash1;
+      stroke_dash2 = p->dash2;
+      stroke_colour = p->colour;
+      strokepending = TRUE;
+      pathstart = p;
+      move_needed = TRUE;
+      }
+
+    /* Start filling */
+
+    if (!fillpending && !samecolour(p->shapefilled, unfilled))
+      {
+      line_fill_colour = p->shapefilled;
+      fillpending = TRUE;
+      pathstart = p;
+      move_needed = TRUE;
+      }
+
+    /* Write the arc or the line or the curve */
+
+    if (p->type == i_arc)
+      write_arc((item_arc *)p, move_needed, startx, starty);
+    else if (p->type == i_curve)
+      write_curve((item_curve *)p, move_needed);
+    else
+      write_line((item_line *)p, move_needed);
+    break;
+
+    case i_box:
+    end_line_fillstroke(p);
+    write_box((item_box *)p);
+    break;
+
+    case i_poly:
+    end_line_fillstroke(p);
+    write_poly((item_poly *)p);
+    break;
+
+    case i_text:
+    end_line_fillstroke(p);
+    write_strings(p);
+    break;
+    }
+  }
+
+end_line_fillstroke((prev == NULL)? NULL : prev->next);
+}
+
+
+
+/*************************************************
+*          Write the definition of a group       *
+*************************************************/
+
+/* Each group that is placed is written once, as a PostScript procedure that
+draws its items relative to the origin. The cached graphics state is made
+unknown while the procedure is written, so that it sets everything it uses;
+each call is made under gsave, so the state outside is unaffected. Groups are
+written in the order they were defined, so that any group that is placed in
+another one is defined first.
+
+Argument:   the most recently defined group not yet considered
+Returns:    nothing
+*/
+
+static void
+write_groups(group *g)
+{
+dimen save_bbox0 = bbox[0];
+dimen save_bbox1 = bbox[1];
+colour save_colour = set_colour;
+dimen save_linewidth = set_linewidth;
+dimen save_linedash1 = set_linedash1;
+dimen save_linedash2 = set_linedash2;
+
+if (g == NULL) return;
+write_groups(g->next);
+if (!g->used) return;
+
+bbox[0] = bbox[1] = 0;
+set_colour = unfilled;
+set_linewidth = set_linedash1 = -1;
+at_x = at_y = 0;
+
+out_printf("%% Group %s\n/G%d{\n", g->name, g->number);
+write_items(g->items);
+out_string(US"}def\n");
+
+bbox[0] = save_bbox0;
+bbox[1] = save_bbox1;
+set_colour = save_colour;
+set_linewidth = save_linewidth;
+set_linedash1 = save_linedash1;
+set_linedash2 = save_linedash2;
+at_x = at_y = 0;
+}
+
+
+
+/*************************************************
+*           Write an encoding vector             *
+*************************************************/
+
+/* The vector has 256 entries; those that are not given are left null.
+
+Arguments:
+  name       the name of the vector
+  first      the first name in encoding_names
+  count      the number of names
+
+Returns:     nothing
+*/
+
+static void
+write_encoding(const char *name, int first, int count)
+{
+int len = 0;
+out_printf("/%s 256 array def\n%s 0 [\n", name, name);
+for (int i = first; i < first + count; i++)
+  {
+  int l = (int)strlen(encoding_names[i]) + 1;
+  if ((len += l) > 72) { out_char('\n'); len = l; }
+  out_printf("/%s", encoding_names[i]);
+  }
+out_string(US"\n]putinterval\n");
+}
+
+
+
 /*************************************************
 *          Write PostScript output file          *
 *************************************************/
@@ -671,8 +943,7 @@ void
 write_ps(void)
 {
 tree_node *tn;
-int bboxthick = (drawbbox == NULL)? 0 : drawbbox->thickness;
-int level;
+dimen bboxthick = (drawbbox == NULL)? 0 : drawbbox->thickness;
 
 set_colour = black;
 line_fill_colour = unfilled;
@@ -685,27 +956,37 @@ at_x = at_y = 0;
 
 find_bbox(bbox);
 
+/* In compact mode, dimensions in the body are output in units of the
+resolution, under a scale that is set after the prolog. Coordinates are then
+whole numbers. */
+
+if (minimize)
+  {
+  op = op_short;
+  out_set_unit(resolution);
+  }
+
 /* Output header material */
 
-fprintf(out_file, "%%!PS-Adobe-2.0 EPSF-2.0\n");
+out_printf("%%!PS-Adobe-2.0 EPSF-2.0\n");
 tn = tree_search(varroot, US"title");
-fprintf(out_file, "%%%%Title: %s\n", tn->value);
+out_printf("%%%%Title: %s\n", tn->value);
 tn = tree_search(varroot, US"creator");
-fprintf(out_file, "%%%%Creator: %s, using Aspic %s\n", tn->value,
+out_printf("%%%%Creator: %s, using Aspic %s\n", tn->value,
   testing? "" : Version_String);
 tn = tree_search(varroot, US"date");
-fprintf(out_file, "%%%%CreationDate: %s\n", tn->value);
-fprintf(out_file, "%%%%BoundingBox: 0 0 %s %s\n",
-  fixed(bbox[2] - bbox[0] + bboxthick),
-  fixed(bbox[3] - bbox[1] + bboxthick));
-fprintf(out_file, "%%%%EndComments\n\n");
+out_printf("%%%%CreationDate: %s\n", tn->value);
+out_printf("%%%%BoundingBox: 0 0 %F %F\n",
+  bbox[2] - bbox[0] + bboxthick,
+  bbox[3] - bbox[1] + bboxthick);
+out_printf("%%%%EndComments\n\n");
 
 /* The move function checks to see if there is a current point. If not, it does
 an absolute move. Otherwise, it computes a relative move and does it if it is
 not a null operation. Because the current point will have been adjusted for
 device space, the check for no move must have a small tolerance. */
 
-fprintf(out_file,
+out_string(US
   "/mymove{\n"
   "{currentpoint} stopped {moveto}{\n"
   "  exch 4 1 roll sub 3 1 roll exch sub\n"
@@ -715,180 +996,112 @@ fprintf(out_file,
   "}def\n");
 
 /* If no items have text strings, we do not need to output the showing
-functions or the UTF-8 encoding vectors; nor do we need to output any font
-bindings. For fonts that use Adobe's standard encoding (that is, normal text
-fonts), we are going to bind each font twice, to give us 512 characters to play
-with. This is sufficient to encode all existing characters in the normal fonts.
-The first 256 characters are encoded with The second encoding vector uses
-Unicode for the first 128 characters (Latin Extended-A). The remainder are used
-arbitrarily for the remaining Adobe standardly encoded characters. This latter
-part of the encoding must be kept in step with the appropriate data table in
-the code. */
+functions or the encoding vectors; nor do we need to output any font bindings.
+Otherwise, only the functions, encodings, and fonts that the strings use are
+output, as recorded by note_string() while reading. For fonts that use Adobe's
+standard encoding (that is, normal text fonts), each font may be bound twice,
+to give us 512 characters to play with. This is sufficient to encode all
+existing characters in the normal fonts. The first encoding vector is Unicode
+for the first 256 characters, except that control characters are shown as
+"currency". The second uses Unicode for its first 128 characters (Latin
+Extended-A); the remainder are used arbitrarily for the remaining Adobe
+standardly encoded characters. The glyph names are in encoding_names, which
+must be kept in step with nonulist. */
 
 if (strings_exist)
   {
+  BOOL lower = FALSE;
+  BOOL upper = FALSE;
+  BOOL special = FALSE;
+
+  for (bindfont *b = font_base; b != NULL; b = b->next)
+    {
+    if (b->needLower) lower = TRUE;
+    if (b->needUpper) upper = TRUE;
+    if (b->needSymbol || b->needDingbats) special = TRUE;
+    }
+
   /* These PostScript functions expect a list of (font, string) pairs on the
   stack, followed by a count of the number of pairs. */
 
-  fprintf(out_file,
+  out_string(US
     "/leftshow{dup add /r exch def\n"   /* Twice the count is now in r */
     "{r 2 gt\n"
     "{r -2 roll exch setfont show /r r 2 sub def}\n"  /* Not last substring */
     "{exch setfont show exit}\n"                      /* Last substring */
-    "ifelse}loop}bind def\n"
-    "/findwidth{dup 2 mul 1 add copy /w 0 def\n"  /* Copy pairs, zero count */
-    "1 exch 1 exch\n"                             /* Set loop parameters */
-    "{pop exch setfont stringwidth pop w add /w exch def}for}bind def\n"
-    "/centreshow{findwidth w 2 div neg 0 rmoveto leftshow}bind def\n"
-    "/rightshow{findwidth w neg 0 rmoveto leftshow}bind def\n"
-    "/rot{gsave currentpoint translate rotate}bind def\n");
+    "ifelse}loop}bind def\n");
+
+  if (strings_centred || strings_right)
+    out_string(US
+      "/findwidth{dup 2 mul 1 add copy /w 0 def\n"  /* Copy pairs, zero count */
+      "1 exch 1 exch\n"                             /* Set loop parameters */
+      "{pop exch setfont stringwidth pop w add /w exch def}for}bind def\n");
+
+  if (strings_centred)
+    out_string(US"/centreshow{findwidth w 2 div neg 0 rmoveto leftshow}bind def\n");
+  if (strings_right)
+    out_string(US"/rightshow{findwidth w neg 0 rmoveto leftshow}bind def\n");
+  if (strings_rotated)
+    out_string(US"/rot{gsave currentpoint translate rotate}bind def\n");
 
   /* Encoding vectors */
 
-  fprintf(out_file,
-    "/LowerEncoding 256 array def\n"
-    "LowerEncoding 0 [\n"
-    "/currency/currency/currency/currency\n"
-    "/currency/currency/currency/currency\n"
-    "/currency/currency/currency/currency\n"
-    "/currency/currency/currency/currency\n"
-    "/currency/currency/currency/currency\n"
-    "/currency/currency/currency/currency\n"
-    "/currency/currency/currency/currency\n"
-    "/currency/currency/currency/currency\n"
-    "/space/exclam/quotedbl/numbersign\n"
-    "/dollar/percent/ampersand/quotesingle\n"
-    "/parenleft/parenright/asterisk/plus\n"
-    "/comma/hyphen/period/slash\n"
-    "/zero/one/two/three\n"
-    "/four/five/six/seven\n"
-    "/eight/nine/colon/semicolon\n"
-    "/less/equal/greater/question\n"
-    "/at/A/B/C/D/E/F/G/H/I/J/K/L/M/N/O\n"
-    "/P/Q/R/S/T/U/V/W/X/Y/Z/bracketleft\n"
-    "/backslash/bracketright/asciicircum/underscore\n"
-    "/grave/a/b/c/d/e/f/g/h/i/j/k/l/m/n/o\n"
-    "/p/q/r/s/t/u/v/w/x/y/z/braceleft\n"
-    "/bar/braceright/asciitilde/currency\n"
-    "/currency/currency/currency/currency\n"
-    "/currency/currency/currency/currency\n"
-    "/currency/currency/currency/currency\n"
-    "/currency/currency/currency/currency\n"
-    "/currency/currency/currency/currency\n"
-    "/currency/currency/currency/currency\n"
-    "/currency/currency/currency/currency\n"
-    "/currency/currency/currency/currency\n"
-    "/space/exclamdown/cent/sterling\n"
-    "/currency/yen/brokenbar/section\n"
-    "/dieresis/copyright/ordfeminine/guillemotleft\n"
-    "/logicalnot/hyphen/registered/macron\n"
-    "/degree/plusminus/twosuperior/threesuperior\n"
-    "/acute/mu/paragraph/bullet\n"
-    "/cedilla/onesuperior/ordmasculine/guillemotright\n"
-    "/onequarter/onehalf/threequarters/questiondown\n"
-    "/Agrave/Aacute/Acircumflex/Atilde\n"
-    "/Adieresis/Aring/AE/Ccedilla\n"
-    "/Egrave/Eacute/Ecircumflex/Edieresis\n"
-    "/Igrave/Iacute/Icircumflex/Idieresis\n"
-    "/Eth/Ntilde/Ograve/Oacute\n"
-    "/Ocircumflex/Otilde/Odieresis/multiply\n"
-    "/Oslash/Ugrave/Uacute/Ucircumflex\n"
-    "/Udieresis/Yacute/Thorn/germandbls\n"
-    "/agrave/aacute/acircumflex/atilde\n"
-    "/adieresis/aring/ae/ccedilla\n"
-    "/egrave/eacute/ecircumflex/edieresis\n"
-    "/igrave/iacute/icircumflex/idieresis\n"
-    "/eth/ntilde/ograve/oacute\n"
-    "/ocircumflex/otilde/odieresis/divide\n"
-    "/oslash/ugrave/uacute/ucircumflex\n"
-    "/udieresis/yacute/thorn/ydieresis\n"
-    "]putinterval\n");
-
-  fprintf(out_file,
-    "/UpperEncoding 256 array def\n"
-    "UpperEncoding 0 [\n"
-    "/Amacron/amacron/Abreve/abreve\n"
-    "/Aogonek/aogonek/Cacute/cacute\n"
-    "/currency/currency/currency/currency\n"
-    "/Ccaron/ccaron/Dcaron/dcaron\n"
-    "/Dcroat/dcroat/Emacron/emacron\n"
-    "/currency/currency/Edotaccent/edotaccent\n"
-    "/Eogonek/eogonek/Ecaron/ecaron\n"
-    "/currency/currency/Gbreve/gbreve\n"
-    "/currency/currency/Gcommaaccent/gcommaaccent\n"
-    "/currency/currency/currency/currency\n"
-    "/currency/currency/Imacron/imacron\n"
-    "/currency/currency/Iogonek/iogonek\n"
-    "/Idotaccent/dotlessi/currency/currency\n"
-    "/currency/currency/Kcommaaccent/kcommaaccent\n"
-    "/currency/Lacute/lacute/Lcommaaccent\n"
-    "/lcommaaccent/Lcaron/lcaron/currency\n"
-    "/currency/Lslash/lslash/Nacute\n"
-    "/nacute/Ncommaaccent/ncommaaccent/Ncaron\n"
-    "/ncaron/currency/currency/currency\n"
-    "/Omacron/omacron/currency/currency\n"
-    "/Ohungarumlaut/ohungarumlaut/OE/oe\n"
-    "/Racute/racute/Rcommaaccent/rcommaaccent\n"
-    "/Rcaron/rcaron/Sacute/sacute\n"
-    "/currency/currency/Scedilla/scedilla\n"
-    "/Scaron/scaron/currency/currency\n"
-    "/Tcaron/tcaron/currency/currency\n"
-    "/currency/currency/Umacron/umacron\n"
-    "/currency/currency/Uring/uring\n"
-    "/Uhungarumlaut/uhungarumlaut/Uogonek/uogonek\n"
-    "/currency/currency/currency/currency\n"
-    "/Ydieresis/Zacute/zacute/Zdotaccent\n"
-    "/zdotaccent/Zcaron/zcaron/currency\n"
-    "/Delta/Euro/Scommaaccent/Tcommaaccent\n"
-    "/breve/caron/circumflex/commaaccent\n"
-    "/dagger/daggerdbl/dotaccent/ellipsis\n"
-    "/emdash/endash/fi/fl\n"
-    "/florin/fraction/greaterequal/guilsinglleft\n"
-    "/guilsinglright/hungarumlaut/lessequal/lozenge\n"
-    "/minus/notequal/ogonek/partialdiff\n"
-    "/periodcentered/perthousand/quotedblbase/quotedblleft\n"
-    "/quotedblright/quoteleft/quoteright/quotesinglbase\n"
-    "/radical/ring/scommaaccent/summation\n"
-    "/tcommaaccent/tilde/trademark\n"
-    "]putinterval\n");
-
-  /* The function bindspecialfont binds a single font and scales it. The
-  arguments on the stack are a name for the font (e.g. f0), the font typeface
-  name, and the font size. The function bindstdfont finds a font and, if it is
-  standardly encoded, binds it twice with the two different encodings. The
-  arguments on the stack are the two font names, the font typeface name, and
-  the font size. If the font turns out not be be standardly encoded, the two
-  fonts will end up the same. */
-
-  fprintf(out_file,
-    "/bindspecialfont{exch findfont exch scalefont def}bind def\n"
-    "/bindstdfont{exch findfont exch scalefont\n"
-    "dup dup/Encoding get StandardEncoding eq\n"
-    "{maxlength dup dict/newfont0 exch def dict/newfont1 exch def\n"
-    "dup\n"
-    "{1 index/FID eq{pop pop}{newfont0 3 1 roll put}ifelse}forall\n"
-    "{1 index/FID eq{pop pop}{newfont1 3 1 roll put}ifelse}forall\n"
-    "newfont1/Encoding UpperEncoding put dup newfont1 definefont def\n"
-    "newfont0/Encoding LowerEncoding put dup newfont0 definefont def\n"
-    "}\n"
-    "{3 1 roll def def}ifelse\n"
-    "}bind def\n");
-
-  /* Output font bindings. */
+  if (lower) write_encoding("LowerEncoding", 0, 256);
+  if (upper) write_encoding("UpperEncoding", 256, encoding_count - 256);
+
+  /* The function bindencfont finds a font and, if it is standardly encoded,
+  binds it with a given encoding. The arguments on the stack are a name for the
+  font (e.g. f0), the font typeface name, the font size, and the encoding. If
+  the font turns out not be be standardly encoded, it is bound unchanged. The
+  function bindspecialfont binds a single font and scales it; its arguments are
+  the same, without the encoding. */
+
+  if (lower || upper)
+    out_string(US
+      "/bindencfont{3 1 roll exch findfont exch scalefont\n"
+      "dup/Encoding get StandardEncoding eq\n"
+      "{dup maxlength dict/newfont exch def\n"
+      "{1 index/FID eq{pop pop}{newfont 3 1 roll put}ifelse}forall\n"
+      "newfont/Encoding 3 -1 roll put dup newfont definefont def}\n"
+      "{exch pop def}ifelse\n"
+      "}bind def\n");
+
+  if (special)
+    out_string(US
+      "/bindspecialfont{exch findfont exch scalefont def}bind def\n");
+
+  /* Output the font bindings that are used. */
 
   for (bindfont *b = font_base; b != NULL; b = b->next)
     {
-    fprintf(out_file, "/f%d /f%d /%s %s bindstdfont\n", 4*b->number,
-      4*b->number + 1, b->name, fixed(b->size));
+    if (b->needLower)
+      out_printf("/f%d /%s %U LowerEncoding bindencfont\n", 4*b->number,
+        b->name, b->size);
+    if (b->needUpper)
+      out_printf("/f%d /%s %U UpperEncoding bindencfont\n", 4*b->number + 1,
+        b->name, b->size);
     if (b->needSymbol)
-      fprintf(out_file, "/f%d /%s %s bindspecialfont\n", 4*b->number + 2,
-        "Symbol", fixed(b->size));
+      out_printf("/f%d /%s %U bindspecialfont\n", 4*b->number + 2,
+        "Symbol", b->size);
     if (b->needDingbats)
-      fprintf(out_file, "/f%d /%s %s bindspecialfont\n", 4*b->number + 3,
-        "ZapfDingbats", fixed(b->size));
+      out_printf("/f%d /%s %U bindspecialfont\n", 4*b->number + 3,
+        "ZapfDingbats", b->size);
     }
   }
 
+/* In compact mode, bind the short operator names and set the scale. */
+
+if (minimize)
+  {
+  for (int i = 0; i < op_count; i++)
+    out_printf("/%s/%s load def\n", op_short[i], op_full[i]);
+  out_printf("%F dup scale\n", resolution);
+  }
+
+/* Define the groups that are placed */
+
+write_groups(group_base);
+
 /* Draw a bounding box frame if wanted */
 
 if (drawbbox != NULL)
@@ -900,127 +1113,14 @@ if (drawbbox != NULL)
   write_box(drawbbox);
   }
 
-/* Now process the items, repeating for each level */
-
-for (level = min_level; level <= max_level; level++)
-  {
-  item *p;
-
-  for (p = main_item_base; p != NULL; p = p->next)
-    {
-    BOOL restart = FALSE;
-    BOOL move_needed = FALSE;
-    int  startx = 0, starty = 0;
-    item_arc *ppa;
-    item_curve *ppc;
-    item_line *ppl;
-
-    if (p->level == level) switch (p->type)
-      {
-      case i_arc:
-      ppa = (item_arc *)p;
-      if (ppa->arrow_start) restart = TRUE;
-      startx = p->x + (int )((double)ppa->radius * cos(ppa->angle1));
-      starty = p->y + (int )((double)ppa->radius * sin(ppa->angle1));
-      goto ARCLINE;
-
-      case i_curve:
-      ppc = (item_curve *)p;
-      startx = ppc->x0;
-      starty = ppc->y0;
-      goto ARCLINE;
-
-      case i_line:
-      ppl = (item_line *)p;
-      if (ppl->arrow_start) restart = TRUE;
-      startx = p->x;
-      starty = p->y;
-
-      /* Common code for lines and arcs and curves */
-
-      ARCLINE:
-
-      if (startx != at_x || starty != at_y) restart = TRUE;
-
-      /* Sort out the other conditions under which we have to terminate an
-      existing path. */
+/* Now process the items */
 
-      if (!samecolour(p->shapefilled, fillpending? line_fill_colour : unfilled))
-        restart = TRUE;
-
-      if (strokepending)
-        {
-        if (!samecolour(p->colour, stroke_colour) ||
-            p->style == is_invi ||
-            stroke_thickness != p->thickness ||
-            stroke_dash1 != p->dash1 ||
-            stroke_dash2 != p->dash2)
-          restart = TRUE;
-        }
-      else
-        {
-        if (p->style != is_invi) restart = TRUE;
-        }
-
-      /* If starting a new path, end any previous one. */
-
-      if (restart) end_line_fillstroke(p);
-
-      /* Start stroking */
-
-      if (!strokepending && p->style != is_invi)
-        {
-        stroke_thickness = p->thickness;
-        stroke_dash1 = p->dash1;
-        stroke_dash2 = p->dash2;
-        stroke_colour = p->colour;
-        strokepending = TRUE;
-        pathstart = p;
-        move_needed = TRUE;
-        }
-
-      /* Start filling */
-
-      if (!fillpending && !samecolour(p->shapefilled, unfilled))
-        {
-        line_fill_colour = p->shapefilled;
-        fillpending = TRUE;
-        pathstart = p;
-        move_needed = TRUE;
-        }
-
-      /* Write the arc or the line or the curve */
-
-      if (p->type == i_arc)
-        write_arc((item_arc *)p, move_needed, startx, starty);
-      else if (p->type == i_curve)
-        write_curve((item_curve *)p, move_needed);
-      else
-        write_line((item_line *)p, move_needed);
-      break;
-
-      case i_box:
-      end_line_fillstroke(p);
-      write_box((item_box *)p);
-      break;
-
-      case i_text:
-      end_line_fillstroke(p);
-      write_strings(p);
-      break;
-      }
-
-    /* If hit an item at another level, stroke line and/or end line filling */
-
-    else end_line_fillstroke(p);
-    }
-
-  end_line_fillstroke(NULL);
-  }
+write_items(main_item_base);
 
 /* Output showpage at the end so the file can be viewed on its own. */
 
-fprintf(out_file, "showpage\n");
+out_string(US"showpage\n");
+out_set_unit(0);
 }
 
 
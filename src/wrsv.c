@@ -12,29 +12,43 @@
 
 #include "aspic.h"
 
+#define ATTR_SIZE 160           /* Buffer for fill and stroke attributes */
+
 
 
 /*************************************************
 *               Local variables                  *
 *************************************************/
 
-static int  bbox[4];
+static dimen bbox[4];
 
 static colour line_fill_colour;
 static colour stroke_colour;
 
-static int  stroke_thickness;
-static int  stroke_dash1;
-static int  stroke_dash2;
+static dimen stroke_thickness;
+static dimen stroke_dash1;
+static dimen stroke_dash2;
 
-static int  at_x;
-static int  at_y;
+static dimen at_x;
+static dimen at_y;
 
 static BOOL fillpending;
 static BOOL strokepending;
 
 static item *pathstart;
 
+/* These are used for writing path data in minimized output (-svgmin). */
+
+static int  path_command;       /* Previous command letter */
+static BOOL path_space;         /* A separator may be needed */
+static BOOL path_point;         /* The previous number contains a point */
+
+/* The distinct styles, when they are written as classes (-svgclass). Each
+node's name is the attributes of the style, and its value is the class name. */
+
+static tree_node *style_tree;
+static int  style_count;
+
 
 
 /*************************************************
@@ -50,10 +64,53 @@ f->next = font_base;
 font_base = f;
 f->number = 0;
 f->size = 12000;
+f->needLower = f->needUpper = FALSE;
 f->needSymbol = f->needDingbats = FALSE;
 Ustrcpy(f->name, "Times-Roman");
 
 minimum_thickness = 200;    /* So that zero does something */
+if (minimize) resolution = 10;  /* Two decimal places for -svgmin */
+}
+
+
+
+/*************************************************
+*      Write numbers in minimized path data      *
+*************************************************/
+
+/* A command letter is written only when it differs from the previous one,
+because SVG repeats a command implicitly for further sets of numbers. A space
+is needed between two numbers only if the second does not start with a minus
+sign, or with a point after a number that already contains one.
+
+Arguments:
+  command    the command letter, or 0 for a list of points
+  values     the numbers
+  count      the number of them
+
+Returns:     nothing
+*/
+
+static void
+path_numbers(int command, dimen *values, int count)
+{
+if (command != 0 && command != path_command)
+  {
+  out_char(command);
+  path_command = command;
+  path_space = FALSE;
+  }
+
+for (int i = 0; i < count; i++)
+  {
+  uschar buffer[FIXED_SIZE];
+  int n = format_fixed_min(buffer, values[i]);
+  if (path_space && buffer[0] != '-' && (buffer[0] != '.' || !path_point))
+    out_char(' ');
+  out_bytes(buffer, n);
+  path_point = memchr(buffer, '.', n) != NULL;
+  path_space = TRUE;
+  }
 }
 
 
@@ -66,45 +123,91 @@ minimum_thickness = 200;    /* So that zero does something */
 that is not a close shape. */
 
 static
-void move(int x, int y)
+void move(dimen x, dimen y)
 {
 x = x - bbox[0];
 y = y - bbox[1];
-fprintf(out_file, "<path d=\"M %s %s\n", fixed(rnd(x)), fixed(rnd(-y)));
+if (minimize)
+  {
+  dimen v[2] = { x, -y };
+  out_string(US"<path d=\"");
+  path_command = 0;
+  path_numbers('M', v, 2);
+  }
+else out_printf("<path d=\"M %R %R\n", x, -y);
 }
 
 
-/* Relative line */
+/* Relative line; when minimized, a horizontal or vertical line is written
+with a single number. */
 
 static void
-rline(int x, int y)
+rline(dimen x, dimen y)
 {
-fprintf(out_file, "l %s %s\n", fixed(rnd(x)), fixed(rnd(-y)));
+if (minimize)
+  {
+  dimen v[2] = { rnd(x), rnd(-y) };
+  if (v[1] == 0) path_numbers('h', v, 1);
+    else if (v[0] == 0) path_numbers('v', v + 1, 1);
+      else path_numbers('l', v, 2);
+  }
+else out_printf("l %R %R\n", x, -y);
 }
 
 
 /* Relative bezier */
 
 static void
-rbezier(int x1, int y1, int x2, int y2, int x3, int y3)
+rbezier(dimen x1, dimen y1, dimen x2, dimen y2, dimen x3, dimen y3)
 {
-fprintf(out_file, "c %s %s %s %s %s %s\n",
-  fixed(rnd(x1)), fixed(rnd(-y1)),
-  fixed(rnd(x2)), fixed(rnd(-y2)),
-  fixed(rnd(x3)), fixed(rnd(-y3)));
+if (minimize)
+  {
+  dimen v[6] = { x1, -y1, x2, -y2, x3, -y3 };
+  path_numbers('c', v, 6);
+  }
+else out_printf("c %R %R %R %R %R %R\n", x1, -y1, x2, -y2, x3, -y3);
 }
 
 
 
 /*************************************************
-*       Set fill and stroke parameters           *
+*              Format a colour                   *
 *************************************************/
 
-/*
+/* When minimized, the three-digit form is used if it is possible.
+
+Arguments:
+  p           where to put the colour, including the quotes
+  c           the colour
+
+Returns:      the end of the string, which is zero-terminated
+*/
+
+static uschar *
+format_colour(uschar *p, colour c)
+{
+int r = (c.red   * 255)/1000;
+int g = (c.green * 255)/1000;
+int b = (c.blue  * 255)/1000;
+
+if (minimize && r % 17 == 0 && g % 17 == 0 && b % 17 == 0)
+  return p + sprintf(CS p, "\"#%X%X%X\"", r/17, g/17, b/17);
+return p + sprintf(CS p, "\"#%02X%02X%02X\"", r, g, b);
+}
+
+
+
+/*************************************************
+*       Format fill and stroke attributes        *
+*************************************************/
+
+/* The fill and stroke attributes for an element are written into a buffer,
+each preceded by a space. When minimized, those that have SVG's default values
+(a black fill, no stroke, and a stroke width of one) are omitted.
+
 Arguments:
-  fill        buffer into which to write the fill data
+  buffer      where to write the attributes, at least ATTR_SIZE bytes
   fc          the fill colour
-  stroke      buffer into which to write the stroke data
   sp          TRUE if stroke wanted
   sc          stroke colour
   lw          linewidth
@@ -114,32 +217,191 @@ Returns:      nothing
 */
 
 static void
-sort_fill_stroke(uschar *fill, colour fc, uschar *stroke, BOOL sp, colour sc,
-  int lw, int d1, int d2)
+fill_stroke_attrs(uschar *buffer, colour fc, BOOL sp, colour sc, dimen lw,
+  dimen d1, dimen d2)
 {
+uschar *p = buffer;
+int (*format)(uschar *, dimen) = minimize? format_fixed_min : format_fixed;
+
 if (lw < minimum_thickness) lw = minimum_thickness;
 
-if (samecolour(fc, unfilled)) Ustrcpy(fill, "\"none\"");
-  else sprintf(CS fill, "\"#%02X%02X%02X\"",
-    (fc.red   * 255)/1000,
-    (fc.green * 255)/1000,
-    (fc.blue  * 255)/1000);
+if (samecolour(fc, unfilled)) p += sprintf(CS p, " fill=\"none\"");
+  else if (!minimize || !samecolour(fc, black))
+    p = format_colour(p + sprintf(CS p, " fill="), fc);
 
-if (!sp) Ustrcpy(stroke, "\"none\""); else
+if (!sp)
   {
-  sprintf(CS stroke, "\"#%02X%02X%02X\" stroke-width=\"%s\"",
-    (sc.red   * 255)/1000,
-    (sc.green * 255)/1000,
-    (sc.blue  * 255)/1000,
-    fixed(lw));
+  if (!minimize) p += sprintf(CS p, " stroke=\"none\"");
+  }
+else
+  {
+  p = format_colour(p + sprintf(CS p, " stroke="), sc);
+
+  if (!minimize || lw != 1000)
+    {
+    p += sprintf(CS p, " stroke-width=\"");
+    p += format(p, lw);
+    *p++ = '"';
+    }
 
   if (d1 != 0)
     {
-    uschar *p = stroke;
-    while (*p != 0) p++;
-    sprintf(CS p, " stroke-dasharray=\"%s,%s\"", fixed(d1), fixed(d2));
+    p += sprintf(CS p, " stroke-dasharray=\"");
+    p += format(p, d1);
+    *p++ = ',';
+    p += format(p, d2);
+    *p++ = '"';
+    }
+  }
+
+*p = 0;
+}
+
+
+
+/*************************************************
+*       Set fill and stroke parameters           *
+*************************************************/
+
+/* When styles are written as classes, the attributes are replaced by a
+reference to the class that has them.
+
+Arguments:
+  buffer      where to write the attributes, at least ATTR_SIZE bytes
+  fc          the fill colour
+  sp          TRUE if stroke wanted
+  sc          stroke colour
+  lw          linewidth
+  d1, d2      dash parameters
+
+Returns:      nothing
+*/
+
+static void
+sort_fill_stroke(uschar *buffer, colour fc, BOOL sp, colour sc, dimen lw, dimen d1,
+  dimen d2)
+{
+fill_stroke_attrs(buffer, fc, sp, sc, lw, d1, d2);
+if (style_classes && buffer[0] != 0)
+  {
+  tree_node *tn = tree_search(style_tree, buffer);
+  if (tn != NULL) sprintf(CS buffer, " class=\"%s\"", tn->value);
+  }
+}
+
+
+
+/*************************************************
+*               Collect styles                   *
+*************************************************/
+
+/* This is called for each element that is going to be written, before any
+output, so that the styles can be written at the start.
+
+Arguments:    as for sort_fill_stroke()
+Returns:      nothing
+*/
+
+static void
+add_style(colour fc, BOOL sp, colour sc, dimen lw, dimen d1, dimen d2)
+{
+uschar attrs[ATTR_SIZE];
+tree_node *tn;
+
+fill_stroke_attrs(attrs, fc, sp, sc, lw, d1, d2);
+if (attrs[0] == 0 || tree_search(style_tree, attrs) != NULL) return;
+
+tn = getstore(sizeof(tree_node) + Ustrlen(attrs));
+Ustrcpy(tn->name, attrs);
+tn->value = getstore(12);
+sprintf(CS tn->value, "s%d", style_count++);
+(void)tree_insertnode(&style_tree, tn);
+}
+
+
+/* Collect the styles of a chain of items. All the items in a path have the
+same style, so each item can be considered on its own.
+
+Argument:   the start of the chain
+Returns:    nothing
+*/
+
+static void
+collect_styles(item *p)
+{
+for (; p != NULL; p = p->next)
+  {
+  BOOL filled = !samecolour(p->shapefilled, unfilled);
+
+  if (p->type == i_text ||
+      (p->type == i_box && ((item_box *)p)->boxtype == box_place) ||
+      (p->type != i_box && p->style == is_invi && !filled))
+    continue;
+
+  add_style(p->shapefilled, p->style != is_invi, p->colour, p->thickness,
+    p->dash1, p->dash2);
+
+  /* Arrow heads are drawn only on lines and arcs that are not filled. */
+
+  if (p->style != is_invi && !filled)
+    {
+    if (p->type == i_line && (((item_line *)p)->arrow_start ||
+        ((item_line *)p)->arrow_end))
+      add_style(((item_line *)p)->arrow_filled, TRUE, black, 400, 0, 0);
+    else if (p->type == i_arc && (((item_arc *)p)->arrow_start ||
+        ((item_arc *)p)->arrow_end))
+      add_style(((item_arc *)p)->arrow_filled, TRUE, black, 400, 0, 0);
+    }
+  }
+}
+
+
+
+/*************************************************
+*            Write the style classes             *
+*************************************************/
+
+/* The classes are put into a vector in the order of their numbers, and then
+written as CSS, converted from the attributes in their names.
+
+Arguments:
+  tn          the root of the tree of styles
+  vector      the vector
+
+Returns:      nothing
+*/
+
+static void
+sort_styles(tree_node *tn, tree_node **vector)
+{
+if (tn == NULL) return;
+sort_styles(tn->left, vector);
+vector[Uatoi(tn->value + 1)] = tn;
+sort_styles(tn->right, vector);
+}
+
+static void
+write_styles(void)
+{
+tree_node **vector = getstore(style_count * sizeof(tree_node *));
+
+sort_styles(style_tree, vector);
+out_string(US"<style>\n");
+for (int i = 0; i < style_count; i++)
+  {
+  out_printf(".%s{", vector[i]->value);
+  for (uschar *p = vector[i]->name + 1; *p != 0; p++)
+    {
+    if (*p == '=') { out_char(':'); p++; }         /* Skip the quote */
+    else if (*p == '"')
+      {
+      if (p[1] != 0) { out_char(';'); p++; }    /* Skip the space */
+      }
+    else out_char(*p);
     }
+  out_string(US"}\n");
   }
+out_printf("</style>\n%s", minimize? "" : "\n");
 }
 
 
@@ -154,7 +416,7 @@ if (!sp) Ustrcpy(stroke, "\"none\""); else
 static void
 write_strings(item *p)
 {
-int  x, y;
+dimen x, y;
 stringchain *s = p->strings;
 
 if (s == NULL) return;  /* There are no strings */
@@ -163,30 +425,29 @@ stringpos(p, &x, &y);      /* Find the right position for the strings */
 
 for (;;)
   {
-  int depth;
+  dimen depth;
 
   if (s->text[0] != 0)
     {
     uschar *ss = s->text;
-    uschar *fx = fixed(rnd(x - bbox[0] + s->xadjust));
-    uschar *fy = fixed(rnd(-y + bbox[1] - s->yadjust));
-    uschar fill[12];
-    uschar stroke[128];
+    dimen fx = rnd(x - bbox[0] + s->xadjust);
+    dimen fy = rnd(-y + bbox[1] - s->yadjust);
 
-    fprintf(out_file, "<text x=\"%s\" y=\"%s\"", fx, fy);
+    out_printf("<text x=\"%F\" y=\"%F\"", fx, fy);
 
     if (s->rotate != 0)
-      fprintf(out_file, " transform=\"rotate(%s,%s,%s)\"", fixed(-s->rotate),
-        fx, fy);
+      out_printf(" transform=\"rotate(%F,%F,%F)\"", -s->rotate, fx, fy);
 
-    fprintf(out_file, " text-anchor=\"%s\"",
-      (s->justify == just_left)? US"start" :
-      (s->justify == just_right)? US"end" : US"middle");
+    if (s->justify != just_left || !minimize)
+      out_printf(" text-anchor=\"%s\"",
+        (s->justify == just_left)? US"start" :
+        (s->justify == just_right)? US"end" : US"middle");
 
     if (s->rgb.red != 0 || s->rgb.green != 0 || s->rgb.blue != 0)
       {
-      sort_fill_stroke(fill, s->rgb, stroke, FALSE, s->rgb, 0, 0, 0);
-      fprintf(out_file, " fill=%s", fill);
+      uschar fill[16];
+      (void)format_colour(fill, s->rgb);
+      out_printf(" fill=%s", fill);
       }
 
     if (s->font != 0)
@@ -222,29 +483,29 @@ for (;;)
               weight = US"bold";
             }
 
-          fprintf(out_file, " font-family=\"%s\" font-size=\"%s\"",
-            family, fixed(b->size));
+          out_printf(" font-family=\"%s\" font-size=\"%F\"",
+            family, b->size);
           if (weight != NULL)
-            fprintf(out_file, " font-weight=\"%s\"", weight);
+            out_printf(" font-weight=\"%s\"", weight);
           if (style != NULL)
-            fprintf(out_file, " font-style=\"%s\"", style);
+            out_printf(" font-style=\"%s\"", style);
           break;
           }
         }
       }
 
-    fprintf(out_file, ">");
+    out_char('>');
     while (*ss != 0)
       {
       int c;
       GETCHARINC(c, ss);
-      if (c == '<') fprintf(out_file, "&lt;");
-      else if (c == '>') fprintf(out_file, "&gt;");
-      else if (c == '&') fprintf(out_file, "&amp;");
-      else if (c < 127) fputc(c, out_file);
-      else fprintf(out_file, "&#x%x;", c);
+      if (c == '<') out_string(US"&lt;");
+      else if (c == '>') out_string(US"&gt;");
+      else if (c == '&') out_string(US"&amp;");
+      else if (c < 127) out_char(c);
+      else out_printf("&#x%x;", c);
       }
-    fprintf(out_file, "</text>\n");
+    out_string(US"</text>\n");
     }
 
   /* Move on to the next string; if we are not done, move down by its depth,
@@ -256,8 +517,8 @@ for (;;)
   depth = find_linedepth(p, s);
   if (s->rotate == 0) y -= depth; else
     {
-    y -= (int)((double)depth * cos(s->rrotate));
-    x += (int)((double)depth * sin(s->rrotate));
+    y -= (dimen)((double)depth * cos(s->rrotate));
+    x += (dimen)((double)depth * sin(s->rrotate));
     }
   }
 }
@@ -281,14 +542,13 @@ Returns:      nothing
 static void
 end_line_fillstroke(item *current)
 {
-uschar fill[12];
-uschar stroke[128];
+uschar attrs[ATTR_SIZE];
 
 if (!samecolour(line_fill_colour, unfilled) || strokepending)
   {
-  sort_fill_stroke(fill, line_fill_colour, stroke, strokepending,
-    stroke_colour, stroke_thickness, stroke_dash1, stroke_dash2);
-  fprintf(out_file, "\" fill=%s stroke=%s/>\n", fill, stroke);
+  sort_fill_stroke(attrs, line_fill_colour, strokepending, stroke_colour,
+    stroke_thickness, stroke_dash1, stroke_dash2);
+  out_printf("\"%s/>\n", attrs);
   }
 
 while (pathstart != NULL && pathstart != current)
@@ -309,33 +569,27 @@ pathstart = NULL;
 *************************************************/
 
 static void
-arrowhead(int x, int y, int xx, int yy, double angle, colour filled)
+arrowhead(dimen x, dimen y, dimen xx, dimen yy, double angle, colour filled)
 {
-uschar fill[32];
+uschar attrs[ATTR_SIZE];
 double s = sin(angle);
 double c = cos(angle);
 
-int x1 = (int )((double)yy*s*0.5);
-int y1 = (int )((double)yy*c*0.5);
-int x2 = (int )((double)xx*c);
-int y2 = (int )((double)xx*s);
+dimen x1 = (dimen)((double)yy*s*0.5);
+dimen y1 = (dimen)((double)yy*c*0.5);
+dimen x2 = (dimen)((double)xx*c);
+dimen y2 = (dimen)((double)xx*s);
 
-fprintf(out_file, "<path d=\"M %s %s\n", fixed(x - bbox[0]),
-  fixed(-y + bbox[1]));
+if (minimize) move(x, y);
+  else out_printf("<path d=\"M %F %F\n", x - bbox[0], -y + bbox[1]);
 
 rline(x1, -y1);
 rline(x2 - x1, y2 + y1);
 rline(-x2 -x1, y1 - y2);
 rline(x1, -y1);
 
-if (samecolour(filled, unfilled)) Ustrcpy(fill, "\"none\"");
-  else sprintf(CS fill, "\"#%02X%02X%02X\"",
-    (filled.red   * 255)/1000,
-    (filled.green * 255)/1000,
-    (filled.blue  * 255)/1000);
-
-fprintf(out_file,
-  "\" fill=%s stroke=\"#000000\" stroke-width=\"0.4\"/>\n", fill);
+sort_fill_stroke(attrs, filled, TRUE, black, 400, 0, 0);
+out_printf("\"%s/>\n", attrs);
 }
 
 
@@ -344,7 +598,7 @@ fprintf(out_file,
 *            Draw an elliptical arc              *
 *************************************************/
 
-static void arc(int clockwise, int x, int y, int radius1, int radius2,
+static void arc(int clockwise, dimen x, dimen y, dimen radius1, dimen radius2,
   double angle1, double angle2)
 {
 if (!clockwise)
@@ -369,8 +623,8 @@ else
 
 smallarc(radius1, radius2, angle1, angle2, rbezier);
 
-at_x = x + (int )((double)radius1 * cos(angle2));
-at_y = y + (int )((double)radius2 * sin(angle2));
+at_x = x + (dimen)((double)radius1 * cos(angle2));
+at_y = y + (dimen)((double)radius2 * sin(angle2));
 }
 
 
@@ -390,7 +644,7 @@ Returns:          nothing
 */
 
 static void
-write_arc(item_arc *p, BOOL move_needed, int startx, int starty)
+write_arc(item_arc *p, BOOL move_needed, dimen startx, dimen starty)
 {
 double radius = (double)p->radius;
 double angle1 = p->angle1;
@@ -428,14 +682,14 @@ if (p->arrow_start || p->arrow_end)
   if (p->arrow_start)
     {
     double angle = (p->cw)? (angle1 + pi/2.0 + tilt) : (angle1 - pi/2.0 - tilt);
-    arrowhead(p->x + (int )(radius * cos(angle1)), p->y + (int )(radius * sin(angle1)),
+    arrowhead(p->x + (dimen)(radius * cos(angle1)), p->y + (dimen)(radius * sin(angle1)),
       p->arrow_x, p->arrow_y, angle, p->arrow_filled);
     }
 
   if (p->arrow_end)
     {
     double angle = (p->cw)? (angle2 - pi/2.0 - tilt) : (angle2 + pi/2.0 + tilt);
-    arrowhead(p->x + (int )(radius * cos(angle2)), p->y + (int )(radius * sin(angle2)),
+    arrowhead(p->x + (dimen)(radius * cos(angle2)), p->y + (dimen)(radius * sin(angle2)),
       p->arrow_x, p->arrow_y, angle, p->arrow_filled);
     }
   }
@@ -493,48 +747,125 @@ rbezier(p->cx1, p->cy1, p->cx2, p->cy2, p->x1 - p->x0, p->y1 - p->y0);
 static void
 write_box(item_box *p)
 {
-int x = p->x - bbox[0];
-int y = p->y - bbox[1];
-uschar fill[12];
-uschar stroke[128];
+dimen x = p->x - bbox[0];
+dimen y = p->y - bbox[1];
+uschar attrs[ATTR_SIZE];
+
+/* A placed group uses its definition, transformed to the placement. The
+y-axis is inverted, so the rotation is reversed. */
 
-sort_fill_stroke(fill, p->shapefilled, stroke, p->style != is_invi, p->colour,
+if (p->boxtype == box_place)
+  {
+  item_place *pp = (item_place *)p;
+  out_printf("<use xlink:href=\"#G%d\" transform=\"translate(%R,%R)",
+    pp->group->number, x + pp->originx, -y - pp->originy);
+  if (pp->rotate != 0) out_printf(" rotate(%F)", -pp->rotate);
+  if (pp->scale != 1000) out_printf(" scale(%F)", pp->scale);
+  out_string(US"\"/>\n");
+  write_strings((item *)p);
+  return;
+  }
+
+sort_fill_stroke(attrs, p->shapefilled, p->style != is_invi, p->colour,
   p->thickness, p->dash1, p->dash2);
 
 if (p->boxtype == box_box)
-  fprintf(out_file, "<rect x=\"%s\" y=\"%s\" width=\"%s\" height=\"%s\" "
-    "fill=%s stroke=%s/>\n",
-    fixed(rnd(x - p->width/2)),
-    fixed(rnd(-y - p->depth/2)),
-    fixed(p->width),
-    fixed(p->depth),
-    fill,
-    stroke);
+  out_printf("<rect x=\"%R\" y=\"%R\" width=\"%F\" height=\"%F\"%s/>\n",
+    x - p->width/2,
+    -y - p->depth/2,
+    p->width,
+    p->depth,
+    attrs);
 
 else if (p->boxtype == box_circle)
-  fprintf(out_file, "<circle cx=\"%s\" cy=\"%s\" r=\"%s\" "
-    "fill=%s stroke=%s/>\n",
-    fixed(rnd(x)),
-    fixed(rnd(-y)),
-    fixed(p->width/2),
-    fill,
-    stroke);
+  out_printf("<circle cx=\"%R\" cy=\"%R\" r=\"%F\"%s/>\n",
+    x,
+    -y,
+    p->width/2,
+    attrs);
 
 else
-  fprintf(out_file, "<ellipse cx=\"%s\" cy=\"%s\" rx=\"%s\" ry=\"%s\" "
-    "fill=%s stroke=%s/>\n",
-    fixed(rnd(x)),
-    fixed(rnd(-y)),
-    fixed(p->width/2),
-    fixed(p->depth/2),
-    fill,
-    stroke);
+  out_printf("<ellipse cx=\"%R\" cy=\"%R\" rx=\"%F\" ry=\"%F\"%s/>\n",
+    x,
+    -y,
+    p->width/2,
+    p->depth/2,
+    attrs);
 
 write_strings((item *)p);
 }
 
 
 
+/*************************************************
+*          Process a polyline or polygon         *
+*************************************************/
+
+/* The whole path is written as a single element, with a few points on each
+output line. A spline is written as a path of relative Bezier curves, each of
+which ends at a rounded absolute position, so that rounding errors do not
+accumulate. */
+
+static void
+write_poly(item_poly *p)
+{
+uschar attrs[ATTR_SIZE];
+
+if (p->style == is_invi && samecolour(p->shapefilled, unfilled))
+  {
+  write_strings((item *)p);
+  return;
+  }
+
+sort_fill_stroke(attrs, p->shapefilled, p->style != is_invi, p->colour,
+  p->thickness, p->dash1, p->dash2);
+
+if (p->smooth)
+  {
+  dimen *pp = p->points;
+  dimen *ppend = pp + 2*p->count;
+  dimen lastx = rnd(pp[0] - bbox[0]);
+  dimen lasty = rnd(pp[1] - bbox[1]);
+
+  move(pp[0], pp[1]);
+  for (pp += 2; pp < ppend; pp += 6)
+    {
+    dimen x = rnd(pp[4] - bbox[0]);
+    dimen y = rnd(pp[5] - bbox[1]);
+    rbezier(pp[0] - bbox[0] - lastx, pp[1] - bbox[1] - lasty,
+      pp[2] - bbox[0] - lastx, pp[3] - bbox[1] - lasty, x - lastx, y - lasty);
+    lastx = x;
+    lasty = y;
+    }
+  out_printf("\"%s/>\n", attrs);
+  }
+
+else
+  {
+  out_printf("<%s points=\"", p->closed? "polygon" : "polyline");
+  path_space = FALSE;
+  for (int i = 0; i < p->count; i++)
+    {
+    dimen *pp = p->points + 2*i;
+    if (minimize)
+      {
+      dimen v[2] = { pp[0] - bbox[0], bbox[1] - pp[1] };
+      path_numbers(0, v, 2);
+      continue;
+      }
+    if (i != 0) out_char(((i & 7) == 0)? '\n' : ' ');
+    out_printf("%R,%R", pp[0] - bbox[0], bbox[1] - pp[1]);
+    }
+  out_printf("\"%s/>\n", attrs);
+  }
+
+at_x = p->x1;
+at_y = p->y1;
+write_strings((item *)p);
+}
+
+
+
 /*************************************************
 *               Process a line                   *
 *************************************************/
@@ -543,9 +874,9 @@ static void
 write_line(item_line *p, BOOL move_needed)
 {
 double angle = 0.0;
-int x1 = p->x, y1 = p->y;
-int xw = p->width, yd = p->depth;
-int xx = 0, yy = 0;
+dimen x1 = p->x, y1 = p->y;
+dimen xw = p->width, yd = p->depth;
+dimen xx = 0, yy = 0;
 
 /* Filling: generate the line even if it is invisible; no arrow can be
 involved. */
@@ -573,8 +904,8 @@ if (p->style == is_invi)
 if (p->arrow_start || p->arrow_end)
   {
   angle = atan2((double)p->depth, (double)p->width);
-  xx = (int )(((double)p->arrow_x) * cos(angle));
-  yy = (int )(((double)p->arrow_x) * sin(angle));
+  xx = (dimen)(((double)p->arrow_x) * cos(angle));
+  yy = (dimen)(((double)p->arrow_x) * sin(angle));
   }
 
 /* Adjust the line according to the arrow heads. */
@@ -619,6 +950,186 @@ if (p->arrow_end)
 
 
 
+/*************************************************
+*            Write a chain of items              *
+*************************************************/
+
+/* This is called for the main chain of items, and for the items in each group
+that is placed. The items are drawn in level order, as sorted by sort_items(),
+keeping their original order within each level.
+
+Argument:   the start of the chain
+Returns:    nothing
+*/
+
+static void
+write_items(item *base)
+{
+int count;
+item *prev = NULL;
+item **sorted = sort_items(base, &count);
+
+for (int i = 0; i < count; i++)
+  {
+  item *p = sorted[i];
+  BOOL restart = FALSE;
+  BOOL move_needed = FALSE;
+  dimen startx = 0, starty = 0;
+  item_arc *ppa;
+  item_curve *ppc;
+  item_line *ppl;
+
+  /* A path cannot continue to an item at a different level, or across an
+  item at another level in the chain. */
+
+  if (prev != NULL && (prev->level != p->level || prev->next != p))
+    end_line_fillstroke(prev->next);
+  prev = p;
+
+  switch (p->type)
+    {
+    case i_arc:
+    ppa = (item_arc *)p;
+    if (ppa->arrow_start) restart = TRUE;
+    startx = p->x + (dimen)((double)ppa->radius * cos(ppa->angle1));
+    starty = p->y + (dimen)((double)ppa->radius * sin(ppa->angle1));
+    goto ARCLINE;
+
+    case i_curve:
+    ppc = (item_curve *)p;
+    startx = ppc->x0;
+    starty = ppc->y0;
+    goto ARCLINE;
+
+    case i_line:
+    ppl = (item_line *)p;
+    if (ppl->arrow_start) restart = TRUE;
+    startx = p->x;
+    starty = p->y;
+
+    /* Common code for lines and arcs and curves */
+
+    ARCLINE:
+
+    if (startx != at_x || starty != at_y) restart = TRUE;
+
+    /* Sort out the other conditions under which we have to terminate an
+    existing path. */
+
+    if (!samecolour(p->shapefilled, fillpending? line_fill_colour : unfilled))
+      restart = TRUE;
+
+    if (strokepending)
+      {
+      if (!samecolour(p->colour, stroke_colour) ||
+          p->style == is_invi ||
+          stroke_thickness != p->thickness ||
+          stroke_dash1 != p->dash1 ||
+          stroke_dash2 != p->dash2)
+        restart = TRUE;
+      }
+    else
+      {
+      if (p->style != is_invi) restart = TRUE;
+      }
+
+    /* If starting a new path, end any previous one. */
+
+    if (restart) end_line_fillstroke(p);
+
+    /* Start stroking */
+
+    if (!strokepending && p->style != is_invi)
+      {
+      stroke_thickness = p->thickness;
+      stroke_dash1 = p->dash1;
+      stroke_dash2 = p->dash2;
+      stroke_colour = p->colour;
+      strokepending = TRUE;
+      pathstart = p;
+      move_needed = TRUE;
+      }
+
+    /* Start filling */
+
+    if (!fillpending && !samecolour(p->shapefilled, unfilled))
+      {
+      line_fill_colour = p->shapefilled;
+      fillpending = TRUE;
+      pathstart = p;
+      move_needed = TRUE;
+      }
+
+    /* Write the arc or the line or the curve */
+
+    if (p->type == i_arc)
+      write_arc((item_arc *)p, move_needed, startx, starty);
+    else if (p->type == i_curve)
+      write_curve((item_curve *)p, move_needed);
+    else
+      write_line((item_line *)p, move_needed);
+    break;
+
+    case i_box:
+    end_line_fillstroke(p);
+    write_box((item_box *)p);
+    break;
+
+    case i_poly:
+    end_line_fillstroke(p);
+    write_poly((item_poly *)p);
+    break;
+
+    case i_text:
+    end_line_fillstroke(p);
+    write_strings(p);
+    break;
+    }
+  }
+
+end_line_fillstroke((prev == NULL)? NULL : prev->next);
+}
+
+
+
+/*************************************************
+*          Write the definition of a group       *
+*************************************************/
+
+/* Each group that is placed is written once, inside <defs>, with coordinates
+relative to its origin; placements refer to it with <use>. Groups are written
+in the order they were defined, so that any group that is placed in another
+one is defined first.
+
+Argument:   the most recently defined group not yet considered
+Returns:    nothing
+*/
+
+static void
+write_groups(group *g)
+{
+dimen save_bbox0 = bbox[0];
+dimen save_bbox1 = bbox[1];
+
+if (g == NULL) return;
+write_groups(g->next);
+if (!g->used) return;
+
+bbox[0] = bbox[1] = 0;
+at_x = at_y = 0;
+
+if (!minimize) out_printf("<!-- Group %s -->\n", g->name);
+out_printf("<g id=\"G%d\">\n", g->number);
+write_items(g->items);
+out_string(US"</g>\n");
+
+bbox[0] = save_bbox0;
+bbox[1] = save_bbox1;
+at_x = at_y = 0;
+}
+
+
+
 /*************************************************
 *            Write SVG output file               *
 *************************************************/
@@ -627,8 +1138,9 @@ void
 write_sv(void)
 {
 tree_node *tnc, *tnd;
-int level;
-int bboxthick = (drawbbox == NULL)? 0 : drawbbox->thickness;
+group *g;
+BOOL groups_used;
+dimen bboxthick = (drawbbox == NULL)? 0 : drawbbox->thickness;
 
 line_fill_colour = unfilled;
 strokepending = FALSE;
@@ -640,28 +1152,74 @@ at_x = at_y = 0;
 
 find_bbox(bbox);
 
-/* Output header material */
+/* Output header material. Minimized output has no XML declaration, DOCTYPE,
+or comments, and numbers are written in minimal form. */
+
+if (minimize)
+  {
+  out_set_minimal(TRUE);
+  out_printf("<svg width=\"%F\" height=\"%F\"",
+    bbox[2] - bbox[0] + bboxthick, bbox[3] - bbox[1] + bboxthick);
+  }
+else
+  {
+  out_string(US"<?xml version=\"1.0\" standalone=\"no\"?>\n");
+  out_string(US"<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\"\n");
+  out_string(US"  \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n");
+  out_printf("<svg width=\"%F\" height=\"%F\" version=\"1.1\"\n    ",
+    bbox[2] - bbox[0] + bboxthick, bbox[3] - bbox[1] + bboxthick);
+  }
 
-fprintf(out_file, "<?xml version=\"1.0\" standalone=\"no\"?>\n");
-fprintf(out_file, "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\"\n");
-fprintf(out_file, "  \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n");
+/* The xlink namespace is needed only if groups are placed. */
 
-fprintf(out_file, "<svg width=\"%s\" height=\"%s\" version=\"1.1\"\n",
-  fixed(bbox[2] - bbox[0] + bboxthick), fixed(bbox[3] - bbox[1] + bboxthick));
+for (g = group_base; g != NULL; g = g->next) if (g->used) break;
+groups_used = g != NULL;
 
-fprintf(out_file, "     xmlns=\"http://www.w3.org/2000/svg\">\n\n");
+out_string(US" xmlns=\"http://www.w3.org/2000/svg\"");
+if (groups_used) out_string(minimize?
+  US" xmlns:xlink=\"http://www.w3.org/1999/xlink\">\n" :
+  US"\n     xmlns:xlink=\"http://www.w3.org/1999/xlink\">\n\n");
+else out_string(minimize? US">\n" : US">\n\n");
 
-tnc = tree_search(varroot, US"creator");
-tnd = tree_search(varroot, US"date");
-fprintf(out_file, "<!-- created by %s on %s, using Aspic %s -->\n",
-  tnc->value,  tnd->value, testing? "" : Version_String);
+if (!minimize)
+  {
+  tnc = tree_search(varroot, US"creator");
+  tnd = tree_search(varroot, US"date");
+  out_printf("<!-- created by %s on %s, using Aspic %s -->\n",
+    tnc->value,  tnd->value, testing? "" : Version_String);
+  }
 
 tnc = tree_search(varroot, US"title");
-fprintf(out_file, "<title>%s</title>\n\n", tnc->value);
+out_printf("<title>%s</title>\n%s", tnc->value, minimize? "" : "\n");
+
+/* If styles are written as classes, collect them from everything that is
+going to be drawn. */
 
-fprintf(out_file, "<g transform=\"translate(0,%s)\" "
+if (style_classes)
+  {
+  style_tree = NULL;
+  style_count = 0;
+  for (g = group_base; g != NULL; g = g->next)
+    if (g->used) collect_styles(g->items);
+  if (drawbbox != NULL)
+    add_style(drawbbox->shapefilled, drawbbox->style != is_invi,
+      drawbbox->colour, drawbbox->thickness, drawbbox->dash1, drawbbox->dash2);
+  collect_styles(main_item_base);
+  if (style_count > 0) write_styles();
+  }
+
+out_printf("<g transform=\"translate(0,%F)\" "
   "font-family=\"Times\" font-size=\"12\">\n",
-  fixed(bbox[3] - bbox[1] + bboxthick));
+  bbox[3] - bbox[1] + bboxthick);
+
+/* Define the groups that are placed */
+
+if (groups_used)
+  {
+  out_string(US"<defs>\n");
+  write_groups(group_base);
+  out_string(US"</defs>\n");
+  }
 
 /* Draw a frame if wanted */
 
@@ -674,125 +1232,12 @@ if (drawbbox != NULL)
   write_box(drawbbox);
   }
 
-/* Now process the items, repeating for each level */
-
-for (level = min_level; level <= max_level; level++)
-  {
-  item *p;
-
-  for (p = main_item_base; p != NULL; p = p->next)
-    {
-    BOOL restart = FALSE;
-    BOOL move_needed = FALSE;
-    int  startx = 0, starty = 0;
-    item_arc *ppa;
-    item_curve *ppc;
-    item_line *ppl;
-
-    if (p->level == level) switch (p->type)
-      {
-      case i_arc:
-      ppa = (item_arc *)p;
-      if (ppa->arrow_start) restart = TRUE;
-      startx = p->x + (int )((double)ppa->radius * cos(ppa->angle1));
-      starty = p->y + (int )((double)ppa->radius * sin(ppa->angle1));
-      goto ARCLINE;
-
-      case i_curve:
-      ppc = (item_curve *)p;
-      startx = ppc->x0;
-      starty = ppc->y0;
-      goto ARCLINE;
-
-      case i_line:
-      ppl = (item_line *)p;
-      if (ppl->arrow_start) restart = TRUE;
-      startx = p->x;
-      starty = p->y;
-
-      /* Common code for lines and arcs and curves */
+/* Now process the items */
 
-      ARCLINE:
-
-      if (startx != at_x || starty != at_y) restart = TRUE;
-
-      /* Sort out the other conditions under which we have to terminate an
-      existing path. */
-
-      if (!samecolour(p->shapefilled, fillpending? line_fill_colour : unfilled))
-        restart = TRUE;
-
-      if (strokepending)
-        {
-        if (!samecolour(p->colour, stroke_colour) ||
-            p->style == is_invi ||
-            stroke_thickness != p->thickness ||
-            stroke_dash1 != p->dash1 ||
-            stroke_dash2 != p->dash2)
-          restart = TRUE;
-        }
-      else
-        {
-        if (p->style != is_invi) restart = TRUE;
-        }
-
-      /* If starting a new path, end any previous one. */
-
-      if (restart) end_line_fillstroke(p);
-
-      /* Start stroking */
-
-      if (!strokepending && p->style != is_invi)
-        {
-        stroke_thickness = p->thickness;
-        stroke_dash1 = p->dash1;
-        stroke_dash2 = p->dash2;
-        stroke_colour = p->colour;
-        strokepending = TRUE;
-        pathstart = p;
-        move_needed = TRUE;
-        }
-
-      /* Start filling */
-
-      if (!fillpending && !samecolour(p->shapefilled, unfilled))
-        {
-        line_fill_colour = p->shapefilled;
-        fillpending = TRUE;
-        pathstart = p;
-        move_needed = TRUE;
-        }
-
-      /* Write the arc or the line or the curve */
-
-      if (p->type == i_arc)
-        write_arc((item_arc *)p, move_needed, startx, starty);
-      else if (p->type == i_curve)
-        write_curve((item_curve *)p, move_needed);
-      else
-        write_line((item_line *)p, move_needed);
-      break;
-
-      case i_box:
-      end_line_fillstroke(p);
-      write_box((item_box *)p);
-      break;
-
-      case i_text:
-      end_line_fillstroke(p);
-      write_strings(p);
-      break;
-      }
-
-    /* If hit an item at another level, stroke line and/or end line filling */
-
-    else end_line_fillstroke(p);
-    }
-
-  end_line_fillstroke(NULL);
-  }
+write_items(main_item_base);
 
-fprintf(out_file, "</g></svg>\n");
+out_string(US"</g></svg>\n");
+out_set_minimal(FALSE);
 }
 
 /* End of wrsv.c */
@@ -0,0 +1,432 @@
+/*************************************************
+*                      ASPIC                     *
+*************************************************/
+
+/* Copyright (c) University of Cambridge 1991 - 2023 */
+/* Created: October 2026 */
+/* Last modified: October 2026 */
+
+/* This module compresses output, in gzip format for .svgz files, or in zlib
+format for PDF streams. The data is passed here by the output layer in wrfile.c
+as each buffer is flushed, and the compressed data is written by
+out_write_raw(). If zlib is available (when HAVE_ZLIB is defined by the
+configure script), it is used. Otherwise there is a simple internal compressor,
+which finds repeated strings with a hash table and encodes everything as a
+single deflate block with the fixed Huffman codes. This is not as good as zlib,
+but SVG is repetitive enough for it to do well. */
+
+
+#include "aspic.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define ZBUFFERSIZE 16384      /* Buffer for compressed data */
+
+static uschar zbuffer[ZBUFFERSIZE];
+
+
+
+#ifdef HAVE_ZLIB
+/*************************************************
+*             Compression using zlib             *
+*************************************************/
+
+static z_stream zs;
+
+
+/* Start compressing. A window size of 15 plus 16 asks for a gzip header and
+trailer instead of a zlib one.
+
+Argument:  ZIP_GZIP or ZIP_ZLIB
+Returns:   nothing
+*/
+
+void
+zip_start(int format)
+{
+memset(&zs, 0, sizeof(zs));
+if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+    (format == ZIP_GZIP)? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+  {
+  /* LCOV_EXCL_START */
+  error_moan(68, "zlib initialization failed");
+  exit(EXIT_FAILURE);
+  /* LCOV_EXCL_STOP */
+  }
+}
+
+
+/* Compress some data, writing whatever is produced.
+
+Arguments:
+  s          the data
+  n          its length
+  final      TRUE for the last call, which may have no data
+
+Returns:     nothing
+*/
+
+void
+zip_data(const uschar *s, size_t n, BOOL final)
+{
+zs.next_in = (Bytef *)s;
+zs.avail_in = (uInt)n;
+
+do
+  {
+  zs.next_out = zbuffer;
+  zs.avail_out = ZBUFFERSIZE;
+  (void)deflate(&zs, final? Z_FINISH : Z_NO_FLUSH);
+  out_write_raw(zbuffer, ZBUFFERSIZE - zs.avail_out);
+  }
+while (zs.avail_out == 0);
+
+if (final) (void)deflateEnd(&zs);
+}
+
+
+
+#else  /* HAVE_ZLIB */
+/*************************************************
+*         Internal deflate compression           *
+*************************************************/
+
+#define WSIZE       32768      /* Deflate's maximum distance */
+#define WMASK       (WSIZE - 1)
+#define HASH_BITS   15
+#define HASH_SIZE   (1 << HASH_BITS)
+#define MIN_MATCH   3
+#define MAX_MATCH   258
+#define MAX_CHAIN   64         /* Limit on candidates for each position */
+
+/* The window holds up to two WSIZE halves; when it is full, the upper half is
+moved down. The hash table holds the most recent position for each hash of
+three bytes, and prev[] chains back to earlier ones, or -1. */
+
+static uschar window[2*WSIZE];
+static int  head[HASH_SIZE];
+static int  prev[WSIZE];
+static int  wlen;              /* Bytes in the window */
+static int  wpos;              /* Next byte to be compressed */
+
+static unsigned long int bitbuf;
+static int  bitcount;
+static int  zlen;              /* Bytes in zbuffer */
+
+static int  zip_format;        /* ZIP_GZIP or ZIP_ZLIB */
+static unsigned int crc;       /* Check value for gzip */
+static unsigned int crc_table[256];
+static unsigned int adler1;    /* Check value for zlib */
+static unsigned int adler2;
+static unsigned int total_in;
+
+/* Fixed Huffman codes for literals and lengths, reversed so that they can be
+written least significant bit first, and their lengths. */
+
+static unsigned short int lit_code[288];
+static uschar lit_bits[288];
+
+/* Base values and extra bits for the length and distance codes */
+
+static const unsigned short int len_base[] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+
+static const uschar len_extra[] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+
+static const unsigned short int dist_base[] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289,
+  16385, 24577 };
+
+static const uschar dist_extra[] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+
+
+/*************************************************
+*             Write bits and bytes               *
+*************************************************/
+
+static void
+put_byte(int c)
+{
+if (zlen >= ZBUFFERSIZE)
+  {
+  out_write_raw(zbuffer, zlen);
+  zlen = 0;
+  }
+zbuffer[zlen++] = (uschar)c;
+}
+
+
+static void
+put_bits(unsigned int value, int n)
+{
+bitbuf |= (unsigned long int)value << bitcount;
+bitcount += n;
+while (bitcount >= 8)
+  {
+  put_byte((int)(bitbuf & 0xff));
+  bitbuf >>= 8;
+  bitcount -= 8;
+  }
+}
+
+
+static unsigned int
+reverse(unsigned int code, int n)
+{
+unsigned int r = 0;
+while (n-- > 0) { r = (r << 1) | (code & 1); code >>= 1; }
+return r;
+}
+
+
+
+/*************************************************
+*          Write a literal or a match            *
+*************************************************/
+
+static void
+put_literal(int c)
+{
+put_bits(lit_code[c], lit_bits[c]);
+}
+
+
+static void
+put_match(int length, int distance)
+{
+int i;
+
+for (i = 28; len_base[i] > length; i--);
+put_bits(lit_code[257 + i], lit_bits[257 + i]);
+put_bits(length - len_base[i], len_extra[i]);
+
+for (i = 29; dist_base[i] > distance; i--);
+put_bits(reverse(i, 5), 5);
+put_bits(distance - dist_base[i], dist_extra[i]);
+}
+
+
+
+/*************************************************
+*         Add a position to the hash table       *
+*************************************************/
+
+static void
+insert(int p)
+{
+int h;
+if (p + MIN_MATCH > wlen) return;
+h = ((window[p] << 10) ^ (window[p+1] << 5) ^ window[p+2]) & (HASH_SIZE - 1);
+prev[p & WMASK] = head[h];
+head[h] = p;
+}
+
+
+
+/*************************************************
+*         Compress the data in the window        *
+*************************************************/
+
+/* Unless this is the final call, enough data is left uncompressed for the
+longest possible match to be found when more data arrives. The matching is
+greedy, taking the longest match at each position.
+
+Argument:  TRUE for the final call
+Returns:   nothing
+*/
+
+static void
+compress(BOOL final)
+{
+int limit = final? wlen : wlen - MAX_MATCH;
+
+while (wpos < limit)
+  {
+  int best = 0, distance = 0;
+  int max = wlen - wpos;
+
+  if (max > MAX_MATCH) max = MAX_MATCH;
+  if (max >= MIN_MATCH)
+    {
+    int h = ((window[wpos] << 10) ^ (window[wpos+1] << 5) ^ window[wpos+2]) &
+      (HASH_SIZE - 1);
+    int chain = MAX_CHAIN;
+
+    for (int c = head[h]; c >= 0 && c > wpos - WSIZE && chain-- > 0;
+         c = prev[c & WMASK])
+      {
+      int len = 0;
+      if (window[c + best] != window[wpos + best]) continue;
+      while (len < max && window[c + len] == window[wpos + len]) len++;
+      if (len > best)
+        {
+        best = len;
+        distance = wpos - c;
+        if (len >= max) break;
+        }
+      }
+    }
+
+  if (best >= MIN_MATCH)
+    {
+    put_match(best, distance);
+    while (best-- > 0) insert(wpos++);
+    }
+  else
+    {
+    put_literal(window[wpos]);
+    insert(wpos++);
+    }
+  }
+}
+
+
+
+/*************************************************
+*           Start compressing                    *
+*************************************************/
+
+/* The tables are set up, and the gzip or zlib header and the header of the
+single deflate block are written.
+
+Argument:  ZIP_GZIP or ZIP_ZLIB
+Returns:   nothing
+*/
+
+void
+zip_start(int format)
+{
+static const uschar gzip_header[] = {
+  0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+static const uschar zlib_header[] = { 0x78, 0x01 };
+
+for (unsigned int i = 0; i < 256; i++)
+  {
+  unsigned int c = i;
+  for (int k = 0; k < 8; k++) c = (c & 1)? 0xedb88320u ^ (c >> 1) : c >> 1;
+  crc_table[i] = c;
+  }
+
+for (int i = 0; i < 288; i++)
+  {
+  int code, bits;
+  if (i < 144) { code = 0x30 + i; bits = 8; }
+    else if (i < 256) { code = 0x190 + i - 144; bits = 9; }
+    else if (i < 280) { code = i - 256; bits = 7; }
+    else { code = 0xc0 + i - 280; bits = 8; }
+  lit_code[i] = (unsigned short int)reverse(code, bits);
+  lit_bits[i] = (uschar)bits;
+  }
+
+for (int i = 0; i < HASH_SIZE; i++) head[i] = -1;
+wlen = wpos = 0;
+bitbuf = 0;
+bitcount = 0;
+zlen = 0;
+crc = 0xffffffffu;
+adler1 = 1;
+adler2 = 0;
+total_in = 0;
+zip_format = format;
+
+if (format == ZIP_GZIP)
+  for (size_t i = 0; i < sizeof(gzip_header); i++) put_byte(gzip_header[i]);
+else
+  for (size_t i = 0; i < sizeof(zlib_header); i++) put_byte(zlib_header[i]);
+put_bits(1, 1);      /* Final block */
+put_bits(1, 2);      /* Fixed Huffman codes */
+}
+
+
+
+/*************************************************
+*             Compress some data                 *
+*************************************************/
+
+/* The data is copied into the window and compressed. When the window is full,
+its upper half is moved down, and the positions in the hash table and chains
+are adjusted; those that fall off the bottom become -1.
+
+Arguments:
+  s          the data
+  n          its length
+  final      TRUE for the last call, which may have no data
+
+Returns:     nothing
+*/
+
+void
+zip_data(const uschar *s, size_t n, BOOL final)
+{
+if (zip_format == ZIP_GZIP)
+  {
+  for (size_t i = 0; i < n; i++)
+    crc = crc_table[(crc ^ s[i]) & 0xff] ^ (crc >> 8);
+  }
+else for (size_t i = 0; i < n; i++)
+  {
+  adler1 = (adler1 + s[i]) % 65521;
+  adler2 = (adler2 + adler1) % 65521;
+  }
+total_in += (unsigned int)n;
+
+while (n > 0)
+  {
+  size_t k;
+
+  if (wlen == 2*WSIZE)
+    {
+    memmove(window, window + WSIZE, WSIZE);
+    wlen -= WSIZE;
+    wpos -= WSIZE;
+    for (int i = 0; i < HASH_SIZE; i++)
+      head[i] = (head[i] >= WSIZE)? head[i] - WSIZE : -1;
+    for (int i = 0; i < WSIZE; i++)
+      prev[i] = (prev[i] >= WSIZE)? prev[i] - WSIZE : -1;
+    }
+
+  k = 2*WSIZE - wlen;
+  if (k > n) k = n;
+  memcpy(window + wlen, s, k);
+  wlen += (int)k;
+  s += k;
+  n -= k;
+  compress(FALSE);
+  }
+
+if (!final) return;
+
+/* Finish the block and the stream, and write the trailer. For gzip this is
+the CRC and the length, least significant byte first; for zlib it is the
+Adler-32 checksum, most significant byte first. */
+
+compress(TRUE);
+put_bits(lit_code[256], lit_bits[256]);
+if (bitcount > 0) put_bits(0, 8 - bitcount);
+
+if (zip_format == ZIP_GZIP)
+  {
+  crc ^= 0xffffffffu;
+  for (int i = 0; i < 32; i += 8) put_byte((int)((crc >> i) & 0xff));
+  for (int i = 0; i < 32; i += 8) put_byte((int)((total_in >> i) & 0xff));
+  }
+else
+  {
+  unsigned int adler = (adler2 << 16) | adler1;
+  for (int i = 24; i >= 0; i -= 8) put_byte((int)((adler >> i) & 0xff));
+  }
+out_write_raw(zbuffer, zlen);
+zlen = 0;
+}
+#endif  /* HAVE_ZLIB */
+
+/* End of wrzip.c */